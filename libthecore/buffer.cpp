@@ -1,41 +1,225 @@
 #include "stdafx.h"
 
+#if !defined(_WIN64)
+#include <sys/mman.h>
+#endif
+
+/* SSE2 is part of x86-64, the bulk varint functions use it there */
+#if defined(__SSE2__) || defined(_M_X64)
+#define BUFFER_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+/* mremap is Linux only, other systems grow mapped buffers by copying */
+#if defined(__linux__)
+#define BUFFER_USE_MREMAP
+#endif
+
 #define BUFFER_REALLOC_SIZE 10240
+
+/* amount of buffers a single magazine can hold before it is handed to the depot */
+#define BUFFER_MAGAZINE_SIZE 32
+
+/* bytes a single magazine may hold, big size classes get magazines of fewer buffers */
+#define BUFFER_MAGAZINE_MAX_BYTES (1024 * 1024)
+
+/* default pool policy: the depot of a class holds at most this many idle bytes, */
+#define BUFFER_POOL_DEFAULT_HIGH_BYTES (32 * 1024 * 1024)
+
+/* and trimming brings an idle class down to this many bytes */
+#define BUFFER_POOL_DEFAULT_LOW_BYTES (4 * 1024 * 1024)
+
+/* the depot stacks keep a 16 bit ABA tag in the upper bits of the packed head */
+#define BUFFER_DEPOT_PTR_MASK 0x0000FFFFFFFFFFFFull
+#define BUFFER_DEPOT_TAG_SHIFT 48
+
+/***
+ * TBufferMagazine - a fixed size stack of pooled buffers of the same size class.
+ * Magazines are the unit of exchange between the per-thread caches and the
+ * shared depot, so the shared state is only touched once per BUFFER_MAGAZINE_SIZE
+ * allocations or frees. Magazines are never freed once created, which keeps
+ * the lock-free depot pop safe from reading released memory.
+ */
+typedef struct SBufferMagazine
+{
+	/* Pointer to the next magazine while it is parked in the depot, atomic because
+	 * a thread losing the race for the head still reads it */
+	std::atomic<SBufferMagazine*> next;
+
+	/* The amount of buffers currently held by the magazine */
+	int32_t count;
+
+	/* The amount of buffers the magazine may hold, depends on the size class */
+	int32_t capacity;
+
+	/* The pooled buffers (rounds) of this magazine */
+	LPBUFFER rounds[BUFFER_MAGAZINE_SIZE];
+} TBufferMagazine;
+
+/***
+ * TBufferDepot - the shared, lock-free part of one size class.
+ * Both stacks are Treiber stacks whose head packs the magazine pointer with an
+ * ABA tag, so pushes and pops are a single compare-and-swap each.
+ */
+typedef struct SBufferDepot
+{
+	/* Stack of magazines that hold buffers */
+	std::atomic<uint64_t> full;
+
+	/* Stack of magazines that hold no buffers, kept for reuse */
+	std::atomic<uint64_t> empty;
+
+	/* The amount of buffers held by the full stack */
+	std::atomic<int32_t> pooled;
+
+	/* The amount of full magazines taken by threads, an unchanged value means the class is idle */
+	std::atomic<uint32_t> refills;
+
+	/* Pool policy in buffers, 0 means the default of the class is used */
+	std::atomic<int32_t> low_water;
+	std::atomic<int32_t> high_water;
+
+	/* The amount of buffers of the class that exist, in use or pooled */
+	std::atomic<int64_t> total;
+
+	/* The highest total seen */
+	std::atomic<int64_t> peak;
+
+	/* The amount of buffers given back to the system by the watermarks and trimming */
+	std::atomic<uint64_t> trimmed;
+} TBufferDepot;
+
+/***
+ * TBufferThreadCache - the per-thread magazine pair of every size class.
+ * The loaded magazine serves allocations and frees, the previous one lets a
+ * thread bounce around a magazine boundary without touching the depot.
+ * This struct is trivially constructible so accessing it costs no TLS guard.
+ */
+typedef struct SBufferThreadCache
+{
+	/* The magazine currently used for allocations and frees */
+	TBufferMagazine* loaded[BUFFER_POOL_COUNT];
+
+	/* The magazine used before the loaded one */
+	TBufferMagazine* previous[BUFFER_POOL_COUNT];
+
+	/* Allocation counters, only written by the owning thread and summed by buffer_pool_get_stats */
+	std::atomic<uint64_t> hits[BUFFER_POOL_COUNT];
+	std::atomic<uint64_t> misses[BUFFER_POOL_COUNT];
+	std::atomic<uint64_t> frees[BUFFER_POOL_COUNT];
+
+	/* Links of the list of registered thread caches */
+	SBufferThreadCache* next_registered;
+	SBufferThreadCache* prev_registered;
+
+	/* true once the thread exit handler has been registered */
+	bool registered;
+} TBufferThreadCache;
+
 /***
- * normalized_buffer_pool - The normalized_buffer_pool is an array of pointers to linked lists of buffers,
- * categorized by size. Each index in the array represents buffers of sizes that 
- * are powers of two (e.g., index 0 for size 1 byte, index 1 for size 2 bytes,
- * index 2 for size 4 bytes, ..., index 31 for size 2^31 bytes).
+ * normalized_buffer_pool - The normalized_buffer_pool is an array of depots of buffers,
+ * categorized by size class. Sizes up to 16 bytes are powers of two (index 0 for
+ * size 1 byte, index 1 for size 2 bytes, ..., index 4 for size 16 bytes), every
+ * bigger power of two is split into four classes of 1.25, 1.5, 1.75 and 2 times
+ * the previous power (20, 24, 28, 32, 40, 48, ...), so a request never pins more
+ * than 25% extra memory (a 4200 bytes packet takes 5 KB instead of 8 KB).
  * This allows efficient management of buffers by reusing memory from the pool
  * instead of constantly allocating and deallocating buffers, which can be costly.
- * When a buffer of a certain size is needed, the corresponding pool (index) is
- * checked first. If a buffer is available, it is reused; otherwise, a new buffer
- * is allocated. This approach helps reduce memory fragmentation and allocation overhead.
+ * When a buffer of a certain size is needed, the calling thread's magazine of the
+ * corresponding pool (index) is checked first, then the shared depot. If a buffer is
+ * available, it is reused; otherwise, a new buffer is allocated. This approach helps
+ * reduce memory fragmentation and allocation overhead, and lets any thread use the pool.
+ */
+static TBufferDepot normalized_buffer_pool[BUFFER_POOL_COUNT];
+
+/* counters of how buffer_write and buffer_adjust_size made room, see buffer_get_write_stats */
+static std::atomic<uint64_t> buffer_write_compactions(0);
+static std::atomic<uint64_t> buffer_write_compacted_bytes(0);
+static std::atomic<uint64_t> buffer_write_reallocations(0);
+static std::atomic<uint64_t> buffer_write_remaps(0);
+
+/* per-thread magazines in front of normalized_buffer_pool */
+static thread_local TBufferThreadCache buffer_thread_cache;
+
+/* guards the list of registered thread caches and the counters of exited threads */
+static std::mutex buffer_thread_cache_lock;
+
+/* the registered thread caches, their counters are summed by buffer_pool_get_stats */
+static TBufferThreadCache* buffer_thread_cache_list = nullptr;
+
+/* counters of the threads that already exited */
+static uint64_t buffer_retired_hits[BUFFER_POOL_COUNT];
+static uint64_t buffer_retired_misses[BUFFER_POOL_COUNT];
+static uint64_t buffer_retired_frees[BUFFER_POOL_COUNT];
+
+/***
+ * buffer_bit_scan_reverse - Get the index of the highest set bit.
+ * @uValue: The value to scan, must not be zero.
+ *
+ * Return: The index of the most significant set bit (floor of log2).
+ */
+static inline int32_t buffer_bit_scan_reverse(uint32_t uValue)
+{
+#if defined(_WIN64)
+	unsigned long ulIndex;
+	_BitScanReverse(&ulIndex, uValue);
+	return ((int32_t)ulIndex);
+#else
+	return (31 - __builtin_clz(uValue));
+#endif
+}
+
+/**
+ * buffer_get_pool_size - Get the buffer size of a pool index.
+ * @iPoolIndex: The index of the buffer pool.
+ *
+ * Return: The size in bytes of every buffer held by the pool.
  */
-static LPBUFFER normalized_buffer_pool[32] = { nullptr, };
+static int32_t buffer_get_pool_size(int32_t iPoolIndex)
+{
+	if (iPoolIndex <= BUFFER_POOL_SMALL_SHIFT)
+	{
+		return (1 << iPoolIndex);
+	}
+
+	/* the power of two the class lies above, and the step of the class within it */
+	int32_t iRelative = iPoolIndex - (BUFFER_POOL_SMALL_SHIFT + 1);
+	int32_t iShift = BUFFER_POOL_SMALL_SHIFT + iRelative / BUFFER_POOL_CLASSES_PER_POW2;
+	int32_t iStep = iRelative % BUFFER_POOL_CLASSES_PER_POW2;
+
+	/* ex. iShift = 12 (4096), iStep = 0, result is 5 * 1024 = 5120 */
+	return ((BUFFER_POOL_CLASSES_PER_POW2 + iStep + 1) << (iShift - BUFFER_POOL_CLASS_BITS));
+}
 
 /**
  * buffer_get_pool_index - Get the index of the buffer pool size for allocation.
  * @iSize: The size of the buffer needed.
  *
- * This function calculates the index of the buffer pool that can accommodate
- * the specified size. The buffer sizes are powers of 2, and the function
- * returns the index of the first buffer size that is greater than or equal to
- * the requested size. If the size is too large to be pooled, returns -1.
+ * This function calculates the index of the smallest size class that can
+ * accommodate the specified size in constant time: the highest set bit of
+ * (iSize - 1) selects the power of two, and the next two bits select one of
+ * the four classes above it. If the size is too large to be pooled, returns -1.
  *
  * Return: Index of the buffer pool, or -1 if the size is too large.
  */
 static int32_t buffer_get_pool_index(int32_t iSize)
 {
-	for (int32_t i = 0; i < 32; i++)
+	if (iSize <= (1 << BUFFER_POOL_SMALL_SHIFT))
 	{
-		/* i is powers of 2, ex. when i = 3, result is 8 (2*2*2) */
-		if ((1 << i) >= iSize)
-		{
-			return (i);
-		}
+		/* i is powers of 2, ex. when iSize = 5, result is 3 (2*2*2 = 8) */
+		return (iSize <= 1 ? 0 : buffer_bit_scan_reverse((uint32_t)(iSize - 1)) + 1);
+	}
+
+	if (iSize > (1 << BUFFER_POOL_MAX_SHIFT))
+	{
+		return (-1); /* Too big, not pooled. */
 	}
-	return (-1); /* Too big, not pooled. */
+
+	uint32_t uValue = (uint32_t)(iSize - 1);
+	int32_t iShift = buffer_bit_scan_reverse(uValue);
+	int32_t iStep = (int32_t)(uValue >> (iShift - BUFFER_POOL_CLASS_BITS)) & (BUFFER_POOL_CLASSES_PER_POW2 - 1);
+
+	return (BUFFER_POOL_SMALL_SHIFT + 1 + (iShift - BUFFER_POOL_SMALL_SHIFT) * BUFFER_POOL_CLASSES_PER_POW2 + iStep);
 }
 
 
@@ -44,610 +228,2222 @@ static int32_t buffer_get_pool_index(int32_t iSize)
  * @iSize: The exact size of the buffer needed.
  *
  * This function calculates the index of the buffer pool that exactly matches
- * the requested size. The sizes in the pool are powers of 2, and the function
- * returns the index if it finds an exact match. If the size is too large or
- * doesn't exactly match, it returns -1.
+ * the requested size, so buffers go back to the size class they came from.
+ * If the size is too large or isn't a size class, it returns -1.
  *
  * Return: Exact index of the buffer pool, or -1 if no exact match is found.
  */
 static int32_t buffer_get_exact_pool_index(int32_t iSize)
 {
-	for (int32_t i = 0; i < 32; i++)
+	int32_t iPoolIndex = buffer_get_pool_index(iSize);
+
+	if (iPoolIndex < 0 || buffer_get_pool_size(iPoolIndex) != iSize)
 	{
-		if ((1 << i) == iSize)
-		{
-			return (i);
-		}
+		return (-1); /* Too big, or not a pooled size. */
 	}
-	return (-1); /* Too big, not pooled. */
+
+	return (iPoolIndex);
 }
 
-/**
- * buffer_pool_free - Free all buffer pools.
+/***
+ * buffer_depot_push - Push a magazine onto one of the depot stacks.
+ * @stack: The packed stack head (full or empty stack of a depot).
+ * @magazine: The magazine to push.
  *
- * This function frees all buffers in all pool levels. It iterates over each
- * buffer pool, releasing the memory of each buffer in the pool and setting the
- * pool to NULL.
  * Return: Nothing (void.)
  */
-static void buffer_pool_free()
+static void buffer_depot_push(std::atomic<uint64_t>& stack, TBufferMagazine* magazine)
 {
-	for (int32_t i = 31; i >= 0; i--)
+	uint64_t ullHead = stack.load(std::memory_order_acquire);
+	uint64_t ullNewHead;
+
+	do
 	{
-		if (normalized_buffer_pool[i] != nullptr)
-		{
-			LPBUFFER nextBuffer = nullptr;
-			for (LPBUFFER buffer = normalized_buffer_pool[i]; buffer != nullptr; buffer = nextBuffer)
-			{
-				nextBuffer = buffer->next;
-				free(buffer->mem_data);
-				free(buffer);
-			}
-			normalized_buffer_pool[i] = nullptr;
-		}
-	}
+		magazine->next.store((TBufferMagazine*)(uintptr_t)(ullHead & BUFFER_DEPOT_PTR_MASK), std::memory_order_relaxed);
+		ullNewHead = (((ullHead >> BUFFER_DEPOT_TAG_SHIFT) + 1) << BUFFER_DEPOT_TAG_SHIFT) | (uint64_t)(uintptr_t)magazine;
+	} while (!stack.compare_exchange_weak(ullHead, ullNewHead, std::memory_order_release, std::memory_order_acquire));
 }
 
-/**
- * buffer_larger_pool_free - Free one larger buffer pool.
- * @iIndex: The index of the current pool size.
+/***
+ * buffer_depot_pop - Pop a magazine from one of the depot stacks.
+ * @stack: The packed stack head (full or empty stack of a depot).
  *
- * This function frees one buffer from the pool larger than the specified index
- * @iIndex. It searches the buffer pools from index 31 down to @iIndex, frees a buffer if
- * found, and returns true. If no larger buffer is found, it returns false.
+ * The tag in the upper bits changes on every successful exchange, so a head that
+ * was popped and pushed back in between can't be mistaken for an unchanged one.
  *
- * Return: True if a buffer was freed, false otherwise.
+ * Return: The popped magazine, or nullptr if the stack is empty.
  */
-static bool buffer_larger_pool_free(int32_t iIndex)
+static TBufferMagazine* buffer_depot_pop(std::atomic<uint64_t>& stack)
 {
-	for (int32_t i = 31; i > iIndex; i--)
+	uint64_t ullHead = stack.load(std::memory_order_acquire);
+
+	while (true)
 	{
-		if (normalized_buffer_pool[i])
+		TBufferMagazine* magazine = (TBufferMagazine*)(uintptr_t)(ullHead & BUFFER_DEPOT_PTR_MASK);
+		if (magazine == nullptr)
 		{
-			LPBUFFER buffer = normalized_buffer_pool[i];
-			LPBUFFER next = buffer->next;
-			free(buffer->mem_data);
-			free(buffer);
-			normalized_buffer_pool[i]->next = next;
-			return (true);
+			return (nullptr);
 		}
-	}
 
-	return(false);
+		uint64_t ullNewHead = (((ullHead >> BUFFER_DEPOT_TAG_SHIFT) + 1) << BUFFER_DEPOT_TAG_SHIFT) | (uint64_t)(uintptr_t)magazine->next.load(std::memory_order_relaxed);
+		if (stack.compare_exchange_weak(ullHead, ullNewHead, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			magazine->next.store(nullptr, std::memory_order_relaxed);
+			return (magazine);
+		}
+	}
 }
 
 /***
- * safe_create - Safely allocate memory and handle errors.
- * @pData: Double pointer to the data to be allocated.
- * @iNum: The number of elements to allocate.
- *
- * This function allocates memory for @pData using calloc and handles memory
- * allocation failure by logging an error message and returning false. If the
- * allocation is successful, it returns true.
+ * buffer_free_memory - Release the memory of a buffer to the allocator that owns it.
+ * @buffer: The buffer to release, it must not be used afterwards.
  *
- * Return: True if memory allocation is successful, otherwise false.
+ * Return: Nothing (void.)
  */
-bool safe_create(char** pData, int32_t iNum)
+static void buffer_free_memory(LPBUFFER buffer)
 {
-	(*pData) = (char*)calloc(iNum, sizeof(char));
-	if (!(*pData))
+	if (buffer->alloc_type == BUFFER_ALLOC_SLAB)
 	{
-		sys_err("calloc failed, Error[%d] : %s", errno, strerror(errno));
-		return (false);
+		/* header and payload are one slab chunk */
+		buffer_slab_free(buffer);
+		return;
 	}
-	return(true);
+
+#if !defined(_WIN64)
+	if (buffer->alloc_type == BUFFER_ALLOC_MMAP)
+	{
+		/* the payload is an anonymous mapping */
+		munmap(buffer->mem_data, buffer->mem_size);
+		free(buffer);
+		return;
+	}
+#endif
+
+	/* free the memory allocated for mem_data */
+	free(buffer->mem_data);
+	/* free the buffer itself, ensuring that all allocated resources are properly released to avoid memory leaks */
+	free(buffer);
 }
 
 /***
- * buffer_new - Create a new buffer of the specified size.
- * @iSize: The size of the buffer to be created.
- *
- * This function creates a new buffer from the pool if the requested size can
- * be pooled. If a suitable buffer is not available, it tries to allocate memory.
- * If allocation fails, it frees buffers from the pool and retries.
+ * buffer_pool_low_water - Get the low watermark of a pool.
+ * @iPoolIndex: The index of the buffer pool.
  *
- * Return: A pointer to the newly created buffer, or nullptr if the size is invalid.
+ * Return: The amount of idle buffers trimming keeps in the depot.
  */
+static int32_t buffer_pool_low_water(int32_t iPoolIndex)
+{
+	int32_t iLowWater = normalized_buffer_pool[iPoolIndex].low_water.load(std::memory_order_relaxed);
+	return (iLowWater > 0 ? iLowWater : (int32_t)(BUFFER_POOL_DEFAULT_LOW_BYTES / buffer_get_pool_size(iPoolIndex)));
+}
 
-LPBUFFER buffer_new(int32_t iSize)
+/***
+ * buffer_pool_high_water - Get the high watermark of a pool.
+ * @iPoolIndex: The index of the buffer pool.
+ *
+ * Return: The most idle buffers the depot holds, extra ones are freed.
+ */
+static int32_t buffer_pool_high_water(int32_t iPoolIndex)
 {
-	if (iSize < 0)
-	{
-		return (nullptr);
-	}
+	int32_t iHighWater = normalized_buffer_pool[iPoolIndex].high_water.load(std::memory_order_relaxed);
+	return (iHighWater > 0 ? iHighWater : std::max<int32_t>(1, (int32_t)(BUFFER_POOL_DEFAULT_HIGH_BYTES / buffer_get_pool_size(iPoolIndex))));
+}
 
-	LPBUFFER buffer = nullptr;
-	/* etermine the index of the buffer pool that can accommodate a buffer of the requested size,
-	 * The function returns the index based on the size as a power of two (e.g., sizes of 1, 2, 4, 8, etc.)
-	 * if none is available with request size then create new one.
-	 */
-	int32_t iPoolIndex = buffer_get_pool_index(iSize);
+/***
+ * buffer_pool_created - Account a buffer created for a pool.
+ * @iPoolIndex: The index of the buffer pool.
+ *
+ * Return: Nothing (void.)
+ */
+static void buffer_pool_created(int32_t iPoolIndex)
+{
+	TBufferDepot* depot = &normalized_buffer_pool[iPoolIndex];
+	int64_t llTotal = depot->total.fetch_add(1, std::memory_order_relaxed) + 1;
+	int64_t llPeak = depot->peak.load(std::memory_order_relaxed);
 
-	if (iPoolIndex >= 0)
+	while (llTotal > llPeak && !depot->peak.compare_exchange_weak(llPeak, llTotal, std::memory_order_relaxed))
 	{
-		/* gets a pointer to the appropriate buffer pool from the normalized_buffer_pool array using the iPoolIndex
-		 * It points to the linked list of buffers that can be reused, moves the pointer forward by iPoolIndex elements, not bytes
-		 */
-		BUFFER** buffer_pool = normalized_buffer_pool + iPoolIndex;
+	}
+}
 
-		/* updates iSize to the actual size of the buffer that corresponds to the pool index,
-		 * The expression 1 << iPoolIndex calculates the size as a power of two (e.g., if iPoolIndex is 3, then iSize becomes 8).
-		 */
-		iSize = 1 << iPoolIndex;
+/***
+ * buffer_pool_release - Give a pooled buffer back to the system.
+ * @iPoolIndex: The index of the buffer pool the buffer belongs to.
+ * @buffer: The buffer to release.
+ *
+ * Return: Nothing (void.)
+ */
+static void buffer_pool_release(int32_t iPoolIndex, LPBUFFER buffer)
+{
+	buffer_free_memory(buffer);
+	normalized_buffer_pool[iPoolIndex].total.fetch_sub(1, std::memory_order_relaxed);
+	normalized_buffer_pool[iPoolIndex].trimmed.fetch_add(1, std::memory_order_relaxed);
+}
 
-		/* check if there is an existing buffer in the pool */
-		if (*buffer_pool)
-		{
-			/* retrieves the first buffer from the pool and assigns it to buffer */
-			buffer = *buffer_pool;
+/***
+ * buffer_depot_take - Take a magazine holding buffers from the depot of a pool.
+ * @iPoolIndex: The index of the buffer pool.
+ *
+ * Return: The magazine, or nullptr if the depot holds no buffer.
+ */
+static TBufferMagazine* buffer_depot_take(int32_t iPoolIndex)
+{
+	TBufferDepot* depot = &normalized_buffer_pool[iPoolIndex];
+	TBufferMagazine* magazine = buffer_depot_pop(depot->full);
 
-			/* updates the head of the pool to point to the next buffer in the linked list (buffer->next),
-			 * effectively removing the retrieved buffer from the pool for use.
-			 */
-			*buffer_pool = buffer->next;
-		}
-	}
-	
-	if (buffer == nullptr)
+	if (magazine)
 	{
-		/* create new buffer */
-		CREATE(buffer, BUFFER, 1);
-		buffer->mem_size = iSize;
-		/* calloc failures frequently occur in buffer_new(especially on low - end machines in Turkiye),
-		 * so if calloc fails, the buffer pool is cleared and the operation is retried.
-		 */
-		if (!safe_create(&buffer->mem_data, iSize))
-		{
-			/* Releases one buffer from the pool that is larger than the required buffer. */
-			if (buffer_larger_pool_free(iPoolIndex))
-			{
-				/* If this fails, as a last resort, all pools are cleared. */
-				buffer_pool_free();
-			}
-			CREATE(buffer->mem_data, char, iSize);
-			sys_err("buffer pool free success");
-		}
+		depot->pooled.fetch_sub(magazine->count, std::memory_order_relaxed);
+		depot->refills.fetch_add(1, std::memory_order_relaxed);
 	}
 
-	assert(buffer != nullptr);
-	assert(buffer->mem_size == iSize);
-	assert(buffer->mem_data != nullptr);
-
-	/* Reset buffer data, ensuring everything is clean and clear. */
-	buffer_reset(buffer);
-
-	return(buffer);
+	return (magazine);
 }
 
 /***
- * buffer_delete - Free or return buffer to the pool.
- * @buffer: Pointer to the buffer to delete.
+ * buffer_depot_put - Hand a magazine to the depot of a pool.
+ * @iPoolIndex: The index of the buffer pool.
+ * @magazine: The magazine, full, partially filled or empty.
  *
- * This function resets the buffer, then returns it to the pool if it belongs
- * to a pooled size. If it does not belong to a pool, the buffer's memory is
- * freed.
+ * Buffers that would take the depot past its high watermark are given back to
+ * the system, so the idle memory of a class stays bounded.
  * Return: Nothing (void.)
  */
-void buffer_delete(LPBUFFER buffer)
+static void buffer_depot_put(int32_t iPoolIndex, TBufferMagazine* magazine)
 {
-	if (!buffer)
+	TBufferDepot* depot = &normalized_buffer_pool[iPoolIndex];
+	int32_t iRoom = buffer_pool_high_water(iPoolIndex) - depot->pooled.load(std::memory_order_relaxed);
+
+	while (magazine->count > 0 && magazine->count > iRoom)
 	{
-		return;
+		buffer_pool_release(iPoolIndex, magazine->rounds[--magazine->count]);
 	}
 
-	/* reset buffer data, make it's state clear */
-	buffer_reset(buffer);
-
-	/* store the buffer size, to use getting exact correct buffer pool index */
-	int32_t iSize = buffer->mem_size;
-
-	/* get the exact pool index for the size of the buffer */
-	int32_t iPoolIndex = buffer_get_exact_pool_index(iSize);
-
-	/* checks if a valid pool index was found, it means theres a pool that can hold buffers of this size */
-	if (iPoolIndex >= 0)
+	if (magazine->count > 0)
 	{
-		/* gets a pointer to the appropriate buffer pool from the normalized_buffer_pool array using the iPoolIndex
-		 * It points to the linked list of buffers that can be reused, moves the pointer forward by iPoolIndex elements, not bytes
-		 */
-		BUFFER** buffer_pool = normalized_buffer_pool + iPoolIndex;
-
-		/* links the current buffer (buffer) to the start of the existing buffer pool by setting its next pointer to point to the current first buffer in the pool */
-		buffer->next = *buffer_pool;
-
-		/* updates the buffer pool to point to the current buffer, effectively adding it to the front of the pool. This means the current buffer is now available for reuse */
-		*buffer_pool = buffer;
+		depot->pooled.fetch_add(magazine->count, std::memory_order_relaxed);
+		buffer_depot_push(depot->full, magazine);
 	}
-	else /* no valid pool index was found */
+	else
 	{
-		/* free the memory allocated for mem_data */
-		free(buffer->mem_data);
-		/* free the buffer itself, ensuring that all allocated resources are properly released to avoid memory leaks */
-		free(buffer);
+		buffer_depot_push(depot->empty, magazine);
 	}
 }
 
 /***
- * buffer_reset - Reset buffer to its initial state.
- * @buffer: The buffer to reset.
+ * buffer_magazine_new - Get an empty magazine for the given pool.
+ * @iPoolIndex: The index of the buffer pool.
  *
- * This function resets the buffer's read and write pointers and other internal
- * fields, effectively clearing it for reuse.
- * Return: Nothing (void.)
+ * Reuses an empty magazine from the depot when possible, otherwise a new one
+ * is allocated.
+ *
+ * Return: A magazine holding no buffers.
  */
-void buffer_reset(LPBUFFER buffer)
+static TBufferMagazine* buffer_magazine_new(int32_t iPoolIndex)
 {
-	buffer->read_point = buffer->mem_data;
-	buffer->write_point = buffer->mem_data;
-	buffer->write_point_pos = 0;
-	buffer->length = 0;
-	buffer->next = nullptr;
-	buffer->flag = 0;
+	TBufferMagazine* magazine = buffer_depot_pop(normalized_buffer_pool[iPoolIndex].empty);
+
+	if (magazine == nullptr)
+	{
+		CREATE(magazine, TBufferMagazine, 1);
+		magazine->capacity = std::max<int32_t>(1, std::min<int32_t>(BUFFER_MAGAZINE_SIZE, BUFFER_MAGAZINE_MAX_BYTES / buffer_get_pool_size(iPoolIndex)));
+	}
+
+	magazine->count = 0;
+	return (magazine);
 }
 
-/**
- * buffer_realloc - Reallocates the given buffer to accommodate additional memory
- * @buffer: The buffer to be reallocated (passed by reference)
- * @length: The new desired length for the buffer
- *
- * This function checks if the buffer's current size is less than the requested
- * size. If so, it allocates a new buffer with the requested size, copies the
- * data from the old buffer into the new one, and updates the read and write
- * pointers to maintain their relative positions. It then frees the old buffer
- * and assigns the new buffer in its place. If the requested length is less than
- * or equal to the current size, no reallocation is performed.
+/***
+ * buffer_magazine_free_rounds - Free every buffer held by a magazine.
+ * @iPoolIndex: The index of the buffer pool the magazine belongs to.
+ * @magazine: The magazine to empty.
  *
- * Return: Nothing (void.)
+ * Return: The amount of buffers that were freed.
  */
-void buffer_realloc(LPBUFFER& buffer, int32_t iLength)
+static int32_t buffer_magazine_free_rounds(int32_t iPoolIndex, TBufferMagazine* magazine)
 {
-	int32_t i;
-	LPBUFFER tempBuf;
-
-	assert(iLength >= 0 && "buffer_realloc: buffer length is less than zero!");
+	int32_t iFreed = magazine->count;
 
-	/* buffer size already bigger or equal to the needed, don't reallocate */
-	if (buffer->mem_size >= iLength)
+	while (magazine->count > 0)
 	{
-		return;
+		buffer_pool_release(iPoolIndex, magazine->rounds[--magazine->count]);
 	}
 
-	/* i is the difference between the newly allocated size and the previous size,
-	 * which is actually the size of the newly created memory (the amount of memory needed).
-	 */
-	i = iLength - buffer->mem_size;
+	return (iFreed);
+}
 
-	/* if there's no extra memory needed, don't reallocate */
-	if (i <= 0)
-	{
-		return;
-	}
+/***
+ * buffer_thread_cache_drain - Return the calling thread's magazines to the depot.
+ *
+ * Partially filled magazines go to the full stack, so no buffer is lost when a
+ * thread exits. Called automatically on thread exit.
+ * Return: Nothing (void.)
+ */
+static void buffer_thread_cache_drain()
+{
+	TBufferThreadCache* cache = &buffer_thread_cache;
+
+	for (int32_t i = 0; i < BUFFER_POOL_COUNT; i++)
+	{
+		TBufferMagazine* magazines[2] = { cache->loaded[i], cache->previous[i] };
+
+		for (TBufferMagazine* magazine : magazines)
+		{
+			if (magazine == nullptr)
+			{
+				continue;
+			}
+
+			buffer_depot_put(i, magazine);
+		}
+
+		cache->loaded[i] = nullptr;
+		cache->previous[i] = nullptr;
+	}
+}
+
+/***
+ * buffer_thread_cache_trim - Hand the calling thread's cached buffers to the depot.
+ *
+ * buffer_pool_trim only reaches the depot, a thread that went idle after a
+ * burst keeps up to two magazines per size class until it exits. Threads that
+ * stay alive call this once they have been idle for a while (the reactor
+ * shards do it on their own), the depot then keeps what its high watermark
+ * allows and buffer_pool_trim gives the rest back to the system.
+ *
+ * Return: The amount of bytes handed to the depot.
+ */
+int64_t buffer_thread_cache_trim()
+{
+	TBufferThreadCache* cache = &buffer_thread_cache;
+	int64_t llCached = 0;
+
+	for (int32_t i = 0; i < BUFFER_POOL_COUNT; i++)
+	{
+		int32_t iCount = 0;
+
+		if (cache->loaded[i])
+		{
+			iCount += cache->loaded[i]->count;
+		}
+
+		if (cache->previous[i])
+		{
+			iCount += cache->previous[i]->count;
+		}
+
+		llCached += (int64_t)iCount * buffer_get_pool_size(i);
+	}
+
+	buffer_thread_cache_drain();
+	return (llCached);
+}
+
+/***
+ * CBufferThreadCacheReaper - drains the thread cache when its thread exits.
+ * Kept apart from TBufferThreadCache so only the slow paths, and not every
+ * allocation, pay for the thread_local destructor registration.
+ */
+class CBufferThreadCacheReaper
+{
+public:
+	~CBufferThreadCacheReaper()
+	{
+		TBufferThreadCache* cache = &buffer_thread_cache;
+
+		buffer_thread_cache_drain();
+
+		/* keep the counters of the thread, and leave the list of registered caches */
+		std::lock_guard<std::mutex> guard(buffer_thread_cache_lock);
+
+		for (int32_t i = 0; i < BUFFER_POOL_COUNT; i++)
+		{
+			buffer_retired_hits[i] += cache->hits[i].load(std::memory_order_relaxed);
+			buffer_retired_misses[i] += cache->misses[i].load(std::memory_order_relaxed);
+			buffer_retired_frees[i] += cache->frees[i].load(std::memory_order_relaxed);
+		}
+
+		if (cache->prev_registered)
+		{
+			cache->prev_registered->next_registered = cache->next_registered;
+		}
+		else
+		{
+			buffer_thread_cache_list = cache->next_registered;
+		}
+
+		if (cache->next_registered)
+		{
+			cache->next_registered->prev_registered = cache->prev_registered;
+		}
+	}
+};
+
+/***
+ * buffer_thread_cache_register - Make sure the thread exit handler is registered.
+ * Return: Nothing (void.)
+ */
+static void buffer_thread_cache_register()
+{
+	TBufferThreadCache* cache = &buffer_thread_cache;
+
+	if (!cache->registered)
+	{
+		static thread_local CBufferThreadCacheReaper reaper;
+		(void)reaper;
+		cache->registered = true;
+
+		std::lock_guard<std::mutex> guard(buffer_thread_cache_lock);
+		cache->next_registered = buffer_thread_cache_list;
+		if (buffer_thread_cache_list)
+		{
+			buffer_thread_cache_list->prev_registered = cache;
+		}
+		buffer_thread_cache_list = cache;
+	}
+}
+
+/***
+ * buffer_pool_uncached - Check whether a pool skips the thread caches.
+ * @iPoolIndex: The index of the buffer pool.
+ *
+ * Buffers bigger than a whole magazine may hold go straight to the depot,
+ * where the watermarks and buffer_pool_trim reach them, instead of idling in
+ * the magazines of every thread that once used the class.
+ *
+ * Return: True if the pool bypasses the magazines.
+ */
+static bool buffer_pool_uncached(int32_t iPoolIndex)
+{
+	return (buffer_get_pool_size(iPoolIndex) > BUFFER_MAGAZINE_MAX_BYTES);
+}
+
+/***
+ * buffer_cache_pop - Take a pooled buffer of the given pool.
+ * @iPoolIndex: The index of the buffer pool.
+ *
+ * The loaded magazine is tried first, then the previous one, then a full
+ * magazine is exchanged with the depot. Uncached pools take their buffer from
+ * a depot magazine directly.
+ *
+ * Return: A pooled buffer, or nullptr if the pool has none.
+ */
+static LPBUFFER buffer_cache_pop(int32_t iPoolIndex)
+{
+	if (buffer_pool_uncached(iPoolIndex))
+	{
+		TBufferMagazine* magazine = buffer_depot_take(iPoolIndex);
+		if (magazine == nullptr)
+		{
+			return (nullptr);
+		}
+
+		/* nothing is cached, but the counters of the thread still have to be found */
+		buffer_thread_cache_register();
+
+		LPBUFFER buffer = magazine->rounds[--magazine->count];
+		buffer_depot_put(iPoolIndex, magazine);
+		return (buffer);
+	}
+
+	TBufferThreadCache* cache = &buffer_thread_cache;
+	TBufferMagazine* loaded = cache->loaded[iPoolIndex];
+
+	/* fast path, the loaded magazine has a buffer */
+	if (loaded && loaded->count > 0)
+	{
+		return (loaded->rounds[--loaded->count]);
+	}
+
+	TBufferMagazine* previous = cache->previous[iPoolIndex];
+
+	/* the previous magazine has buffers, swap it with the loaded one */
+	if (previous && previous->count > 0)
+	{
+		cache->loaded[iPoolIndex] = previous;
+		cache->previous[iPoolIndex] = loaded;
+		return (previous->rounds[--previous->count]);
+	}
+
+	/* both magazines are empty, get a full one from the depot */
+	TBufferMagazine* full = buffer_depot_take(iPoolIndex);
+	if (full == nullptr)
+	{
+		return (nullptr);
+	}
+
+	buffer_thread_cache_register();
+
+	if (previous)
+	{
+		buffer_depot_push(normalized_buffer_pool[iPoolIndex].empty, previous);
+	}
+
+	cache->previous[iPoolIndex] = loaded;
+	cache->loaded[iPoolIndex] = full;
+
+	return (full->rounds[--full->count]);
+}
+
+/***
+ * buffer_cache_push - Return a buffer to the given pool.
+ * @iPoolIndex: The index of the buffer pool.
+ * @buffer: The buffer to pool.
+ *
+ * Mirror of buffer_cache_pop, when both magazines are full the previous one is
+ * handed to the depot and an empty magazine takes the place of the loaded one.
+ * Uncached pools hand every buffer to the depot in a magazine of its own.
+ * Return: Nothing (void.)
+ */
+static void buffer_cache_push(int32_t iPoolIndex, LPBUFFER buffer)
+{
+	if (buffer_pool_uncached(iPoolIndex))
+	{
+		buffer_thread_cache_register();
+
+		TBufferMagazine* magazine = buffer_magazine_new(iPoolIndex);
+		magazine->rounds[magazine->count++] = buffer;
+		buffer_depot_put(iPoolIndex, magazine);
+		return;
+	}
+
+	TBufferThreadCache* cache = &buffer_thread_cache;
+	TBufferMagazine* loaded = cache->loaded[iPoolIndex];
+
+	/* fast path, the loaded magazine has room */
+	if (loaded && loaded->count < loaded->capacity)
+	{
+		loaded->rounds[loaded->count++] = buffer;
+		return;
+	}
+
+	TBufferMagazine* previous = cache->previous[iPoolIndex];
+
+	/* the previous magazine has room, swap it with the loaded one */
+	if (previous && previous->count < previous->capacity)
+	{
+		cache->loaded[iPoolIndex] = previous;
+		cache->previous[iPoolIndex] = loaded;
+		previous->rounds[previous->count++] = buffer;
+		return;
+	}
+
+	buffer_thread_cache_register();
+
+	/* both magazines are full (or missing), hand the previous one to the depot */
+	if (previous)
+	{
+		buffer_depot_put(iPoolIndex, previous);
+	}
+
+	TBufferMagazine* empty = buffer_magazine_new(iPoolIndex);
+	empty->rounds[empty->count++] = buffer;
+
+	cache->previous[iPoolIndex] = loaded;
+	cache->loaded[iPoolIndex] = empty;
+}
+
+/**
+ * buffer_pool_free - Free all buffer pools.
+ *
+ * This function frees all buffers in all pool levels. It iterates over each
+ * buffer pool, releasing the memory of each buffer held by the depot and by
+ * the calling thread's magazines. The emptied magazines are kept for reuse.
+ * Return: Nothing (void.)
+ */
+static void buffer_pool_free()
+{
+	buffer_thread_cache_drain();
+
+	for (int32_t i = BUFFER_POOL_COUNT - 1; i >= 0; i--)
+	{
+		TBufferMagazine* magazine;
+		while ((magazine = buffer_depot_take(i)) != nullptr)
+		{
+			buffer_magazine_free_rounds(i, magazine);
+			buffer_depot_put(i, magazine);
+		}
+	}
+}
+
+/**
+ * buffer_larger_pool_free - Free one larger buffer pool magazine.
+ * @iIndex: The index of the current pool size.
+ *
+ * This function frees the buffers of one depot magazine from a pool larger than
+ * the specified index @iIndex. It searches the buffer pools from the largest down
+ * to @iIndex, frees the buffers if found, and returns true. If no larger buffer
+ * is found, it returns false.
+ *
+ * Return: True if a buffer was freed, false otherwise.
+ */
+static bool buffer_larger_pool_free(int32_t iIndex)
+{
+	for (int32_t i = BUFFER_POOL_COUNT - 1; i > iIndex; i--)
+	{
+		TBufferMagazine* magazine = buffer_depot_take(i);
+		if (magazine)
+		{
+			int32_t iFreed = buffer_magazine_free_rounds(i, magazine);
+			buffer_depot_put(i, magazine);
+
+			if (iFreed > 0)
+			{
+				return (true);
+			}
+		}
+	}
+
+	return(false);
+}
+
+/***
+ * buffer_pool_set_watermarks - Set the pool policy of the size class of a buffer size.
+ * @iSize: A buffer size, the policy applies to the size class that serves it.
+ * @iLowWater: The amount of idle buffers trimming keeps, 0 for the default.
+ * @iHighWater: The most idle buffers the depot holds, 0 for the default.
+ *
+ * The defaults keep at most 32 MB of idle buffers per class and trim idle
+ * classes down to 4 MB.
+ * Return: True on success, false if the size isn't pooled.
+ */
+bool buffer_pool_set_watermarks(int32_t iSize, int32_t iLowWater, int32_t iHighWater)
+{
+	int32_t iPoolIndex = buffer_get_pool_index(iSize);
+
+	if (iPoolIndex < 0 || iLowWater < 0 || iHighWater < 0)
+	{
+		return (false);
+	}
+
+	if (iHighWater > 0 && iLowWater > iHighWater)
+	{
+		iLowWater = iHighWater;
+	}
+
+	normalized_buffer_pool[iPoolIndex].low_water.store(iLowWater, std::memory_order_relaxed);
+	normalized_buffer_pool[iPoolIndex].high_water.store(iHighWater, std::memory_order_relaxed);
+	return (true);
+}
+
+/***
+ * buffer_pool_trim - Give idle pooled buffers back to the system.
+ *
+ * Meant to be called periodically (e.g. once every few seconds) from one thread.
+ * A size class whose depot wasn't used by any thread since the previous call is
+ * considered idle, and its depot is trimmed down to the low watermark. Buffers
+ * held by the magazines of other threads are left alone, each thread hands
+ * them to the depot with buffer_thread_cache_trim. Pools bigger than a
+ * magazine are never cached by threads.
+ *
+ * Return: The amount of bytes given back to the system.
+ */
+int64_t buffer_pool_trim()
+{
+	static std::mutex trimLock;
+	static uint32_t lastRefills[BUFFER_POOL_COUNT];
+
+	std::lock_guard<std::mutex> guard(trimLock);
+	int64_t llReleased = 0;
+
+	for (int32_t i = 0; i < BUFFER_POOL_COUNT; i++)
+	{
+		TBufferDepot* depot = &normalized_buffer_pool[i];
+		uint32_t uRefills = depot->refills.load(std::memory_order_relaxed);
+
+		/* the class was used since the last trim, leave it alone */
+		if (uRefills != lastRefills[i])
+		{
+			lastRefills[i] = uRefills;
+			continue;
+		}
+
+		int32_t iLowWater = buffer_pool_low_water(i);
+		int32_t iReleased = 0;
+
+		while (depot->pooled.load(std::memory_order_relaxed) > iLowWater)
+		{
+			TBufferMagazine* magazine = buffer_depot_take(i);
+			if (!magazine)
+			{
+				break;
+			}
+
+			int32_t iExcess = depot->pooled.load(std::memory_order_relaxed) + magazine->count - iLowWater;
+			while (magazine->count > 0 && iExcess-- > 0)
+			{
+				buffer_pool_release(i, magazine->rounds[--magazine->count]);
+				iReleased++;
+			}
+
+			/* once in the depot the magazine can be taken by another thread, don't touch it after */
+			const int32_t iKept = magazine->count;
+			buffer_depot_put(i, magazine);
+
+			/* the magazine kept some buffers, the low watermark is reached */
+			if (iKept > 0)
+			{
+				break;
+			}
+		}
+
+		/* taking magazines counted as refills, don't mistake the trim for activity */
+		lastRefills[i] = depot->refills.load(std::memory_order_relaxed);
+		llReleased += (int64_t)iReleased * buffer_get_pool_size(i);
+	}
+
+	if (llReleased > 0)
+	{
+		sys_log(0, "buffer_pool_trim: released %lld bytes of idle buffers", (long long)llReleased);
+	}
+
+	return (llReleased);
+}
+
+/***
+ * buffer_pool_get_stats - Get the statistics of a size class.
+ * @iPoolIndex: The index of the size class, from 0 to BUFFER_POOL_COUNT - 1.
+ * @pStats: Where the statistics are stored.
+ *
+ * The per-thread counters are summed without stopping the threads, so the values
+ * are a close snapshot rather than an exact one while threads are allocating.
+ *
+ * Return: True on success, false if the index is invalid.
+ */
+bool buffer_pool_get_stats(int32_t iPoolIndex, TBufferPoolStats* pStats)
+{
+	if (iPoolIndex < 0 || iPoolIndex >= BUFFER_POOL_COUNT || !pStats)
+	{
+		return (false);
+	}
+
+	TBufferDepot* depot = &normalized_buffer_pool[iPoolIndex];
+	int64_t llSize = buffer_get_pool_size(iPoolIndex);
+	uint64_t ullFrees;
+
+	{
+		std::lock_guard<std::mutex> guard(buffer_thread_cache_lock);
+
+		pStats->hits = buffer_retired_hits[iPoolIndex];
+		pStats->misses = buffer_retired_misses[iPoolIndex];
+		ullFrees = buffer_retired_frees[iPoolIndex];
+
+		for (TBufferThreadCache* cache = buffer_thread_cache_list; cache; cache = cache->next_registered)
+		{
+			pStats->hits += cache->hits[iPoolIndex].load(std::memory_order_relaxed);
+			pStats->misses += cache->misses[iPoolIndex].load(std::memory_order_relaxed);
+			ullFrees += cache->frees[iPoolIndex].load(std::memory_order_relaxed);
+		}
+	}
+
+	/* every buffer that exists and isn't in use is pooled, in the depot or in a thread's magazines */
+	int64_t llTotal = depot->total.load(std::memory_order_relaxed);
+	int64_t llInUse = (int64_t)(pStats->hits + pStats->misses - ullFrees);
+
+	pStats->size = (int32_t)llSize;
+	pStats->in_use_bytes = llInUse * llSize;
+	pStats->pooled_bytes = std::max<int64_t>(0, llTotal - llInUse) * llSize;
+	pStats->total_bytes = llTotal * llSize;
+	pStats->peak_bytes = depot->peak.load(std::memory_order_relaxed) * llSize;
+	pStats->trimmed = depot->trimmed.load(std::memory_order_relaxed);
+	pStats->low_water = buffer_pool_low_water(iPoolIndex);
+	pStats->high_water = buffer_pool_high_water(iPoolIndex);
+	return (true);
+}
+
+/***
+ * buffer_pool_log_stats - Write the statistics of every used size class to the syslog.
+ * Return: Nothing (void.)
+ */
+void buffer_pool_log_stats()
+{
+	for (int32_t i = 0; i < BUFFER_POOL_COUNT; i++)
+	{
+		TBufferPoolStats stats;
+		if (!buffer_pool_get_stats(i, &stats) || stats.peak_bytes == 0)
+		{
+			continue;
+		}
+
+		sys_log(0, "buffer pool [%d bytes] hits %llu misses %llu in use %lld pooled %lld total %lld peak %lld trimmed %llu",
+			stats.size, (unsigned long long)stats.hits, (unsigned long long)stats.misses, (long long)stats.in_use_bytes,
+			(long long)stats.pooled_bytes, (long long)stats.total_bytes, (long long)stats.peak_bytes, (unsigned long long)stats.trimmed);
+	}
+}
+
+/***
+ * buffer_mmap_alloc - Create a buffer whose payload is an anonymous mapping.
+ * @iSize: The size of the payload, a multiple of the page size.
+ *
+ * Large buffers are mapped so buffer_realloc can grow them by remapping their
+ * pages instead of copying them. The mapping is zero filled like calloc memory.
+ *
+ * Return: The new buffer, or nullptr if mapping isn't available or failed.
+ */
+static LPBUFFER buffer_mmap_alloc(int32_t iSize)
+{
+#if defined(_WIN64)
+	return (nullptr);
+#else
+	void* pMemory = mmap(nullptr, iSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pMemory == MAP_FAILED)
+	{
+		sys_err("mmap failed, Size[%d] Error[%d] : %s", iSize, errno, strerror(errno));
+		return (nullptr);
+	}
+
+	LPBUFFER buffer;
+	CREATE(buffer, BUFFER, 1);
+	buffer->alloc_type = BUFFER_ALLOC_MMAP;
+	buffer->mem_data = (char*)pMemory;
+	buffer->mem_size = iSize;
+	return (buffer);
+#endif
+}
+
+/***
+ * buffer_mmap_grow - Grow a mapped buffer in place with mremap.
+ * @buffer: The buffer to grow, its payload must be mapped.
+ * @iLength: The needed size.
+ *
+ * The pages are extended or moved by the kernel, nothing is copied and the old
+ * and new payload never exist at the same time. The new size is rounded to a
+ * size class so the buffer still returns to the pool.
+ *
+ * Return: True if the buffer was grown, false if the caller must copy instead.
+ */
+static bool buffer_mmap_grow(LPBUFFER buffer, int32_t iLength)
+{
+#if defined(BUFFER_USE_MREMAP)
+	int32_t iOldPoolIndex = buffer_get_exact_pool_index(buffer->mem_size);
+	int32_t iNewPoolIndex = buffer_get_pool_index(iLength);
+
+	/* not pooled sizes are only rounded to the page size */
+	int32_t iNewSize = iNewPoolIndex >= 0 ? buffer_get_pool_size(iNewPoolIndex) : (int32_t)(((int64_t)iLength + 4095) & ~(int64_t)4095);
+
+	void* pMemory = mremap(buffer->mem_data, buffer->mem_size, iNewSize, MREMAP_MAYMOVE);
+	if (pMemory == MAP_FAILED)
+	{
+		sys_err("mremap failed, Size[%d -> %d] Error[%d] : %s", buffer->mem_size, iNewSize, errno, strerror(errno));
+		return (false);
+	}
+
+	ptrdiff_t read_point_pos = buffer->read_point - buffer->mem_data;
+
+	buffer->mem_data = (char*)pMemory;
+	buffer->mem_size = iNewSize;
+	buffer->read_point = buffer->mem_data + read_point_pos;
+	buffer->write_point = buffer->mem_data + buffer->write_point_pos;
+
+	/* the buffer left its old size class and joined the new one */
+	TBufferThreadCache* cache = &buffer_thread_cache;
+	if (iOldPoolIndex >= 0)
+	{
+		normalized_buffer_pool[iOldPoolIndex].total.fetch_sub(1, std::memory_order_relaxed);
+		cache->frees[iOldPoolIndex].store(cache->frees[iOldPoolIndex].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	if (iNewPoolIndex >= 0)
+	{
+		buffer_thread_cache_register();
+		buffer_pool_created(iNewPoolIndex);
+		cache->misses[iNewPoolIndex].store(cache->misses[iNewPoolIndex].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	return (true);
+#else
+	return (false);
+#endif
+}
+
+/***
+ * safe_create - Safely allocate memory and handle errors.
+ * @pData: Double pointer to the data to be allocated.
+ * @iNum: The number of elements to allocate.
+ *
+ * This function allocates memory for @pData using calloc and handles memory
+ * allocation failure by logging an error message and returning false. If the
+ * allocation is successful, it returns true.
+ *
+ * Return: True if memory allocation is successful, otherwise false.
+ */
+bool safe_create(char** pData, int32_t iNum)
+{
+	(*pData) = (char*)calloc(iNum, sizeof(char));
+	if (!(*pData))
+	{
+		sys_err("calloc failed, Error[%d] : %s", errno, strerror(errno));
+		return (false);
+	}
+	return(true);
+}
+
+/***
+ * buffer_new - Create a new buffer of the specified size.
+ * @iSize: The size of the buffer to be created.
+ *
+ * This function creates a new buffer from the pool if the requested size can
+ * be pooled. If a suitable buffer is not available, it tries to allocate memory.
+ * If allocation fails, it frees buffers from the pool and retries.
+ * Safe to call from any thread.
+ *
+ * Return: A pointer to the newly created buffer, or nullptr if the size is invalid.
+ */
+
+LPBUFFER buffer_new(int32_t iSize)
+{
+	if (iSize < 0)
+	{
+		return (nullptr);
+	}
+
+	LPBUFFER buffer = nullptr;
+	/* determine the index of the buffer pool that can accommodate a buffer of the requested size,
+	 * The function returns the index of the smallest size class that fits (e.g., sizes of 1, 2, 4, 8, 16, 20, 24, etc.)
+	 * if none is available with request size then create new one.
+	 */
+	int32_t iPoolIndex = buffer_get_pool_index(iSize);
+
+	if (iPoolIndex >= 0)
+	{
+		/* updates iSize to the actual size of the buffer that corresponds to the pool index,
+		 * (e.g., if iPoolIndex is 3, then iSize becomes 8, if iPoolIndex is 5, then iSize becomes 20).
+		 */
+		iSize = buffer_get_pool_size(iPoolIndex);
+
+		/* take a buffer from the thread's magazines, or from the shared depot behind them */
+		buffer = buffer_cache_pop(iPoolIndex);
+
+		TBufferThreadCache* cache = &buffer_thread_cache;
+		if (buffer)
+		{
+			cache->hits[iPoolIndex].store(cache->hits[iPoolIndex].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+		else
+		{
+			buffer_thread_cache_register();
+			cache->misses[iPoolIndex].store(cache->misses[iPoolIndex].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			buffer_pool_created(iPoolIndex);
+		}
+	}
+	
+	/* small and medium buffers are carved from slabs, header and payload in one chunk */
+	if (buffer == nullptr && iPoolIndex >= 0 && iSize <= BUFFER_SLAB_MAX_PAYLOAD)
+	{
+		buffer = buffer_slab_alloc(iPoolIndex, iSize);
+	}
+
+	/* large buffers are mapped, so growing them doesn't copy (only pooled sizes are page multiples) */
+	if (buffer == nullptr && iPoolIndex >= 0 && iSize >= BUFFER_MMAP_THRESHOLD)
+	{
+		buffer = buffer_mmap_alloc(iSize);
+	}
+
+	if (buffer == nullptr)
+	{
+		/* create new buffer */
+		CREATE(buffer, BUFFER, 1);
+		buffer->mem_size = iSize;
+		/* calloc failures frequently occur in buffer_new(especially on low - end machines in Turkiye),
+		 * so if calloc fails, the buffer pool is cleared and the operation is retried.
+		 */
+		if (!safe_create(&buffer->mem_data, iSize))
+		{
+			/* Releases one buffer from the pool that is larger than the required buffer. */
+			if (!buffer_larger_pool_free(iPoolIndex))
+			{
+				/* If this fails, as a last resort, all pools are cleared. */
+				buffer_pool_free();
+			}
+			CREATE(buffer->mem_data, char, iSize);
+			sys_err("buffer pool free success");
+		}
+	}
+
+	assert(buffer != nullptr);
+	assert(buffer->mem_size == iSize);
+	assert(buffer->mem_data != nullptr);
+
+	/* Reset buffer data, ensuring everything is clean and clear. */
+	buffer_reset(buffer);
+
+	return(buffer);
+}
+
+/***
+ * buffer_delete - Free or return buffer to the pool.
+ * @buffer: Pointer to the buffer to delete.
+ *
+ * This function resets the buffer, then returns it to the pool if it belongs
+ * to a pooled size. If it does not belong to a pool, the buffer's memory is
+ * freed. The buffer may be deleted by another thread than the one that created it.
+ * Return: Nothing (void.)
+ */
+void buffer_delete(LPBUFFER buffer)
+{
+	if (!buffer)
+	{
+		return;
+	}
+
+	/* a view drops its reference on the shared buffer it was reading */
+	if (buffer->shared)
+	{
+		buffer_shared_release(buffer->shared);
+		buffer->shared = nullptr;
+	}
+
+	/* reset buffer data, make it's state clear */
+	buffer_reset(buffer);
+
+	/* store the buffer size, to use getting exact correct buffer pool index */
+	int32_t iSize = buffer->mem_size;
+
+	/* get the exact pool index for the size of the buffer */
+	int32_t iPoolIndex = buffer_get_exact_pool_index(iSize);
+
+	/* checks if a valid pool index was found, it means there's a pool that can hold buffers of this size */
+	if (iPoolIndex >= 0)
+	{
+		/* put the buffer in the thread's magazines, full magazines are handed to the shared depot */
+		buffer_cache_push(iPoolIndex, buffer);
+
+		TBufferThreadCache* cache = &buffer_thread_cache;
+		cache->frees[iPoolIndex].store(cache->frees[iPoolIndex].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+	else /* no valid pool index was found */
+	{
+		/* give the memory back to its allocator */
+		buffer_free_memory(buffer);
+	}
+}
+
+/***
+ * buffer_reset - Reset buffer to its initial state.
+ * @buffer: The buffer to reset.
+ *
+ * This function resets the buffer's read and write pointers and other internal
+ * fields, effectively clearing it for reuse.
+ * Return: Nothing (void.)
+ */
+void buffer_reset(LPBUFFER buffer)
+{
+	buffer->read_point = buffer->mem_data;
+	buffer->write_point = buffer->mem_data;
+	buffer->write_point_pos = 0;
+	buffer->length = 0;
+	buffer->next = nullptr;
+	buffer->flag = 0;
+}
+
+/***
+ * buffer_is_immutable - Checks whether a buffer is shared or a view of a shared buffer
+ * @buffer: The buffer to check
+ *
+ * A view reads the memory of its shared buffer, and the shared buffer is read
+ * by its views, so neither can be written to, compacted nor reallocated.
+ *
+ * Return: true if the buffer must not be modified
+ */
+bool buffer_is_immutable(LPBUFFER buffer)
+{
+	return (buffer->shared != nullptr || buffer->refcount.load(std::memory_order_relaxed) != 0);
+}
+
+/**
+ * buffer_realloc - Reallocates the given buffer to accommodate additional memory
+ * @buffer: The buffer to be reallocated (passed by reference)
+ * @length: The new desired length for the buffer
+ *
+ * This function checks if the buffer's current size is less than the requested
+ * size. If so, it allocates a new buffer with the requested size, copies the
+ * data from the old buffer into the new one, and updates the read and write
+ * pointers to maintain their relative positions. It then frees the old buffer
+ * and assigns the new buffer in its place. If the requested length is less than
+ * or equal to the current size, no reallocation is performed.
+ * Buffers of BUFFER_MMAP_THRESHOLD bytes and more are mapped, those are grown
+ * in place with mremap where available, without copying their data.
+ *
+ * Return: Nothing (void.)
+ */
+void buffer_realloc(LPBUFFER& buffer, int32_t iLength)
+{
+	int32_t i;
+	LPBUFFER tempBuf;
+
+	assert(iLength >= 0 && "buffer_realloc: buffer length is less than zero!");
+
+	if (buffer_is_immutable(buffer))
+	{
+		sys_err("buffer_realloc: shared buffers and their views are immutable");
+		return;
+	}
+
+	/* buffer size already bigger or equal to the needed, don't reallocate */
+	if (buffer->mem_size >= iLength)
+	{
+		return;
+	}
+
+	/* i is the difference between the newly allocated size and the previous size,
+	 * which is actually the size of the newly created memory (the amount of memory needed).
+	 */
+	i = iLength - buffer->mem_size;
+
+	/* if there's no extra memory needed, don't reallocate */
+	if (i <= 0)
+	{
+		return;
+	}
+
+	/* a mapped buffer is grown by remapping its pages, the data stays where it is */
+	if (buffer->alloc_type == BUFFER_ALLOC_MMAP && buffer_mmap_grow(buffer, iLength))
+	{
+		buffer_write_remaps.fetch_add(1, std::memory_order_relaxed);
+		sys_log(0, "remapped buffer to [%d]", buffer->mem_size);
+		return;
+	}
+
+	buffer_write_reallocations.fetch_add(1, std::memory_order_relaxed);
+
+	/* allocate new temporary buffer with the bigger size */
+	tempBuf = buffer_new(iLength);
+	sys_log(0, "reallocating buffer to [%d], current [%d]", tempBuf->mem_size, buffer->mem_size);
+
+	/* copy the existing data to the new created buffer, nothing past the write point is valid.
+	 * The old buffer is freed right after, so a multi-MB copy is streamed past the caches.
+	 */
+	thecore_memcpy_stream(tempBuf->mem_data, buffer->mem_data, buffer->write_point_pos);
+
+	/* The current position of the read_point (the point in the buffer where the next read will occur)
+	 * is saved by calculating its offset from the start of the buffer's data (mem_data).
+	 * This allows the function to maintain the correct read position in the new buffer after reallocation.
+	 */
+	ptrdiff_t read_point_pos = buffer->read_point - buffer->mem_data;
+
+	/* Set the next write point position in the new buffer's data */
+	tempBuf->write_point = tempBuf->mem_data + buffer->write_point_pos;
+
+	/* Transfer the write point position to the new buffer */
+	tempBuf->write_point_pos = buffer->write_point_pos;
+
+	/* Update Read point and make it point to the correct position */
+	tempBuf->read_point = tempBuf->mem_data + read_point_pos;
+
+	/* Copy Buffer flag */
+	tempBuf->flag = buffer->flag;
+
+	/* set next buffer to null since this is a new buffer */
+	tempBuf->next = nullptr;
+
+	/* set the data length that is copied from previous buffer to the new one */
+	tempBuf->length = buffer->length;
+
+	/* delete the old buffer since we don't need it anymore */
+	buffer_delete(buffer);
+
+	/* set the buffer to the newly allocated one */
+	buffer = tempBuf;
+}
+
+/***
+ * buffer_compact - Slides the unread data to the start of the buffer to make room
+ * @buffer: The buffer to compact
+ * @iNeeded: The amount of free space needed after the write point
+ *
+ * Bytes before read_point were already consumed, moving the unread data over
+ * them frees that space without a reallocation. The buffer is only compacted
+ * when that makes enough room and the data to move isn't bigger than the space
+ * it frees, so a mostly unread buffer grows instead of being moved over and over.
+ *
+ * Return: True if the buffer now has iNeeded bytes of room, false if it must grow.
+ */
+static bool buffer_compact(LPBUFFER buffer, int32_t iNeeded)
+{
+	int32_t iConsumed = (int32_t)(buffer->read_point - buffer->mem_data);
+
+	if (iConsumed == 0 || buffer->length + iNeeded > buffer->mem_size || buffer->length > iConsumed)
+	{
+		return (false);
+	}
+
+	if (buffer->length > 0)
+	{
+		memmove(buffer->mem_data, buffer->read_point, buffer->length);
+	}
+
+	buffer->read_point = buffer->mem_data;
+	buffer->write_point = buffer->mem_data + buffer->length;
+	buffer->write_point_pos = buffer->length;
+
+	buffer_write_compactions.fetch_add(1, std::memory_order_relaxed);
+	buffer_write_compacted_bytes.fetch_add(buffer->length, std::memory_order_relaxed);
+	return (true);
+}
+
+/***
+ * buffer_get_write_stats - Get the counters of how buffers made room for writes
+ * @pStats: Where the counters are stored
+ *
+ * Return: Nothing (void.)
+ */
+void buffer_get_write_stats(TBufferWriteStats* pStats)
+{
+	pStats->compactions = buffer_write_compactions.load(std::memory_order_relaxed);
+	pStats->compacted_bytes = buffer_write_compacted_bytes.load(std::memory_order_relaxed);
+	pStats->reallocations = buffer_write_reallocations.load(std::memory_order_relaxed);
+	pStats->remaps = buffer_write_remaps.load(std::memory_order_relaxed);
+}
+
+/***
+ * buffer_write - Writes data to the buffer and reallocates if necessary
+ * @buffer: The buffer to write data into (passed by reference)
+ * @src: Pointer to the source data to be written
+ * @iLength: The length of the data to be written
+ *
+ * This function checks if the buffer has enough space to accommodate the
+ * new data. If the current buffer's write position plus the length of the
+ * data exceeds the buffer's allocated size, the consumed space before the
+ * read point is reclaimed first, and only if that isn't enough it reallocates
+ * the buffer to make room for the additional data. After ensuring there is enough space,
+ * the function copies the data from the source to the buffer's write point
+ * and updates the buffer's internal write position.
+ *
+ * Return: None
+ */
+void buffer_write(LPBUFFER& buffer, const void* src, int32_t iLength)
+{
+	if (buffer_is_immutable(buffer))
+	{
+		sys_err("buffer_write: shared buffers and their views are immutable, %d bytes not written", iLength);
+		return;
+	}
+
+	/* if the buffer actual write position and the given data length is bigger than the allocated memory size,
+	 * and sliding the unread data to the front doesn't make enough room
+	 */
+	if (buffer->write_point_pos + iLength > buffer->mem_size && !buffer_compact(buffer, iLength))
+	{
+		/* then reallocate the buffer to have a space for the new data to be written */
+		sys_log(0, "buffer_write: realloc buffer : write_point_pos [%d] + iLength [%d] > mem_size [%d] and compaction can't make room", buffer->write_point_pos, iLength, buffer->mem_size);
+		buffer_realloc(buffer, buffer->mem_size + iLength + std::min<int32_t>(BUFFER_REALLOC_SIZE, iLength));
+	}
+
+	/* write the data from that is given to the write point, bulk writes bypass the caches */
+	thecore_memcpy_stream(buffer->write_point, src, iLength);
+	buffer_write_proceed(buffer, iLength);
+}
+
+/***
+ * buffer_write_peek - Returns the current write position in the buffer
+ * @buffer: The buffer whose write point is to be returned
+ *
+ * This function returns a pointer to the current position in the buffer
+ * where the next write operation will begin. It does not modify the buffer,
+ * but allows for inspection of the write point, which is usually empty point
+ * right after the last character.
+ *
+ * Return: A pointer to the current write position in the buffer.
+ */
+void* buffer_write_peek(LPBUFFER buffer)
+{
+	return (buffer->write_point);
+}
+
+/**
+ * buffer_write_proceed - Advances the write position in the buffer after data is written
+ * @buffer: The buffer whose write position is to be updated
+ * @iLength: The number of bytes written to the buffer
+ *
+ * This function updates the buffer's internal tracking of the amount of data
+ * written. It increases the buffer's total length, adjusts the write pointer
+ * to reflect the new position, and increments the write point position to
+ * account for the newly written data.
+ *
+ * Return: Nothing (void.)
+ */
+void buffer_write_proceed(LPBUFFER buffer, int32_t iLength)
+{
+	buffer->length += iLength;
+	buffer->write_point += iLength;
+	buffer->write_point_pos += iLength;
+}
+
+/***
+ * buffer_read - Reads data from the buffer
+ * @buffer: The buffer to read data from
+ * @buf: The destination buffer where the data will be copied
+ * @iBytes: The number of bytes to read
+ *
+ * This function copies the specified number of bytes from the buffer's
+ * read position into the provided destination buffer. After copying the data,
+ * it advances the buffer's read position by the number of bytes read.
+ *
+ * Return: Nothing (void.)
+ */
+void buffer_read(LPBUFFER buffer, void* buf, int32_t iBytes)
+{
+	thecore_memcpy_stream(buf, buffer->read_point, iBytes);
+	buffer_read_proceed(buffer, iBytes);
+}
+
+/***
+ * buffer_read_proceed - Advances the read position after reading data
+ * @buffer: The buffer whose read position will be updated
+ * @iLength: The number of bytes to advance the read position by
+ *
+ * This function moves the read position forward by the specified number of
+ * bytes. If the length to advance is zero, it does nothing. If the length is
+ * negative or exceeds the available data in the buffer, an error is logged.
+ * If the buffer has more data than the length to process, only the read point
+ * is moved. Otherwise, the buffer is reset.
+ *
+ * Return: Nothing (void.)
+ */
+void buffer_read_proceed(LPBUFFER buffer, int32_t iLength)
+{
+	if (iLength == 0)
+	{
+		return;
+	}
+
+	if (iLength < 0)
+	{
+		sys_err("buffer_read_proceed: length argument is lower than zero [%d]", iLength);
+	}
+	else if (iLength > buffer->length)
+	{
+		sys_err("buffer_read_proceed: length argument is bigger than buffer length [Length: %d] [Buffer Length: %d]", iLength, buffer->length);
+		iLength = buffer->length;
+	}
+
+	/* If the length to be processed is less than the buffer length, only the read point is adjusted. */
+	if (iLength < buffer->length)
+	{
+		/* Ensure the read point is within bounds, a view reads the memory of its shared buffer. */
+		LPBUFFER owner = buffer->shared ? buffer->shared : buffer;
+		if (buffer->read_point + iLength - owner->mem_data > owner->mem_size)
+		{
+			sys_err("buffer_read_proceed: buffer overflow! [Length: %d] [Read Point: %d]", iLength, (int32_t)(buffer->read_point - owner->mem_data));
+			abort();
+		}
+
+		buffer->read_point += iLength;
+		buffer->length -= iLength;
+	}
+	else
+	{
+		/* If the entire buffer has been processed, reset the buffer. */
+		buffer_reset(buffer);
+	}
+}
+
+/***
+ * buffer_read_peek - Returns a pointer to the current read position
+ * @buffer: The buffer to peek into
+ *
+ * This function returns a constant pointer to the current read position
+ * within the buffer. It allows inspection of the buffer contents at the read
+ * position without modifying any internal state.
+ *
+ * Return: A constant pointer to the read point within the buffer
+ */
+const void* buffer_read_peek(LPBUFFER buffer)
+{
+	return (static_cast<const void*>(buffer->read_point));
+}
+
+/***
+ * buffer_has_space - Determines how much space is left in the buffer
+ * @buffer: The buffer to check for available space
+ *
+ * This function calculates the remaining space in the buffer by subtracting
+ * the current write position from the total size of the allocated memory.
+ * It returns the number of bytes left that can still be written to the buffer.
+ *
+ * Return: The amount of free space (in bytes) available in the buffer.
+ */
+int32_t buffer_has_space(LPBUFFER buffer)
+{
+	return (buffer->mem_size - buffer->write_point_pos);
+}
+
+/***
+ * buffer_size - Get the current size of the buffer.
+ * @buffer: The buffer to query.
+ *
+ * This function returns the current length of data in the buffer.
+ *
+ * Return: The length of the buffer.
+ */
+uint32_t buffer_size(LPBUFFER buffer)
+{
+	return (buffer->length);
+}
+
+/***
+ * buffer_adjust_size - Adjusts the buffer size to accommodate additional data
+ * @buffer: The buffer to be resized (passed by reference)
+ * @iAdded_Size: The additional size needed in the buffer
+ *
+ * This function checks if the current size of the buffer is sufficient to
+ * accommodate the specified additional size. If the buffer already has enough
+ * space, no action is taken. If additional space is needed, the consumed space
+ * before the read point is reclaimed first, otherwise the buffer is
+ * reallocated to increase its size. A log entry is made to record the
+ * adjustment.
+ *
+ * Return: Nothing (void.)
+ */
+void buffer_adjust_size(LPBUFFER& buffer, int32_t iAdded_Size)
+{
+	/* if current buffer size is bigger or equal to needed size, do nothing */
+	if (buffer->mem_size >= buffer->write_point_pos + iAdded_Size)
+	{
+		return;
+	}
+
+	if (buffer_is_immutable(buffer))
+	{
+		sys_err("buffer_adjust_size: shared buffers and their views are immutable");
+		return;
+	}
+
+	/* reclaim the consumed space before growing */
+	if (buffer_compact(buffer, iAdded_Size))
+	{
+		return;
+	}
+
+	sys_log(0, "buffer_adjust_size: %d size have been added to the buffer, current : %d/%d", iAdded_Size, buffer->length, buffer->mem_size);
+	buffer_realloc(buffer, buffer->mem_size + iAdded_Size);
+}
+
+/***
+ * buffer_get_byte - Reads a BYTE value from the buffer
+ * @buffer: The buffer to read from
+ *
+ * This function retrieves a single BYTE value from the current read position
+ * of the buffer. It first checks if there is enough data available to read
+ * a BYTE. If not, an error is logged, and a default value of 0 is returned.
+ * After reading, the read position is updated.
+ *
+ * Return: The BYTE value read from the buffer, or 0 if there is not enough data.
+ */
+uint8_t buffer_get_byte(LPBUFFER buffer)
+{
+	/* Ensure the buffer has enough data to read a BYTE */
+	if (buffer->length < sizeof(uint8_t))
+	{
+		sys_err("buffer_get_byte: not enough data in buffer to read a BYTE");
+		return 0;
+	}
 
-	/* allocate new temporary buffer with the bigger size */
-	tempBuf = buffer_new(iLength);
-	sys_log(0, "reallocating buffer to [%d], current [%d]", tempBuf->mem_size, buffer->mem_size);
+	/* Read the BYTE value from the current read point */
+	uint8_t val = *(uint8_t*)buffer->read_point;
 
-	/* copy the existing data to the new created buffer */
-	thecore_memcpy(tempBuf->mem_data, buffer->mem_data, buffer->mem_size);
+	/* Advance the read position by the size of a BYTE */
+	buffer_read_proceed(buffer, sizeof(uint8_t));
 
-	/* The current position of the read_point (the point in the buffer where the next read will occur)
-	 * is saved by calculating its offset from the start of the buffer's data (mem_data).
-	 * This allows the function to maintain the correct read position in the new buffer after reallocation.
-	 */
-	ptrdiff_t read_point_pos = tempBuf->read_point - buffer->mem_data;
+	/* Return the read BYTE value */
+	return val;
+}
 
-	/* Set the next write point position in the new buffer's data */
-	tempBuf->write_point = tempBuf->mem_data + buffer->write_point_pos;
+/***
+ * buffer_get_word - Reads a WORD value from the buffer
+ * @buffer: The buffer to read from
+ *
+ * This function retrieves a WORD value from the current read position of
+ * the buffer. It checks if there is enough data to read a WORD. If
+ * insufficient data is available, an error is logged, and 0 is returned.
+ * The read position is updated after reading the value.
+ *
+ * Return: The WORD value read from the buffer, or 0 if there is not enough data.
+ */
+uint16_t buffer_get_word(LPBUFFER buffer)
+{
+	/* Ensure the buffer has enough data to read a WORD */
+	if (buffer->length < sizeof(uint16_t))
+	{
+		sys_err("buffer_get_word: not enough data in buffer to read a WORD");
+		return 0;
+	}
 
-	/* Transfer the write point position to the new buffer */
-	tempBuf->write_point_pos = buffer->write_point_pos;
+	/* Read the WORD value from the current read point */
+	uint16_t val = buffer_load_le16(buffer->read_point);
 
-	/* Update Read point and make it point to the correct position */
-	tempBuf->read_point = read_point_pos + buffer->mem_data;
+	/* Advance the read position by the size of a WORD */
+	buffer_read_proceed(buffer, sizeof(uint16_t));
 
-	/* Copy Buffer flag */
-	tempBuf->flag = buffer->flag;
+	/* Return the read WORD value */
+	return val;
+}
 
-	/* set next buffer to null since this is a new buffer */
-	tempBuf->next = nullptr;
+/***
+ * buffer_get_dword - Reads a DWORD value from the buffer
+ * @buffer: The buffer to read from
+ *
+ * This function retrieves a DWORD value from the current read position of
+ * the buffer. It checks if there is sufficient data available to read a
+ * DWORD. If not, an error is logged, and 0 is returned. The read position
+ * is updated after reading the value.
+ *
+ * Return: The DWORD value read from the buffer, or 0 if there is not enough data.
+ */
+uint32_t buffer_get_dword(LPBUFFER buffer)
+{
+	/* Ensure the buffer has enough data to read a DWORD */
+	if (buffer->length < sizeof(uint32_t))
+	{
+		sys_err("buffer_get_dword: not enough data in buffer to read a DWORD");
+		return 0;
+	}
 
-	/* set the data length that is copied from previous buffer to the new one */
-	tempBuf->length = buffer->length;
+	/* Read the DWORD value from the current read point */
+	uint32_t val = buffer_load_le32(buffer->read_point);
 
-	/* delete the old buffer since we don't need it anymore */
-	buffer_delete(buffer);
+	/* Advance the read position by the size of a DWORD */
+	buffer_read_proceed(buffer, sizeof(uint32_t));
+
+	/* Return the read DWORD value */
+	return val;
+}
+
+/***
+ * buffer_bit_scan_forward - Get the index of the lowest set bit.
+ * @uValue: The value to scan, must not be 0.
+ *
+ * Return: The index (0-31) of the lowest set bit.
+ */
+static inline int32_t buffer_bit_scan_forward(uint32_t uValue)
+{
+#if defined(_WIN64)
+	unsigned long ulIndex;
+	_BitScanForward(&ulIndex, uValue);
+	return ((int32_t)ulIndex);
+#else
+	return (__builtin_ctz(uValue));
+#endif
+}
+
+/***
+ * buffer_varint_encode - Encodes an unsigned integer as a varint
+ * @dst: Where to write, at least BUFFER_VARINT_MAX bytes
+ * @val: The value to encode
+ *
+ * The value is written 7 bits at a time starting with the lowest ones, the
+ * highest bit of every byte but the last is set (LEB128).
+ *
+ * Return: The amount of bytes written (1-10).
+ */
+int32_t buffer_varint_encode(uint8_t* dst, uint64_t val)
+{
+	int32_t iLength = 0;
+
+	while (val >= 0x80)
+	{
+		dst[iLength++] = (uint8_t)(val | 0x80);
+		val >>= 7;
+	}
+
+	dst[iLength++] = (uint8_t)val;
+	return (iLength);
+}
+
+/***
+ * buffer_varint_decode - Decodes a varint
+ * @src: The encoded data
+ * @iLength: The amount of encoded data (in bytes)
+ * @pVal: Receives the decoded value
+ *
+ * Return: The amount of bytes read, 0 if the varint is not complete yet,
+ * or -1 if it is malformed (longer than BUFFER_VARINT_MAX bytes or more than 64 bits).
+ */
+int32_t buffer_varint_decode(const uint8_t* src, int32_t iLength, uint64_t* pVal)
+{
+	const int32_t iMax = std::min<int32_t>(iLength, BUFFER_VARINT_MAX);
+	uint64_t val = 0;
+
+	for (int32_t i = 0; i < iMax; ++i)
+	{
+		val |= (uint64_t)(src[i] & 0x7F) << (7 * i);
+
+		if (!(src[i] & 0x80))
+		{
+			/* the 10th byte only holds the 64th bit */
+			if (i == BUFFER_VARINT_MAX - 1 && src[i] > 1)
+			{
+				return (-1);
+			}
+
+			*pVal = val;
+			return (i + 1);
+		}
+	}
+
+	return ((iLength >= BUFFER_VARINT_MAX) ? -1 : 0);
+}
+
+/***
+ * buffer_varint_decode_u32 - Decodes a varint holding a 32 bit value
+ * @src: The encoded data
+ * @iLength: The amount of encoded data (in bytes)
+ * @pVal: Receives the decoded value
+ *
+ * Return: As buffer_varint_decode, values over 32 bits are malformed.
+ */
+static inline int32_t buffer_varint_decode_u32(const uint8_t* src, int32_t iLength, uint32_t* pVal)
+{
+	const int32_t iMax = std::min<int32_t>(iLength, BUFFER_VARINT32_MAX);
+	uint32_t val = 0;
+
+	for (int32_t i = 0; i < iMax; ++i)
+	{
+		val |= (uint32_t)(src[i] & 0x7F) << (7 * i);
+
+		if (!(src[i] & 0x80))
+		{
+			/* the 5th byte only holds the upper 4 bits */
+			if (i == BUFFER_VARINT32_MAX - 1 && src[i] > 0x0F)
+			{
+				return (-1);
+			}
+
+			*pVal = val;
+			return (i + 1);
+		}
+	}
+
+	return ((iLength >= BUFFER_VARINT32_MAX) ? -1 : 0);
+}
+
+/***
+ * buffer_varint_encode_array - Encodes an array of unsigned integers as varints
+ * @dst: Where to write, at least iCount * BUFFER_VARINT32_MAX bytes
+ * @pValues: The values to encode
+ * @iCount: The amount of values
+ *
+ * Runs of 8 values under 128, the common case, are narrowed to 8 bytes with
+ * SSE2 instead of being encoded one by one.
+ *
+ * Return: The amount of bytes written.
+ */
+int32_t buffer_varint_encode_array(uint8_t* dst, const uint32_t* pValues, int32_t iCount)
+{
+	uint8_t* pStart = dst;
+	int32_t i = 0;
+
+#if defined(BUFFER_USE_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 8 <= iCount; i += 8)
+	{
+		const __m128i lo = _mm_loadu_si128((const __m128i*)(pValues + i));
+		const __m128i hi = _mm_loadu_si128((const __m128i*)(pValues + i + 4));
+		const __m128i high_bits = _mm_srli_epi32(_mm_or_si128(lo, hi), 7);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(high_bits, zero)) == 0xFFFF)
+		{
+			/* every value fits in a byte, the saturating packs are exact */
+			const __m128i words = _mm_packs_epi32(lo, hi);
+			_mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(words, words));
+			dst += 8;
+			continue;
+		}
+
+		for (int32_t j = 0; j < 8; ++j)
+		{
+			dst += buffer_varint_encode(dst, pValues[i + j]);
+		}
+	}
+#endif
+
+	for (; i < iCount; ++i)
+	{
+		dst += buffer_varint_encode(dst, pValues[i]);
+	}
+
+	return ((int32_t)(dst - pStart));
+}
+
+/***
+ * buffer_varint_decode_array - Decodes an array of varints holding 32 bit values
+ * @src: The encoded data
+ * @iLength: The amount of encoded data (in bytes)
+ * @pValues: Receives the decoded values
+ * @iCount: The amount of values to decode
+ *
+ * 16 bytes are checked for continuation bits at once with SSE2, the single
+ * byte values in front of the first multi byte one are widened together.
+ *
+ * Return: The amount of bytes read, 0 if the data is not complete yet, or -1 if it is malformed.
+ */
+int32_t buffer_varint_decode_array(const uint8_t* src, int32_t iLength, uint32_t* pValues, int32_t iCount)
+{
+	int32_t iOffset = 0;
+	int32_t i = 0;
+
+#if defined(BUFFER_USE_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+
+	while (iCount - i >= 16 && iLength - iOffset >= 16)
+	{
+		const __m128i bytes = _mm_loadu_si128((const __m128i*)(src + iOffset));
+		const uint32_t uMask = (uint32_t)_mm_movemask_epi8(bytes);
+
+		if (uMask == 0)
+		{
+			const __m128i words_lo = _mm_unpacklo_epi8(bytes, zero);
+			const __m128i words_hi = _mm_unpackhi_epi8(bytes, zero);
+
+			_mm_storeu_si128((__m128i*)(pValues + i), _mm_unpacklo_epi16(words_lo, zero));
+			_mm_storeu_si128((__m128i*)(pValues + i + 4), _mm_unpackhi_epi16(words_lo, zero));
+			_mm_storeu_si128((__m128i*)(pValues + i + 8), _mm_unpacklo_epi16(words_hi, zero));
+			_mm_storeu_si128((__m128i*)(pValues + i + 12), _mm_unpackhi_epi16(words_hi, zero));
+
+			iOffset += 16;
+			i += 16;
+			continue;
+		}
+
+		/* the bytes before the first continuation bit are whole values */
+		const int32_t iSingles = buffer_bit_scan_forward(uMask);
+
+		for (int32_t j = 0; j < iSingles; ++j)
+		{
+			pValues[i++] = src[iOffset++];
+		}
+
+		const int32_t iRead = buffer_varint_decode_u32(src + iOffset, iLength - iOffset, &pValues[i]);
+
+		if (iRead <= 0)
+		{
+			return (iRead);
+		}
+
+		iOffset += iRead;
+		++i;
+	}
+#endif
+
+	for (; i < iCount; ++i)
+	{
+		const int32_t iRead = buffer_varint_decode_u32(src + iOffset, iLength - iOffset, &pValues[i]);
+
+		if (iRead <= 0)
+		{
+			return (iRead);
+		}
+
+		iOffset += iRead;
+	}
+
+	return (iOffset);
+}
+
+/***
+ * buffer_put_varint - Writes an unsigned integer to the buffer as a varint
+ * @buffer: The buffer to write to, it grows when needed
+ * @val: The value
+ *
+ * Return: Nothing (void)
+ */
+void buffer_put_varint(LPBUFFER& buffer, uint64_t val)
+{
+	uint8_t abData[BUFFER_VARINT_MAX];
+	buffer_write(buffer, abData, buffer_varint_encode(abData, val));
+}
+
+/***
+ * buffer_get_varint - Reads a varint from the buffer
+ * @buffer: The buffer to read from
+ * @pVal: Receives the value
+ *
+ * Nothing is consumed if the varint is not complete.
+ *
+ * Return: true on success, false if the varint is not complete or malformed.
+ */
+bool buffer_get_varint(LPBUFFER buffer, uint64_t* pVal)
+{
+	const int32_t iRead = buffer_varint_decode((const uint8_t*)buffer->read_point, buffer->length, pVal);
+
+	if (iRead <= 0)
+	{
+		if (iRead < 0)
+		{
+			sys_err("buffer_get_varint: malformed varint in buffer");
+		}
+
+		return (false);
+	}
+
+	buffer_read_proceed(buffer, iRead);
+	return (true);
+}
+
+/***
+ * buffer_put_svarint - Writes a signed integer to the buffer as a zigzag varint
+ * @buffer: The buffer to write to, it grows when needed
+ * @val: The value
+ *
+ * Return: Nothing (void)
+ */
+void buffer_put_svarint(LPBUFFER& buffer, int64_t val)
+{
+	buffer_put_varint(buffer, buffer_zigzag_encode(val));
+}
+
+/***
+ * buffer_get_svarint - Reads a zigzag varint from the buffer
+ * @buffer: The buffer to read from
+ * @pVal: Receives the value
+ *
+ * Return: true on success, false if the varint is not complete or malformed.
+ */
+bool buffer_get_svarint(LPBUFFER buffer, int64_t* pVal)
+{
+	uint64_t val;
+
+	if (!buffer_get_varint(buffer, &val))
+	{
+		return (false);
+	}
+
+	*pVal = buffer_zigzag_decode(val);
+	return (true);
+}
+
+/***
+ * buffer_put_varint_array - Writes an array of unsigned integers to the buffer as varints
+ * @buffer: The buffer to write to, it grows when needed
+ * @pValues: The values
+ * @iCount: The amount of values
+ *
+ * The values are encoded straight into the buffer, the count is not written.
+ *
+ * Return: Nothing (void)
+ */
+void buffer_put_varint_array(LPBUFFER& buffer, const uint32_t* pValues, int32_t iCount)
+{
+	buffer_adjust_size(buffer, iCount * BUFFER_VARINT32_MAX);
+	buffer_write_proceed(buffer, buffer_varint_encode_array((uint8_t*)buffer_write_peek(buffer), pValues, iCount));
+}
+
+/***
+ * buffer_get_varint_array - Reads an array of varints from the buffer
+ * @buffer: The buffer to read from
+ * @pValues: Receives the values
+ * @iCount: The amount of values to read
+ *
+ * Nothing is consumed if the array is not complete.
+ *
+ * Return: true on success, false if the array is not complete or malformed.
+ */
+bool buffer_get_varint_array(LPBUFFER buffer, uint32_t* pValues, int32_t iCount)
+{
+	const int32_t iRead = buffer_varint_decode_array((const uint8_t*)buffer->read_point, buffer->length, pValues, iCount);
+
+	if (iRead < 0)
+	{
+		sys_err("buffer_get_varint_array: malformed varint in buffer");
+		return (false);
+	}
+
+	if (iRead == 0 && iCount > 0)
+	{
+		return (false);
+	}
+
+	buffer_read_proceed(buffer, iRead);
+	return (true);
+}
+
+/***
+ * buffer_put_delta_array - Writes a sequence of values as zigzag varints of their differences
+ * @buffer: The buffer to write to, it grows when needed
+ * @pValues: The values, e.g. sorted entity IDs or successive coordinates
+ * @iCount: The amount of values
+ * @dwBase: The value the first one is taken from, e.g. the previous tick's
+ *
+ * Each value is sent as its difference to the one before, so values that
+ * change little take a byte each whatever their size. The differences wrap
+ * around 32 bits.
+ *
+ * Return: Nothing (void)
+ */
+void buffer_put_delta_array(LPBUFFER& buffer, const uint32_t* pValues, int32_t iCount, uint32_t dwBase)
+{
+	uint32_t adwDelta[64];
+
+	buffer_adjust_size(buffer, iCount * BUFFER_VARINT32_MAX);
+
+	for (int32_t i = 0; i < iCount; i += 64)
+	{
+		const int32_t iChunk = std::min<int32_t>(iCount - i, 64);
+
+		for (int32_t j = 0; j < iChunk; ++j)
+		{
+			adwDelta[j] = buffer_zigzag_encode32((int32_t)(pValues[i + j] - dwBase));
+			dwBase = pValues[i + j];
+		}
 
-	/* set the buffer to the newly allocated one */
-	buffer = tempBuf;
+		buffer_write_proceed(buffer, buffer_varint_encode_array((uint8_t*)buffer_write_peek(buffer), adwDelta, iChunk));
+	}
 }
 
 /***
- * buffer_write - Writes data to the buffer and reallocates if necessary
- * @buffer: The buffer to write data into (passed by reference)
- * @src: Pointer to the source data to be written
- * @iLength: The length of the data to be written
- *
- * This function checks if the buffer has enough space to accommodate the
- * new data. If the current buffer's write position plus the length of the
- * data exceeds the buffer's allocated size, it reallocates the buffer to
- * make room for the additional data. After ensuring there is enough space,
- * the function copies the data from the source to the buffer's write point
- * and updates the buffer's internal write position.
+ * buffer_get_delta_array - Reads a sequence written by buffer_put_delta_array
+ * @buffer: The buffer to read from
+ * @pValues: Receives the values
+ * @iCount: The amount of values to read
+ * @dwBase: The base given to buffer_put_delta_array
  *
- * Return: None
+ * Return: true on success, false if the sequence is not complete or malformed.
  */
-void buffer_write(LPBUFFER& buffer, const void* src, int32_t iLength)
+bool buffer_get_delta_array(LPBUFFER buffer, uint32_t* pValues, int32_t iCount, uint32_t dwBase)
 {
-	/* if the buffer actual write position and the given data length is equal or bigger than the allocated memory size */
-	if (buffer->write_point_pos + iLength >= buffer->mem_size)
+	if (!buffer_get_varint_array(buffer, pValues, iCount))
 	{
-		/* then reallocate the buffer to have a space for the new data to be written */
-		sys_log(0, "buffer_write: realloc buffer : write_point_pos [%d] + iLength [%d] >= mem_size [%d]", buffer->write_point_pos, iLength, buffer->mem_size);
-		buffer_realloc(buffer, buffer->mem_size + iLength + std::min<int32_t>(BUFFER_REALLOC_SIZE, iLength));
+		return (false);
 	}
 
-	/* write the data from that is given to the write point */
-	thecore_memcpy(buffer->write_point, src, iLength);
-	buffer_write_proceed(buffer, iLength);
+	for (int32_t i = 0; i < iCount; ++i)
+	{
+		dwBase += (uint32_t)buffer_zigzag_decode32(pValues[i]);
+		pValues[i] = dwBase;
+	}
+
+	return (true);
 }
 
 /***
- * buffer_write_peek - Returns the current write position in the buffer
- * @buffer: The buffer whose write point is to be returned
- *
- * This function returns a pointer to the current position in the buffer
- * where the next write operation will begin. It does not modify the buffer,
- * but allows for inspection of the write point, which is usually empty point
- * right after the last character.
+ * buffer_ring_read_offset - Get the offset of the read point of a ring buffer.
+ * @buffer: The ring buffer.
  *
- * Return: A pointer to the current write position in the buffer.
+ * Return: The offset of the first unread byte from the start of mem_data.
  */
-void* buffer_write_peek(LPBUFFER buffer)
+static inline int32_t buffer_ring_read_offset(LPBUFFER buffer)
 {
-	return (buffer->write_point);
+	return ((int32_t)(buffer->read_point - buffer->mem_data));
 }
 
-/**
- * buffer_write_proceed - Advances the write position in the buffer after data is written
- * @buffer: The buffer whose write position is to be updated
- * @iLength: The number of bytes written to the buffer
+/***
+ * buffer_ring_write - Writes data to the ring buffer
+ * @buffer: The ring buffer to write data into
+ * @src: Pointer to the source data to be written
+ * @iLength: The length of the data to be written
  *
- * This function updates the buffer's internal tracking of the amount of data
- * written. It increases the buffer's total length, adjusts the write pointer
- * to reflect the new position, and increments the write point position to
- * account for the newly written data.
+ * This function copies the data at the write position, wrapping around the end
+ * of the buffer when needed. The ring buffer never grows, if there isn't enough
+ * free space for the whole data nothing is written.
  *
- * Return: Nothing (void.)
+ * Return: True if the data was written, false if the buffer doesn't have enough space.
  */
-void buffer_write_proceed(LPBUFFER buffer, int32_t iLength)
+bool buffer_ring_write(LPBUFFER buffer, const void* src, int32_t iLength)
 {
-	buffer->length += iLength;
-	buffer->write_point += iLength;
-	buffer->write_point_pos += iLength;
+	void* pFirst;
+	void* pSecond;
+	int32_t iFirstLength, iSecondLength;
+
+	if (iLength < 0 || buffer_ring_write_peek(buffer, &pFirst, &iFirstLength, &pSecond, &iSecondLength) < iLength)
+	{
+		return (false);
+	}
+
+	/* the first segment runs up to the end of the buffer (or to the read point), the rest wraps to the start */
+	int32_t iHead = std::min<int32_t>(iLength, iFirstLength);
+	thecore_memcpy(pFirst, src, iHead);
+
+	if (iLength > iHead)
+	{
+		thecore_memcpy(pSecond, (const char*)src + iHead, iLength - iHead);
+	}
+
+	buffer_ring_write_proceed(buffer, iLength);
+	return (true);
 }
 
 /***
- * buffer_read - Reads data from the buffer
- * @buffer: The buffer to read data from
- * @buf: The destination buffer where the data will be copied
- * @iBytes: The number of bytes to read
+ * buffer_ring_write_peek - Returns the free space of the ring buffer as up to two contiguous segments
+ * @buffer: The ring buffer to inspect
+ * @ppFirst: Receives the start of the first free segment (at the write position)
+ * @piFirstLength: Receives the length of the first free segment
+ * @ppSecond: Receives the start of the second free segment (at the start of the buffer)
+ * @piSecondLength: Receives the length of the second free segment, 0 when there is none
  *
- * This function copies the specified number of bytes from the buffer's
- * read position into the provided destination buffer. After copying the data,
- * it advances the buffer's read position by the number of bytes read.
+ * The segments can be filled directly, e.g. by recv or readv, and then committed
+ * with buffer_ring_write_proceed. The first segment is filled before the second.
  *
- * Return: Nothing (void.)
+ * Return: The total amount of free space (in bytes).
  */
-void buffer_read(LPBUFFER buffer, void* buf, int32_t iBytes)
+int32_t buffer_ring_write_peek(LPBUFFER buffer, void** ppFirst, int32_t* piFirstLength, void** ppSecond, int32_t* piSecondLength)
 {
-	thecore_memcpy(buf, buffer->read_point, iBytes);
-	buffer_read_proceed(buffer, iBytes);
+	int32_t iReadOffset = buffer_ring_read_offset(buffer);
+	int32_t iWriteOffset = buffer->write_point_pos;
+	int32_t iFree = buffer->mem_size - buffer->length;
+
+	*ppFirst = buffer->mem_data + iWriteOffset;
+	*ppSecond = buffer->mem_data;
+
+	/* the unread data doesn't wrap, the free space may run to the end and then from the start */
+	if (iWriteOffset >= iReadOffset && buffer->length < buffer->mem_size)
+	{
+		*piFirstLength = buffer->mem_size - iWriteOffset;
+		*piSecondLength = iReadOffset;
+	}
+	else
+	{
+		*piFirstLength = iFree;
+		*piSecondLength = 0;
+	}
+
+	return (iFree);
 }
 
 /***
- * buffer_read_proceed - Advances the read position after reading data
- * @buffer: The buffer whose read position will be updated
- * @iLength: The number of bytes to advance the read position by
- *
- * This function moves the read position forward by the specified number of
- * bytes. If the length to advance is zero, it does nothing. If the length is
- * negative or exceeds the available data in the buffer, an error is logged.
- * If the buffer has more data than the length to process, only the read point
- * is moved. Otherwise, the buffer is reset.
+ * buffer_ring_write_proceed - Advances the write position of the ring buffer after data is written
+ * @buffer: The ring buffer whose write position is to be updated
+ * @iLength: The number of bytes written to the buffer
  *
  * Return: Nothing (void.)
  */
-void buffer_read_proceed(LPBUFFER buffer, int32_t iLength)
+void buffer_ring_write_proceed(LPBUFFER buffer, int32_t iLength)
 {
-	if (iLength == 0)
+	if (iLength <= 0)
 	{
 		return;
 	}
 
-	if (iLength < 0)
-	{
-		sys_err("buffer_read_proceed: length argument is lower than zero [%d]", iLength);
-	}
-	else if (iLength > buffer->length)
+	if (iLength > buffer->mem_size - buffer->length)
 	{
-		sys_err("buffer_read_proceed: length argument is bigger than buffer length [Length: %d] [Buffer Length: %d]", iLength, buffer->length);
-		iLength = buffer->length;
+		sys_err("buffer_ring_write_proceed: length argument is bigger than free space [Length: %d] [Free: %d]", iLength, buffer->mem_size - buffer->length);
+		abort();
 	}
 
-	/* If the length to be processed is less than the buffer length, only the read point is adjusted. */
-	if (iLength < buffer->length)
-	{
-		/* Ensure the read point is within bounds. */
-		if (buffer->read_point + iLength - buffer->mem_data > buffer->mem_size)
-		{
-			sys_err("buffer_read_proceed: buffer overflow! [Length: %d] [Read Point: %d]", iLength, buffer->read_point - buffer->mem_data);
-			abort();
-		}
+	buffer->length += iLength;
+	buffer->write_point_pos += iLength;
 
-		buffer->read_point += iLength;
-		buffer->length = iLength;
-	}
-	else
+	if (buffer->write_point_pos >= buffer->mem_size)
 	{
-		/* If the entire buffer has been processed, reset the buffer. */
-		buffer_reset(buffer);
+		buffer->write_point_pos -= buffer->mem_size;
 	}
+
+	buffer->write_point = buffer->mem_data + buffer->write_point_pos;
 }
 
 /***
- * buffer_read_peek - Returns a pointer to the current read position
- * @buffer: The buffer to peek into
+ * buffer_ring_peek - Copies data from the ring buffer without consuming it
+ * @buffer: The ring buffer to read data from
+ * @buf: The destination buffer where the data will be copied
+ * @iBytes: The number of bytes to copy
  *
- * This function returns a constant pointer to the current read position
- * within the buffer. It allows inspection of the buffer contents at the read
- * position without modifying any internal state.
+ * Useful to inspect a packet header that may wrap around the end of the buffer.
  *
- * Return: A constant pointer to the read point within the buffer
+ * Return: True if the data was copied, false if the buffer holds less than iBytes.
  */
-const void* buffer_read_peek(LPBUFFER buffer)
+bool buffer_ring_peek(LPBUFFER buffer, void* buf, int32_t iBytes)
 {
-	return (static_cast<const void*>(buffer->read_point));
+	const void* pFirst;
+	const void* pSecond;
+	int32_t iFirstLength, iSecondLength;
+
+	if (iBytes < 0 || buffer_ring_read_peek(buffer, &pFirst, &iFirstLength, &pSecond, &iSecondLength) < iBytes)
+	{
+		return (false);
+	}
+
+	int32_t iHead = std::min<int32_t>(iBytes, iFirstLength);
+	thecore_memcpy(buf, pFirst, iHead);
+
+	if (iBytes > iHead)
+	{
+		thecore_memcpy((char*)buf + iHead, pSecond, iBytes - iHead);
+	}
+
+	return (true);
 }
 
 /***
- * buffer_has_space - Determines how much space is left in the buffer
- * @buffer: The buffer to check for available space
- *
- * This function calculates the remaining space in the buffer by subtracting
- * the current write position from the total size of the allocated memory.
- * It returns the number of bytes left that can still be written to the buffer.
+ * buffer_ring_read - Reads data from the ring buffer
+ * @buffer: The ring buffer to read data from
+ * @buf: The destination buffer where the data will be copied
+ * @iBytes: The number of bytes to read
  *
- * Return: The amount of free space (in bytes) available in the buffer.
+ * Return: True if the data was read, false if the buffer holds less than iBytes.
  */
-int32_t buffer_has_space(LPBUFFER buffer)
+bool buffer_ring_read(LPBUFFER buffer, void* buf, int32_t iBytes)
 {
-	return (buffer->mem_size - buffer->write_point_pos);
+	if (!buffer_ring_peek(buffer, buf, iBytes))
+	{
+		return (false);
+	}
+
+	buffer_ring_read_proceed(buffer, iBytes);
+	return (true);
 }
 
 /***
- * buffer_size - Get the current size of the buffer.
- * @buffer: The buffer to query.
+ * buffer_ring_read_peek - Returns the readable data of the ring buffer as up to two contiguous segments
+ * @buffer: The ring buffer to inspect
+ * @ppFirst: Receives the start of the first segment (at the read position)
+ * @piFirstLength: Receives the length of the first segment
+ * @ppSecond: Receives the start of the second segment (at the start of the buffer)
+ * @piSecondLength: Receives the length of the second segment, 0 when the data doesn't wrap
  *
- * This function returns the current length of data in the buffer.
+ * The segments can be passed directly to send or writev, and then consumed with
+ * buffer_ring_read_proceed.
  *
- * Return: The length of the buffer.
+ * Return: The total amount of readable data (in bytes).
  */
-uint32_t buffer_size(LPBUFFER buffer)
+int32_t buffer_ring_read_peek(LPBUFFER buffer, const void** ppFirst, int32_t* piFirstLength, const void** ppSecond, int32_t* piSecondLength)
 {
+	int32_t iReadOffset = buffer_ring_read_offset(buffer);
+
+	*ppFirst = buffer->read_point;
+	*ppSecond = buffer->mem_data;
+
+	/* the unread data runs past the end of the buffer and continues from the start */
+	if (iReadOffset + buffer->length > buffer->mem_size)
+	{
+		*piFirstLength = buffer->mem_size - iReadOffset;
+		*piSecondLength = buffer->length - *piFirstLength;
+	}
+	else
+	{
+		*piFirstLength = buffer->length;
+		*piSecondLength = 0;
+	}
+
 	return (buffer->length);
 }
 
 /***
- * buffer_adjust_size - Adjusts the buffer size to accommodate additional data
- * @buffer: The buffer to be resized (passed by reference)
- * @iAdded_Size: The additional size needed in the buffer
+ * buffer_ring_read_proceed - Advances the read position of the ring buffer after data is read
+ * @buffer: The ring buffer whose read position will be updated
+ * @iLength: The number of bytes to advance the read position by
  *
- * This function checks if the current size of the buffer is sufficient to
- * accommodate the specified additional size. If the buffer already has enough
- * space, no action is taken. If additional space is needed, the buffer is
- * reallocated to increase its size. A log entry is made to record the
- * adjustment.
+ * When all data is consumed both positions go back to the start of the buffer,
+ * which keeps the next writes in one contiguous segment.
  *
  * Return: Nothing (void.)
  */
-void buffer_adjust_size(LPBUFFER& buffer, int32_t iAdded_Size)
+void buffer_ring_read_proceed(LPBUFFER buffer, int32_t iLength)
 {
-	/* if current buffer size is bigger or equal to needed size, do nothing */
-	if (buffer->mem_size >= buffer->write_point_pos + iAdded_Size)
+	if (iLength <= 0)
 	{
 		return;
 	}
 
-	sys_log(0, "buffer_adjust_size: %d size have been added to the buffer, current : %d/%d", iAdded_Size, buffer->length, buffer->mem_size);
-	buffer_realloc(buffer, buffer->mem_size + iAdded_Size);
+	if (iLength > buffer->length)
+	{
+		sys_err("buffer_ring_read_proceed: length argument is bigger than buffer length [Length: %d] [Buffer Length: %d]", iLength, buffer->length);
+		iLength = buffer->length;
+	}
+
+	buffer->length -= iLength;
+
+	if (buffer->length == 0)
+	{
+		buffer->read_point = buffer->mem_data;
+		buffer->write_point = buffer->mem_data;
+		buffer->write_point_pos = 0;
+		return;
+	}
+
+	int32_t iReadOffset = buffer_ring_read_offset(buffer) + iLength;
+
+	if (iReadOffset >= buffer->mem_size)
+	{
+		iReadOffset -= buffer->mem_size;
+	}
+
+	buffer->read_point = buffer->mem_data + iReadOffset;
 }
 
 /***
- * buffer_get_byte - Reads a BYTE value from the buffer
- * @buffer: The buffer to read from
+ * buffer_ring_has_space - Determines how much space is left in the ring buffer
+ * @buffer: The ring buffer to check for available space
  *
- * This function retrieves a single BYTE value from the current read position
- * of the buffer. It first checks if there is enough data available to read
- * a BYTE. If not, an error is logged, and a default value of 0 is returned.
- * After reading, the read position is updated.
- *
- * Return: The BYTE value read from the buffer, or 0 if there is not enough data.
+ * Return: The amount of free space (in bytes), it may be split in two segments.
  */
-uint8_t buffer_get_byte(LPBUFFER buffer)
+int32_t buffer_ring_has_space(LPBUFFER buffer)
 {
-	/* Ensure the buffer has enough data to read a BYTE */
-	if (buffer->length < sizeof(uint8_t))
-	{
-		sys_err("buffer_get_byte: not enough data in buffer to read a BYTE");
-		return 0;
-	}
+	return (buffer->mem_size - buffer->length);
+}
 
-	/* Read the BYTE value from the current read point */
-	uint8_t val = *(uint8_t*)buffer->read_point;
+/***
+ * buffer_shared_new - Create an immutable, reference-counted buffer.
+ * @src: Pointer to the data of the buffer, e.g. an encoded packet.
+ * @iLength: The length of the data.
+ *
+ * The data is copied once, after that the buffer can be queued on any amount of
+ * output streams with buffer_shared_view, each one holding a reference. The
+ * buffer returns to the pool when the last reference is released.
+ *
+ * Return: The shared buffer, holding one reference owned by the caller.
+ */
+LPBUFFER buffer_shared_new(const void* src, int32_t iLength)
+{
+	LPBUFFER buffer = buffer_new(iLength);
 
-	/* Advance the read position by the size of a BYTE */
-	buffer_read_proceed(buffer, sizeof(uint8_t));
+	thecore_memcpy(buffer->write_point, src, iLength);
+	buffer_write_proceed(buffer, iLength);
+	buffer->refcount.store(1, std::memory_order_relaxed);
 
-	/* Return the read BYTE value */
-	return val;
+	return (buffer);
 }
 
 /***
- * buffer_get_word - Reads a WORD value from the buffer
- * @buffer: The buffer to read from
+ * buffer_shared_ref - Take a new reference on a shared buffer.
+ * @buffer: The shared buffer.
  *
- * This function retrieves a WORD value from the current read position of
- * the buffer. It checks if there is enough data to read a WORD. If
- * insufficient data is available, an error is logged, and 0 is returned.
- * The read position is updated after reading the value.
+ * Return: The same buffer, for convenience.
+ */
+LPBUFFER buffer_shared_ref(LPBUFFER buffer)
+{
+	assert(buffer->refcount.load(std::memory_order_relaxed) > 0);
+	buffer->refcount.fetch_add(1, std::memory_order_relaxed);
+	return (buffer);
+}
+
+/***
+ * buffer_shared_release - Release a reference on a shared buffer.
+ * @buffer: The shared buffer.
  *
- * Return: The WORD value read from the buffer, or 0 if there is not enough data.
+ * The buffer goes back to the pool when the last reference is released, from
+ * whatever thread releases it.
+ * Return: Nothing (void.)
  */
-uint16_t buffer_get_word(LPBUFFER buffer)
+void buffer_shared_release(LPBUFFER buffer)
 {
-	/* Ensure the buffer has enough data to read a WORD */
-	if (buffer->length < sizeof(uint16_t))
+	if (buffer->refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)
 	{
-		sys_err("buffer_get_word: not enough data in buffer to read a WORD");
-		return 0;
+		buffer_delete(buffer);
 	}
-
-	/* Read the WORD value from the current read point */
-	uint16_t val = *(uint16_t*)buffer->read_point;
-
-	/* Advance the read position by the size of a WORD */
-	buffer_read_proceed(buffer, sizeof(uint16_t));
-
-	/* Return the read WORD value */
-	return val;
 }
 
 /***
- * buffer_get_dword - Reads a DWORD value from the buffer
- * @buffer: The buffer to read from
+ * buffer_shared_view - Create a reader of a shared buffer.
+ * @shared: The shared buffer to read.
  *
- * This function retrieves a DWORD value from the current read position of
- * the buffer. It checks if there is sufficient data available to read a
- * DWORD. If not, an error is logged, and 0 is returned. The read position
- * is updated after reading the value.
+ * A view is a small pooled buffer whose read point runs over the data of the
+ * shared buffer, so every output stream consumes the data at its own pace
+ * without copying it. The view holds a reference until it is deleted with
+ * buffer_delete. A view can't be written to.
  *
- * Return: The DWORD value read from the buffer, or 0 if there is not enough data.
+ * Return: The new view.
  */
-uint32_t buffer_get_dword(LPBUFFER buffer)
+LPBUFFER buffer_shared_view(LPBUFFER shared)
 {
-	/* Ensure the buffer has enough data to read a DWORD */
-	if (buffer->length < sizeof(uint32_t))
-	{
-		sys_err("buffer_get_dword: not enough data in buffer to read a DWORD");
-		return 0;
-	}
+	LPBUFFER view = buffer_new(0);
 
-	/* Read the DWORD value from the current read point */
-	uint32_t val = *(uint32_t*)buffer->read_point;
+	view->shared = buffer_shared_ref(shared);
+	view->read_point = shared->read_point;
+	view->length = shared->length;
 
-	/* Advance the read position by the size of a DWORD */
-	buffer_read_proceed(buffer, sizeof(uint32_t));
+	/* the view has no room of its own, so nothing gets written after the shared data */
+	view->write_point = view->mem_data + view->mem_size;
+	view->write_point_pos = view->mem_size;
 
-	/* Return the read DWORD value */
-	return val;
+	return (view);
 }
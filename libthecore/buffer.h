@@ -1,6 +1,38 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <type_traits>
+
+/* sizes up to 2^BUFFER_POOL_SMALL_SHIFT bytes use one size class per power of two */
+#define BUFFER_POOL_SMALL_SHIFT 4
+
+/* larger sizes use 2^BUFFER_POOL_CLASS_BITS size classes per power of two */
+#define BUFFER_POOL_CLASS_BITS 2
+#define BUFFER_POOL_CLASSES_PER_POW2 (1 << BUFFER_POOL_CLASS_BITS)
+
+/* the biggest pooled size is 2^BUFFER_POOL_MAX_SHIFT bytes (1 GB) */
+#define BUFFER_POOL_MAX_SHIFT 30
+
+/* amount of pooled size classes (1, 2, 4, 8, 16, then 20, 24, 28, 32, 40, ... up to 1 GB) */
+#define BUFFER_POOL_COUNT (BUFFER_POOL_SMALL_SHIFT + 1 + (BUFFER_POOL_MAX_SHIFT - BUFFER_POOL_SMALL_SHIFT) * BUFFER_POOL_CLASSES_PER_POW2)
+
+/* Allocators a buffer memory can come from */
+enum EBufferAllocType
+{
+	/* header and payload are two separate heap allocations */
+	BUFFER_ALLOC_HEAP,
+	/* header and payload are one chunk carved from a slab */
+	BUFFER_ALLOC_SLAB,
+	/* the payload is an anonymous mapping, grown with mremap */
+	BUFFER_ALLOC_MMAP,
+};
+
+/* buffers of this size and bigger are mapped, so growing them doesn't copy */
+#define BUFFER_MMAP_THRESHOLD (1024 * 1024)
+
+struct SBufferSlab;
 
 typedef struct SBuffer
 {
@@ -27,8 +59,68 @@ typedef struct SBuffer
 
 	/* A field used to store various flags or status indicators */
 	long flag;
+
+	/* The allocator that owns the buffer memory (see EBufferAllocType) */
+	int32_t alloc_type;
+
+	/* The slab the buffer was carved from, when alloc_type is BUFFER_ALLOC_SLAB */
+	SBufferSlab* slab;
+
+	/* The amount of references on a shared buffer, 0 for a regular buffer */
+	std::atomic<int32_t> refcount;
+
+	/* The shared buffer a view reads from, nullptr for a regular buffer */
+	SBuffer* shared;
 } TBuffer;
 
+/* Statistics of one size class of the buffer pool */
+typedef struct SBufferPoolStats
+{
+	/* The size of every buffer of the class */
+	int32_t size;
+
+	/* Allocations served by a pooled buffer */
+	uint64_t hits;
+
+	/* Allocations that had to create a new buffer */
+	uint64_t misses;
+
+	/* Bytes of the buffers currently handed out */
+	int64_t in_use_bytes;
+
+	/* Bytes of the idle buffers kept by the pool */
+	int64_t pooled_bytes;
+
+	/* Bytes of every buffer of the class, in use or pooled */
+	int64_t total_bytes;
+
+	/* The highest total_bytes seen */
+	int64_t peak_bytes;
+
+	/* Buffers given back to the system by the watermarks and trimming */
+	uint64_t trimmed;
+
+	/* The pool policy of the class, in buffers */
+	int32_t low_water;
+	int32_t high_water;
+} TBufferPoolStats;
+
+/* Counters of how buffer_write and buffer_adjust_size made room for data */
+typedef struct SBufferWriteStats
+{
+	/* Times the unread data was slid to the front instead of growing */
+	uint64_t compactions;
+
+	/* Bytes moved by the compactions */
+	uint64_t compacted_bytes;
+
+	/* Times a buffer was grown by allocating a bigger one and copying */
+	uint64_t reallocations;
+
+	/* Times a mapped buffer was grown with mremap */
+	uint64_t remaps;
+} TBufferWriteStats;
+
 /* a variable to Buffer struct */
 typedef TBuffer BUFFER;
 
@@ -38,6 +130,21 @@ typedef TBuffer* LPBUFFER;
 /* Safely allocate memory and handle errors. */
 bool safe_create(char** pData, int32_t iNum);
 
+/* Set the pool policy (idle buffers kept) of the size class serving the given size. */
+extern bool buffer_pool_set_watermarks(int32_t iSize, int32_t iLowWater, int32_t iHighWater);
+
+/* Give idle pooled buffers back to the system, call periodically. */
+extern int64_t buffer_pool_trim();
+
+/* Hand the buffers cached by the calling thread to the depot, call when the thread is idle. */
+extern int64_t buffer_thread_cache_trim();
+
+/* Get the statistics of a size class of the buffer pool. */
+extern bool buffer_pool_get_stats(int32_t iPoolIndex, TBufferPoolStats* pStats);
+
+/* Write the statistics of the buffer pool to the syslog. */
+extern void buffer_pool_log_stats();
+
 /* Create a new buffer of the specified size. */
 extern LPBUFFER buffer_new(int32_t iSize);
 
@@ -50,9 +157,15 @@ extern void buffer_reset(LPBUFFER buffer);
 /* Reallocates the given buffer to accommodate additional memory */
 void buffer_realloc(LPBUFFER& buffer, int32_t iLength);
 
-/* Writes data to the buffer and reallocates if necessary */
+/* Get the counters of compactions versus reallocations */
+extern void buffer_get_write_stats(TBufferWriteStats* pStats);
+
+/* Writes data to the buffer, compacts or reallocates if necessary */
 extern void buffer_write(LPBUFFER& buffer, const void* src, int32_t iLength);
 
+/* Checks whether a buffer is shared or a view of a shared buffer, neither can be written to */
+extern bool buffer_is_immutable(LPBUFFER buffer);
+
 /* Returns the current write position in the buffer */
 extern void* buffer_write_peek(LPBUFFER buffer);
 
@@ -68,6 +181,82 @@ extern void buffer_read_proceed(LPBUFFER buffer, int32_t iLength);
 /* Returns a pointer to the current read position */
 extern const void* buffer_read_peek(LPBUFFER buffer);
 
+/***
+ * buffer_write_fixed - Writes iLength bytes, iLength known at compile time.
+ * @buffer: The buffer to write to.
+ * @src: The data.
+ *
+ * thecore_memcpy is an indirect call the compiler can't see through, even
+ * for a 4 byte field. With the size a constant, the copy below becomes a
+ * few moves inlined in the caller. Only a write that needs the buffer to
+ * be compacted or grown goes through buffer_write, and so does a write to a
+ * shared buffer or a view, which buffer_write refuses.
+ *
+ * Return: Nothing (void)
+ */
+template <int32_t iLength>
+inline void buffer_write_fixed(LPBUFFER& buffer, const void* src)
+{
+	static_assert(iLength > 0, "buffer_write_fixed: the length must be positive");
+
+	if (buffer->write_point_pos + iLength > buffer->mem_size || buffer_is_immutable(buffer))
+	{
+		buffer_write(buffer, src, iLength);
+		return;
+	}
+
+	std::memcpy(buffer->write_point, src, iLength);
+
+	/* buffer_write_proceed */
+	buffer->length += iLength;
+	buffer->write_point += iLength;
+	buffer->write_point_pos += iLength;
+}
+
+/***
+ * buffer_read_fixed - Reads iLength bytes, iLength known at compile time.
+ * @buffer: The buffer to read from.
+ * @dst: Where to copy the data.
+ *
+ * The counterpart of buffer_write_fixed. Only the read that empties the
+ * buffer (which resets it) goes through buffer_read.
+ *
+ * Return: Nothing (void)
+ */
+template <int32_t iLength>
+inline void buffer_read_fixed(LPBUFFER buffer, void* dst)
+{
+	static_assert(iLength > 0, "buffer_read_fixed: the length must be positive");
+
+	if (iLength >= buffer->length)
+	{
+		buffer_read(buffer, dst, iLength);
+		return;
+	}
+
+	std::memcpy(dst, buffer->read_point, iLength);
+
+	/* buffer_read_proceed */
+	buffer->read_point += iLength;
+	buffer->length -= iLength;
+}
+
+/* Writes an object byte for byte, see buffer_write_fixed */
+template <typename T>
+inline void buffer_write_object(LPBUFFER& buffer, const T& object)
+{
+	static_assert(std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value, "buffer_write_object: T must be trivially copyable and not a pointer");
+	buffer_write_fixed<(int32_t)sizeof(T)>(buffer, &object);
+}
+
+/* Reads an object byte for byte, see buffer_read_fixed */
+template <typename T>
+inline void buffer_read_object(LPBUFFER buffer, T& object)
+{
+	static_assert(std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value, "buffer_read_object: T must be trivially copyable and not a pointer");
+	buffer_read_fixed<(int32_t)sizeof(T)>(buffer, &object);
+}
+
 /* Determines how much space is left in the buffer */
 extern int32_t buffer_has_space(LPBUFFER buffer);
 
@@ -84,4 +273,116 @@ extern uint8_t buffer_get_byte(LPBUFFER buffer);
 extern uint16_t buffer_get_word(LPBUFFER buffer);
 
 /* Reads a DWORD value from the buffer */
-extern uint32_t buffer_get_dword(LPBUFFER buffer);
\ No newline at end of file
+extern uint32_t buffer_get_dword(LPBUFFER buffer);
+
+/* most bytes a varint of a 64 bit value takes */
+#define BUFFER_VARINT_MAX 10
+
+/* most bytes a varint of a 32 bit value takes */
+#define BUFFER_VARINT32_MAX 5
+
+/* Maps signed integers to unsigned ones so small negative values make short varints: 0, -1, 1, -2 -> 0, 1, 2, 3 */
+inline uint64_t buffer_zigzag_encode(int64_t val)
+{
+	return (((uint64_t)val << 1) ^ (uint64_t)(val >> 63));
+}
+
+inline int64_t buffer_zigzag_decode(uint64_t val)
+{
+	return ((int64_t)(val >> 1) ^ -(int64_t)(val & 1));
+}
+
+inline uint32_t buffer_zigzag_encode32(int32_t val)
+{
+	return (((uint32_t)val << 1) ^ (uint32_t)(val >> 31));
+}
+
+inline int32_t buffer_zigzag_decode32(uint32_t val)
+{
+	return ((int32_t)(val >> 1) ^ -(int32_t)(val & 1));
+}
+
+/* Encodes an unsigned integer as a varint (LEB128) */
+extern int32_t buffer_varint_encode(uint8_t* dst, uint64_t val);
+
+/* Decodes a varint */
+extern int32_t buffer_varint_decode(const uint8_t* src, int32_t iLength, uint64_t* pVal);
+
+/* Encodes an array of unsigned integers as varints */
+extern int32_t buffer_varint_encode_array(uint8_t* dst, const uint32_t* pValues, int32_t iCount);
+
+/* Decodes an array of varints holding 32 bit values */
+extern int32_t buffer_varint_decode_array(const uint8_t* src, int32_t iLength, uint32_t* pValues, int32_t iCount);
+
+/* Writes an unsigned integer to the buffer as a varint */
+extern void buffer_put_varint(LPBUFFER& buffer, uint64_t val);
+
+/* Reads a varint from the buffer */
+extern bool buffer_get_varint(LPBUFFER buffer, uint64_t* pVal);
+
+/* Writes a signed integer to the buffer as a zigzag varint */
+extern void buffer_put_svarint(LPBUFFER& buffer, int64_t val);
+
+/* Reads a zigzag varint from the buffer */
+extern bool buffer_get_svarint(LPBUFFER buffer, int64_t* pVal);
+
+/* Writes an array of unsigned integers to the buffer as varints */
+extern void buffer_put_varint_array(LPBUFFER& buffer, const uint32_t* pValues, int32_t iCount);
+
+/* Reads an array of varints from the buffer */
+extern bool buffer_get_varint_array(LPBUFFER buffer, uint32_t* pValues, int32_t iCount);
+
+/* Writes a sequence of values as zigzag varints of their differences */
+extern void buffer_put_delta_array(LPBUFFER& buffer, const uint32_t* pValues, int32_t iCount, uint32_t dwBase);
+
+/* Reads a sequence written by buffer_put_delta_array */
+extern bool buffer_get_delta_array(LPBUFFER buffer, uint32_t* pValues, int32_t iCount, uint32_t dwBase);
+
+/***
+ * Ring buffer mode - a TBuffer created with buffer_new can be used as a fixed size
+ * circular buffer through the buffer_ring_* functions, reads and writes wrap around
+ * the end of mem_data so the buffer never reallocates nor moves its data.
+ * A buffer must use either the ring functions or the linear ones, never both.
+ */
+
+/* Writes data to the ring buffer, all or nothing */
+extern bool buffer_ring_write(LPBUFFER buffer, const void* src, int32_t iLength);
+
+/* Returns the free space of the ring buffer as up to two contiguous segments */
+extern int32_t buffer_ring_write_peek(LPBUFFER buffer, void** ppFirst, int32_t* piFirstLength, void** ppSecond, int32_t* piSecondLength);
+
+/* Advances the write position of the ring buffer after data is written */
+extern void buffer_ring_write_proceed(LPBUFFER buffer, int32_t iLength);
+
+/* Reads data from the ring buffer, all or nothing */
+extern bool buffer_ring_read(LPBUFFER buffer, void* buf, int32_t iBytes);
+
+/* Copies data from the ring buffer without consuming it */
+extern bool buffer_ring_peek(LPBUFFER buffer, void* buf, int32_t iBytes);
+
+/* Returns the readable data of the ring buffer as up to two contiguous segments */
+extern int32_t buffer_ring_read_peek(LPBUFFER buffer, const void** ppFirst, int32_t* piFirstLength, const void** ppSecond, int32_t* piSecondLength);
+
+/* Advances the read position of the ring buffer after data is read */
+extern void buffer_ring_read_proceed(LPBUFFER buffer, int32_t iLength);
+
+/* Determines how much space is left in the ring buffer */
+extern int32_t buffer_ring_has_space(LPBUFFER buffer);
+
+
+/***
+ * Shared buffers - an immutable, reference-counted buffer is encoded once and
+ * queued on many output streams through views, see buffer_chain_append_shared.
+ */
+
+/* Create an immutable, reference-counted buffer holding a copy of the data */
+extern LPBUFFER buffer_shared_new(const void* src, int32_t iLength);
+
+/* Take a new reference on a shared buffer */
+extern LPBUFFER buffer_shared_ref(LPBUFFER buffer);
+
+/* Release a reference, the buffer returns to the pool with the last one */
+extern void buffer_shared_release(LPBUFFER buffer);
+
+/* Create a reader of a shared buffer, holding a reference until it is deleted */
+extern LPBUFFER buffer_shared_view(LPBUFFER shared);
\ No newline at end of file
@@ -0,0 +1,355 @@
+#include "stdafx.h"
+
+#if defined(_WIN64)
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/uio.h>
+#endif
+
+#if defined(_WIN64)
+	#define IOVEC_BASE(iov) ((iov).buf)
+	#define IOVEC_LEN(iov) ((iov).len)
+#else
+	#define IOVEC_BASE(iov) ((iov).iov_base)
+	#define IOVEC_LEN(iov) ((iov).iov_len)
+#endif
+
+/***
+ * buffer_chain_new - Create a new empty chain.
+ * @iSegmentSize: The size of the segments allocated when writing.
+ *
+ * Return: The new chain.
+ */
+LPBUFFERCHAIN buffer_chain_new(int32_t iSegmentSize)
+{
+	LPBUFFERCHAIN chain;
+
+	CREATE(chain, BUFFER_CHAIN, 1);
+	chain->segment_size = std::max<int32_t>(iSegmentSize, 64);
+
+	return (chain);
+}
+
+/***
+ * buffer_chain_delete - Free the chain and return its segments to the pool.
+ * @chain: The chain to delete.
+ *
+ * Return: Nothing (void.)
+ */
+void buffer_chain_delete(LPBUFFERCHAIN chain)
+{
+	if (!chain)
+	{
+		return;
+	}
+
+	buffer_chain_reset(chain);
+	free(chain);
+}
+
+/***
+ * buffer_chain_reset - Drop all data of the chain.
+ * @chain: The chain to reset.
+ *
+ * Every segment is returned to the buffer pool.
+ * Return: Nothing (void.)
+ */
+void buffer_chain_reset(LPBUFFERCHAIN chain)
+{
+	LPBUFFER nextSegment = nullptr;
+
+	for (LPBUFFER segment = chain->head; segment != nullptr; segment = nextSegment)
+	{
+		nextSegment = segment->next;
+		buffer_delete(segment);
+	}
+
+	chain->head = nullptr;
+	chain->tail = nullptr;
+	chain->segment_count = 0;
+	chain->length = 0;
+}
+
+/***
+ * buffer_chain_link - Link a segment at the end of the chain.
+ * @chain: The chain.
+ * @segment: The segment to link.
+ *
+ * Return: Nothing (void.)
+ */
+static void buffer_chain_link(LPBUFFERCHAIN chain, LPBUFFER segment)
+{
+	segment->next = nullptr;
+
+	/* a drained tail is the only segment left, reads would stop at it if it stayed the head */
+	if (chain->tail && buffer_size(chain->tail) == 0)
+	{
+		buffer_delete(chain->tail);
+		chain->head = nullptr;
+		chain->tail = nullptr;
+		chain->segment_count = 0;
+	}
+
+	if (chain->tail)
+	{
+		chain->tail->next = segment;
+	}
+	else
+	{
+		chain->head = segment;
+	}
+
+	chain->tail = segment;
+	chain->segment_count++;
+}
+
+/***
+ * buffer_chain_write - Writes data at the end of the chain, adding segments when needed
+ * @chain: The chain to write data into
+ * @src: Pointer to the source data to be written
+ * @iLength: The length of the data to be written
+ *
+ * The free space of the tail segment is filled first, the rest goes to one new
+ * segment of at least segment_size bytes. Unlike buffer_write, data that is
+ * already in the chain is never copied again.
+ *
+ * Return: Nothing (void.)
+ */
+void buffer_chain_write(LPBUFFERCHAIN chain, const void* src, int32_t iLength)
+{
+	const char* pSource = (const char*)src;
+
+	if (iLength <= 0)
+	{
+		return;
+	}
+
+	/* fill the room left in the tail segment */
+	if (chain->tail)
+	{
+		int32_t iSpace = std::min<int32_t>(buffer_has_space(chain->tail), iLength);
+		if (iSpace > 0)
+		{
+			thecore_memcpy(buffer_write_peek(chain->tail), pSource, iSpace);
+			buffer_write_proceed(chain->tail, iSpace);
+			chain->length += iSpace;
+			pSource += iSpace;
+			iLength -= iSpace;
+		}
+	}
+
+	if (iLength > 0)
+	{
+		LPBUFFER segment = buffer_new(std::max<int32_t>(chain->segment_size, iLength));
+		thecore_memcpy(buffer_write_peek(segment), pSource, iLength);
+		buffer_write_proceed(segment, iLength);
+
+		buffer_chain_link(chain, segment);
+		chain->length += iLength;
+	}
+}
+
+/***
+ * buffer_chain_append - Appends a filled buffer as a new segment
+ * @chain: The chain to append to
+ * @buffer: The buffer, the chain takes ownership of it
+ *
+ * Lets a packet that was encoded in its own buffer join the stream without
+ * being copied. The buffer is returned to the pool once it is consumed.
+ *
+ * Return: Nothing (void.)
+ */
+void buffer_chain_append(LPBUFFERCHAIN chain, LPBUFFER buffer)
+{
+	if (buffer_size(buffer) == 0)
+	{
+		buffer_delete(buffer);
+		return;
+	}
+
+	buffer_chain_link(chain, buffer);
+	chain->length += buffer_size(buffer);
+}
+
+/***
+ * buffer_chain_append_shared - Queues a shared buffer as a new segment
+ * @chain: The chain to append to
+ * @shared: The shared buffer, created with buffer_shared_new
+ *
+ * The chain gets a view holding its own reference, the caller keeps its own.
+ * Queuing a broadcast on N chains costs N small pooled headers instead of N
+ * copies of the data.
+ *
+ * Return: Nothing (void.)
+ */
+void buffer_chain_append_shared(LPBUFFERCHAIN chain, LPBUFFER shared)
+{
+	buffer_chain_append(chain, buffer_shared_view(shared));
+}
+
+/***
+ * buffer_chain_read - Reads data from the start of the chain
+ * @chain: The chain to read data from
+ * @buf: The destination buffer where the data will be copied
+ * @iBytes: The number of bytes to read
+ *
+ * Return: True if the data was read, false if the chain holds less than iBytes.
+ */
+bool buffer_chain_read(LPBUFFERCHAIN chain, void* buf, int32_t iBytes)
+{
+	if (iBytes < 0 || iBytes > chain->length)
+	{
+		return (false);
+	}
+
+	char* pDest = (char*)buf;
+
+	while (iBytes > 0)
+	{
+		int32_t iChunk = std::min<int32_t>(iBytes, buffer_size(chain->head));
+		thecore_memcpy(pDest, buffer_read_peek(chain->head), iChunk);
+		buffer_chain_read_proceed(chain, iChunk);
+		pDest += iChunk;
+		iBytes -= iChunk;
+	}
+
+	return (true);
+}
+
+/***
+ * buffer_chain_read_proceed - Consumes data from the start of the chain
+ * @chain: The chain whose read position will be updated
+ * @iLength: The number of bytes consumed, e.g. the result of a send
+ *
+ * Segments that are fully consumed are unlinked and returned to the pool,
+ * except the tail one which is kept for the next writes when it can take them.
+ *
+ * Return: Nothing (void.)
+ */
+void buffer_chain_read_proceed(LPBUFFERCHAIN chain, int32_t iLength)
+{
+	if (iLength > chain->length)
+	{
+		sys_err("buffer_chain_read_proceed: length argument is bigger than chain length [Length: %d] [Chain Length: %d]", iLength, chain->length);
+		iLength = chain->length;
+	}
+
+	while (iLength > 0 && chain->head)
+	{
+		LPBUFFER segment = chain->head;
+		LPBUFFER nextSegment = segment->next;
+		int32_t iChunk = std::min<int32_t>(iLength, buffer_size(segment));
+
+		/* a drained buffer is reset, which also clears its link */
+		buffer_read_proceed(segment, iChunk);
+		segment->next = nextSegment;
+		chain->length -= iChunk;
+		iLength -= iChunk;
+
+		/* drained, release the segment unless it is the tail we keep writing into */
+		if (buffer_size(segment) == 0 && (segment != chain->tail || buffer_is_immutable(segment)))
+		{
+			if (segment == chain->tail)
+			{
+				chain->tail = nullptr;
+			}
+
+			chain->head = nextSegment;
+			chain->segment_count--;
+			buffer_delete(segment);
+		}
+	}
+}
+
+/***
+ * buffer_chain_get_iovec - Fills a scatter-gather array with the unread data of the chain
+ * @chain: The chain to expose
+ * @pIOVec: The array to fill
+ * @iMaxCount: The amount of entries of the array
+ *
+ * Return: The amount of entries filled.
+ */
+int32_t buffer_chain_get_iovec(LPBUFFERCHAIN chain, TBufferIOVec* pIOVec, int32_t iMaxCount)
+{
+	int32_t iCount = 0;
+
+	for (LPBUFFER segment = chain->head; segment != nullptr && iCount < iMaxCount; segment = segment->next)
+	{
+		if (buffer_size(segment) == 0)
+		{
+			continue;
+		}
+
+		IOVEC_BASE(pIOVec[iCount]) = (char*)buffer_read_peek(segment);
+		IOVEC_LEN(pIOVec[iCount]) = buffer_size(segment);
+		iCount++;
+	}
+
+	return (iCount);
+}
+
+/***
+ * buffer_chain_writev - Sends as much of the chain as the socket accepts with one writev
+ * @chain: The chain to send
+ * @fd: The socket to send on, usually non-blocking
+ *
+ * Up to BUFFER_CHAIN_IOV_MAX segments are handed to the kernel in a single call,
+ * the sent bytes are consumed from the chain.
+ *
+ * Return: The amount of bytes sent, 0 if the socket would block, -1 on error.
+ */
+int32_t buffer_chain_writev(LPBUFFERCHAIN chain, socket_t fd)
+{
+	TBufferIOVec aIOVec[BUFFER_CHAIN_IOV_MAX];
+	int32_t iCount = buffer_chain_get_iovec(chain, aIOVec, BUFFER_CHAIN_IOV_MAX);
+
+	if (iCount == 0)
+	{
+		return (0);
+	}
+
+#if defined(_WIN64)
+	DWORD dwSent = 0;
+	if (WSASend(fd, aIOVec, iCount, &dwSent, 0, nullptr, nullptr) == SOCKET_ERROR)
+	{
+		int iError = WSAGetLastError();
+		if (iError == WSAEWOULDBLOCK)
+		{
+			return (0);
+		}
+
+		sys_err("WSASend failed, Error[%d]", iError);
+		return (-1);
+	}
+
+	int32_t iSent = (int32_t)dwSent;
+#else
+	ssize_t iResult = writev(fd, aIOVec, iCount);
+	if (iResult < 0)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		{
+			return (0);
+		}
+
+		sys_err("writev failed, Error[%d] : %s", errno, strerror(errno));
+		return (-1);
+	}
+
+	int32_t iSent = (int32_t)iResult;
+#endif
+
+	buffer_chain_read_proceed(chain, iSent);
+	return (iSent);
+}
+
+/***
+ * buffer_chain_size - Get the amount of unread data of the chain.
+ * @chain: The chain to query.
+ *
+ * Return: The unread length of all segments.
+ */
+uint32_t buffer_chain_size(LPBUFFERCHAIN chain)
+{
+	return (chain->length);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+
+/* default size of the segments a chain allocates on write */
+#define BUFFER_CHAIN_SEGMENT_SIZE 16384
+
+/* most segments handed to a single writev call */
+#define BUFFER_CHAIN_IOV_MAX 64
+
+#if defined(_WIN64)
+	/* a scatter-gather entry, as used by WSASend */
+	typedef struct _WSABUF TBufferIOVec;
+#else
+	/* a scatter-gather entry, as used by writev and sendmsg */
+	typedef struct iovec TBufferIOVec;
+#endif
+
+/***
+ * TBufferChain - a byte stream made of linked pooled TBuffer segments.
+ * Writes fill the tail segment and then append new ones, so data already
+ * written is never copied again when the stream grows. The segments are
+ * linked through TBuffer::next and can be sent with one writev.
+ */
+typedef struct SBufferChain
+{
+	/* The first segment, data is read from it */
+	LPBUFFER head;
+
+	/* The last segment, data is written to it */
+	LPBUFFER tail;
+
+	/* The amount of segments in the chain */
+	int32_t segment_count;
+
+	/* The amount of unread data of all segments (in bytes) */
+	int32_t length;
+
+	/* The size of the segments allocated by buffer_chain_write */
+	int32_t segment_size;
+} TBufferChain;
+
+/* a variable to Buffer Chain struct */
+typedef TBufferChain BUFFER_CHAIN;
+
+/* a pointer to Buffer Chain struct */
+typedef TBufferChain* LPBUFFERCHAIN;
+
+/* Create a new empty chain. */
+extern LPBUFFERCHAIN buffer_chain_new(int32_t iSegmentSize = BUFFER_CHAIN_SEGMENT_SIZE);
+
+/* Free the chain and return its segments to the pool. */
+extern void buffer_chain_delete(LPBUFFERCHAIN chain);
+
+/* Drop all data of the chain. */
+extern void buffer_chain_reset(LPBUFFERCHAIN chain);
+
+/* Writes data at the end of the chain, adding segments when needed */
+extern void buffer_chain_write(LPBUFFERCHAIN chain, const void* src, int32_t iLength);
+
+/* Appends a filled buffer as a new segment, the chain takes ownership of it */
+extern void buffer_chain_append(LPBUFFERCHAIN chain, LPBUFFER buffer);
+
+/* Queues a shared buffer as a new segment without copying its data */
+extern void buffer_chain_append_shared(LPBUFFERCHAIN chain, LPBUFFER shared);
+
+/* Reads data from the start of the chain */
+extern bool buffer_chain_read(LPBUFFERCHAIN chain, void* buf, int32_t iBytes);
+
+/* Consumes data from the start of the chain, releasing drained segments */
+extern void buffer_chain_read_proceed(LPBUFFERCHAIN chain, int32_t iLength);
+
+/* Fills a scatter-gather array with the unread data of the chain */
+extern int32_t buffer_chain_get_iovec(LPBUFFERCHAIN chain, TBufferIOVec* pIOVec, int32_t iMaxCount);
+
+/* Sends as much of the chain as the socket accepts with one writev */
+extern int32_t buffer_chain_writev(LPBUFFERCHAIN chain, socket_t fd);
+
+/* Get the amount of unread data of the chain. */
+extern uint32_t buffer_chain_size(LPBUFFERCHAIN chain);
@@ -0,0 +1,455 @@
+#include "stdafx.h"
+#include "buffer_cipher.h"
+
+#if defined(CPU_X86_64)
+#include <immintrin.h>
+
+/* lets a function use AVX2 without building the whole file for it */
+#if defined(_MSC_VER)
+	#define BUFFER_CIPHER_TARGET_AVX2
+#else
+	#define BUFFER_CIPHER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+/* amount of ChaCha20 double rounds */
+#define BUFFER_CIPHER_DOUBLE_ROUNDS 10
+
+#define BUFFER_CIPHER_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define BUFFER_CIPHER_QUARTER_ROUND(a, b, c, d) \
+	a += b; d ^= a; d = BUFFER_CIPHER_ROTL(d, 16); \
+	c += d; b ^= c; b = BUFFER_CIPHER_ROTL(b, 12); \
+	a += b; d ^= a; d = BUFFER_CIPHER_ROTL(d, 8); \
+	c += d; b ^= c; b = BUFFER_CIPHER_ROTL(b, 7);
+
+/***
+ * buffer_cipher_keystream - Computes one keystream block.
+ * @state: The state, word 12 selects the block.
+ * @keystream: Receives BUFFER_CIPHER_BLOCK_SIZE bytes.
+ *
+ * Return: Nothing (void)
+ */
+static void buffer_cipher_keystream(const uint32_t* state, uint8_t* keystream)
+{
+	uint32_t x[16];
+	memcpy(x, state, sizeof(x));
+
+	for (int32_t i = 0; i < BUFFER_CIPHER_DOUBLE_ROUNDS; ++i)
+	{
+		BUFFER_CIPHER_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+		BUFFER_CIPHER_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+		BUFFER_CIPHER_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+		BUFFER_CIPHER_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+		BUFFER_CIPHER_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+		BUFFER_CIPHER_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+		BUFFER_CIPHER_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+		BUFFER_CIPHER_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+	}
+
+	for (int32_t i = 0; i < 16; ++i)
+	{
+		const uint32_t dwWord = x[i] + state[i];
+
+		keystream[4 * i + 0] = (uint8_t)(dwWord);
+		keystream[4 * i + 1] = (uint8_t)(dwWord >> 8);
+		keystream[4 * i + 2] = (uint8_t)(dwWord >> 16);
+		keystream[4 * i + 3] = (uint8_t)(dwWord >> 24);
+	}
+}
+
+/***
+ * buffer_cipher_blocks_portable - XORs whole blocks with the keystream, one block at a time.
+ * @state: The state, word 12 is advanced past the blocks.
+ * @data: The data, blocks * BUFFER_CIPHER_BLOCK_SIZE bytes.
+ * @blocks: The amount of blocks.
+ *
+ * Return: Nothing (void)
+ */
+static void buffer_cipher_blocks_portable(uint32_t* state, uint8_t* data, size_t blocks)
+{
+	uint8_t keystream[BUFFER_CIPHER_BLOCK_SIZE];
+
+	for (size_t i = 0; i < blocks; ++i)
+	{
+		buffer_cipher_keystream(state, keystream);
+		++state[12];
+
+		for (int32_t j = 0; j < BUFFER_CIPHER_BLOCK_SIZE; ++j)
+		{
+			data[j] ^= keystream[j];
+		}
+
+		data += BUFFER_CIPHER_BLOCK_SIZE;
+	}
+}
+
+#if defined(CPU_X86_64)
+/***
+ * The SIMD kernels compute several blocks at once: vector i holds word i of
+ * every block, so a quarter round is the same instructions on all of them.
+ * The words are transposed back to block order before being XORed in.
+ */
+#define BUFFER_CIPHER_SSE2_ROTL(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define BUFFER_CIPHER_SSE2_QUARTER_ROUND(a, b, c, d) \
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = BUFFER_CIPHER_SSE2_ROTL(d, 16); \
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = BUFFER_CIPHER_SSE2_ROTL(b, 12); \
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = BUFFER_CIPHER_SSE2_ROTL(d, 8); \
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = BUFFER_CIPHER_SSE2_ROTL(b, 7);
+
+/***
+ * buffer_cipher_transpose_sse2 - Transposes 4 vectors of 4 words.
+ * @x: The vectors, transposed in place.
+ *
+ * Return: Nothing (void)
+ */
+static inline void buffer_cipher_transpose_sse2(__m128i* x)
+{
+	const __m128i t0 = _mm_unpacklo_epi32(x[0], x[1]);
+	const __m128i t1 = _mm_unpacklo_epi32(x[2], x[3]);
+	const __m128i t2 = _mm_unpackhi_epi32(x[0], x[1]);
+	const __m128i t3 = _mm_unpackhi_epi32(x[2], x[3]);
+
+	x[0] = _mm_unpacklo_epi64(t0, t1);
+	x[1] = _mm_unpackhi_epi64(t0, t1);
+	x[2] = _mm_unpacklo_epi64(t2, t3);
+	x[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+/***
+ * buffer_cipher_blocks_sse2 - XORs whole blocks with the keystream, 4 blocks at a time.
+ * @state: The state, word 12 is advanced past the blocks.
+ * @data: The data, blocks * BUFFER_CIPHER_BLOCK_SIZE bytes.
+ * @blocks: The amount of blocks.
+ *
+ * Return: Nothing (void)
+ */
+static void buffer_cipher_blocks_sse2(uint32_t* state, uint8_t* data, size_t blocks)
+{
+	while (blocks >= 4)
+	{
+		__m128i x[16], input[16];
+
+		for (int32_t i = 0; i < 16; ++i)
+		{
+			input[i] = _mm_set1_epi32((int32_t)state[i]);
+		}
+
+		input[12] = _mm_add_epi32(input[12], _mm_set_epi32(3, 2, 1, 0));
+		memcpy(x, input, sizeof(x));
+
+		for (int32_t i = 0; i < BUFFER_CIPHER_DOUBLE_ROUNDS; ++i)
+		{
+			BUFFER_CIPHER_SSE2_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+			BUFFER_CIPHER_SSE2_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+			BUFFER_CIPHER_SSE2_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+			BUFFER_CIPHER_SSE2_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+			BUFFER_CIPHER_SSE2_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+			BUFFER_CIPHER_SSE2_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+			BUFFER_CIPHER_SSE2_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+			BUFFER_CIPHER_SSE2_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+		}
+
+		for (int32_t i = 0; i < 16; ++i)
+		{
+			x[i] = _mm_add_epi32(x[i], input[i]);
+		}
+
+		/* after transposing group g, x[4g + j] holds bytes 16g to 16g + 15 of block j */
+		for (int32_t g = 0; g < 4; ++g)
+		{
+			buffer_cipher_transpose_sse2(&x[4 * g]);
+		}
+
+		for (int32_t j = 0; j < 4; ++j)
+		{
+			for (int32_t g = 0; g < 4; ++g)
+			{
+				__m128i* p = (__m128i*)(data + BUFFER_CIPHER_BLOCK_SIZE * j + 16 * g);
+				_mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), x[4 * g + j]));
+			}
+		}
+
+		state[12] += 4;
+		data += 4 * BUFFER_CIPHER_BLOCK_SIZE;
+		blocks -= 4;
+	}
+
+	buffer_cipher_blocks_portable(state, data, blocks);
+}
+
+#define BUFFER_CIPHER_AVX2_ROTL(v, n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+
+#define BUFFER_CIPHER_AVX2_QUARTER_ROUND(a, b, c, d) \
+	a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); d = _mm256_shuffle_epi8(d, rot16); \
+	c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = BUFFER_CIPHER_AVX2_ROTL(b, 12); \
+	a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); d = _mm256_shuffle_epi8(d, rot8); \
+	c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = BUFFER_CIPHER_AVX2_ROTL(b, 7);
+
+/***
+ * buffer_cipher_transpose_avx2 - Transposes 4 vectors of 4 words, in each 128 bit lane.
+ * @x: The vectors, transposed in place.
+ *
+ * Return: Nothing (void)
+ */
+BUFFER_CIPHER_TARGET_AVX2 static inline void buffer_cipher_transpose_avx2(__m256i* x)
+{
+	const __m256i t0 = _mm256_unpacklo_epi32(x[0], x[1]);
+	const __m256i t1 = _mm256_unpacklo_epi32(x[2], x[3]);
+	const __m256i t2 = _mm256_unpackhi_epi32(x[0], x[1]);
+	const __m256i t3 = _mm256_unpackhi_epi32(x[2], x[3]);
+
+	x[0] = _mm256_unpacklo_epi64(t0, t1);
+	x[1] = _mm256_unpackhi_epi64(t0, t1);
+	x[2] = _mm256_unpacklo_epi64(t2, t3);
+	x[3] = _mm256_unpackhi_epi64(t2, t3);
+}
+
+/***
+ * buffer_cipher_xor_avx2 - XORs 32 bytes of data with a vector.
+ * @data: The data.
+ * @v: The keystream.
+ *
+ * Return: Nothing (void)
+ */
+BUFFER_CIPHER_TARGET_AVX2 static inline void buffer_cipher_xor_avx2(uint8_t* data, __m256i v)
+{
+	_mm256_storeu_si256((__m256i*)data, _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)data), v));
+}
+
+/***
+ * buffer_cipher_blocks_avx2 - XORs whole blocks with the keystream, 8 blocks at a time.
+ * @state: The state, word 12 is advanced past the blocks.
+ * @data: The data, blocks * BUFFER_CIPHER_BLOCK_SIZE bytes.
+ * @blocks: The amount of blocks.
+ *
+ * The rotations by 16 and 8 bits are byte shuffles.
+ *
+ * Return: Nothing (void)
+ */
+BUFFER_CIPHER_TARGET_AVX2 static void buffer_cipher_blocks_avx2(uint32_t* state, uint8_t* data, size_t blocks)
+{
+	const __m256i rot16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+		13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+	const __m256i rot8 = _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+		14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+
+	while (blocks >= 8)
+	{
+		__m256i x[16], input[16];
+
+		for (int32_t i = 0; i < 16; ++i)
+		{
+			input[i] = _mm256_set1_epi32((int32_t)state[i]);
+		}
+
+		/* blocks 0-3 in the low lanes, 4-7 in the high ones */
+		input[12] = _mm256_add_epi32(input[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+		memcpy(x, input, sizeof(x));
+
+		for (int32_t i = 0; i < BUFFER_CIPHER_DOUBLE_ROUNDS; ++i)
+		{
+			BUFFER_CIPHER_AVX2_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+			BUFFER_CIPHER_AVX2_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+			BUFFER_CIPHER_AVX2_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+			BUFFER_CIPHER_AVX2_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+			BUFFER_CIPHER_AVX2_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+			BUFFER_CIPHER_AVX2_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+			BUFFER_CIPHER_AVX2_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+			BUFFER_CIPHER_AVX2_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+		}
+
+		for (int32_t i = 0; i < 16; ++i)
+		{
+			x[i] = _mm256_add_epi32(x[i], input[i]);
+		}
+
+		for (int32_t g = 0; g < 4; ++g)
+		{
+			buffer_cipher_transpose_avx2(&x[4 * g]);
+		}
+
+		/* x[4g + j] holds bytes 16g to 16g + 15 of block j (low lane) and block j + 4 (high lane) */
+		for (int32_t j = 0; j < 4; ++j)
+		{
+			uint8_t* low = data + BUFFER_CIPHER_BLOCK_SIZE * j;
+			uint8_t* high = data + BUFFER_CIPHER_BLOCK_SIZE * (j + 4);
+
+			buffer_cipher_xor_avx2(low, _mm256_permute2x128_si256(x[j], x[4 + j], 0x20));
+			buffer_cipher_xor_avx2(low + 32, _mm256_permute2x128_si256(x[8 + j], x[12 + j], 0x20));
+			buffer_cipher_xor_avx2(high, _mm256_permute2x128_si256(x[j], x[4 + j], 0x31));
+			buffer_cipher_xor_avx2(high + 32, _mm256_permute2x128_si256(x[8 + j], x[12 + j], 0x31));
+		}
+
+		state[12] += 8;
+		data += 8 * BUFFER_CIPHER_BLOCK_SIZE;
+		blocks -= 8;
+	}
+
+	buffer_cipher_blocks_sse2(state, data, blocks);
+}
+#endif
+
+/***
+ * buffer_cipher_select_kernel - Picks the fastest kernel the CPU supports.
+ *
+ * Return: The kernel.
+ */
+static void (*buffer_cipher_select_kernel())(uint32_t*, uint8_t*, size_t)
+{
+#if defined(CPU_X86_64)
+	if (cpu_has_feature(CPU_FEATURE_AVX2))
+	{
+		return (buffer_cipher_blocks_avx2);
+	}
+
+	return (buffer_cipher_blocks_sse2);
+#else
+	return (buffer_cipher_blocks_portable);
+#endif
+}
+
+void (*buffer_cipher_blocks)(uint32_t* state, uint8_t* data, size_t blocks) = buffer_cipher_select_kernel();
+
+/***
+ * buffer_cipher_kernel_name - Gets the name of the kernel buffer_cipher_blocks points to.
+ *
+ * Return: "avx2", "sse2", "portable" or "custom".
+ */
+const char* buffer_cipher_kernel_name()
+{
+#if defined(CPU_X86_64)
+	if (buffer_cipher_blocks == buffer_cipher_blocks_avx2)
+	{
+		return ("avx2");
+	}
+
+	if (buffer_cipher_blocks == buffer_cipher_blocks_sse2)
+	{
+		return ("sse2");
+	}
+#endif
+
+	if (buffer_cipher_blocks == buffer_cipher_blocks_portable)
+	{
+		return ("portable");
+	}
+
+	return ("custom");
+}
+
+/***
+ * buffer_cipher_init - Initializes a cipher with a key and a nonce.
+ * @cipher: The cipher to initialize.
+ * @key: BUFFER_CIPHER_KEY_SIZE bytes, shared by both ends.
+ * @nonce: BUFFER_CIPHER_NONCE_SIZE bytes, never used twice with the same key.
+ * @dwCounter: The first block counter, normally 0.
+ *
+ * Return: Nothing (void)
+ */
+void buffer_cipher_init(TBufferCipher* cipher, const uint8_t* key, const uint8_t* nonce, uint32_t dwCounter)
+{
+	/* "expand 32-byte k" */
+	cipher->state[0] = 0x61707865;
+	cipher->state[1] = 0x3320646e;
+	cipher->state[2] = 0x79622d32;
+	cipher->state[3] = 0x6b206574;
+
+	for (int32_t i = 0; i < 8; ++i)
+	{
+		cipher->state[4 + i] = buffer_load_le32(key + 4 * i);
+	}
+
+	cipher->state[12] = dwCounter;
+
+	for (int32_t i = 0; i < 3; ++i)
+	{
+		cipher->state[13 + i] = buffer_load_le32(nonce + 4 * i);
+	}
+
+	cipher->keystream_used = BUFFER_CIPHER_BLOCK_SIZE;
+}
+
+/***
+ * buffer_cipher_xor - Encrypts or decrypts memory in place.
+ * @cipher: The cipher.
+ * @pData: The data.
+ * @iLength: The amount of data (in bytes).
+ *
+ * The rest of the last keystream block is used first, whole blocks go to
+ * the SIMD kernel, and the keystream of a last partial block is kept for
+ * the next call.
+ *
+ * Return: Nothing (void)
+ */
+void buffer_cipher_xor(TBufferCipher* cipher, void* pData, int32_t iLength)
+{
+	uint8_t* data = (uint8_t*)pData;
+
+	while (iLength > 0 && cipher->keystream_used < BUFFER_CIPHER_BLOCK_SIZE)
+	{
+		*data++ ^= cipher->keystream[cipher->keystream_used++];
+		--iLength;
+	}
+
+	const int32_t iBlocks = iLength / BUFFER_CIPHER_BLOCK_SIZE;
+
+	if (iBlocks > 0)
+	{
+		buffer_cipher_blocks(cipher->state, data, iBlocks);
+		data += iBlocks * BUFFER_CIPHER_BLOCK_SIZE;
+		iLength -= iBlocks * BUFFER_CIPHER_BLOCK_SIZE;
+	}
+
+	if (iLength > 0)
+	{
+		buffer_cipher_keystream(cipher->state, cipher->keystream);
+		++cipher->state[12];
+
+		for (int32_t i = 0; i < iLength; ++i)
+		{
+			data[i] ^= cipher->keystream[i];
+		}
+
+		cipher->keystream_used = iLength;
+	}
+}
+
+/***
+ * buffer_cipher_apply - Encrypts or decrypts the unread data of a buffer past an offset, in place.
+ * @cipher: The cipher.
+ * @buffer: The buffer.
+ * @iOffset: The amount of unread bytes already processed, they are skipped.
+ *
+ * E.g. an output buffer is encrypted before sending with the amount of
+ * bytes left unsent (and so already encrypted) by the previous send.
+ *
+ * Return: The amount of bytes processed.
+ */
+int32_t buffer_cipher_apply(TBufferCipher* cipher, LPBUFFER buffer, int32_t iOffset)
+{
+	const int32_t iLength = buffer->length - iOffset;
+
+	if (iLength <= 0)
+	{
+		return (0);
+	}
+
+	buffer_cipher_xor(cipher, (char*)buffer_read_peek(buffer) + iOffset, iLength);
+	return (iLength);
+}
+
+/***
+ * buffer_cipher_write_proceed - Encrypts or decrypts the bytes at the write point, then moves it past them.
+ * @cipher: The cipher.
+ * @buffer: The buffer.
+ * @iLength: The amount of bytes, e.g. received into buffer_write_peek.
+ *
+ * Return: Nothing (void)
+ */
+void buffer_cipher_write_proceed(TBufferCipher* cipher, LPBUFFER buffer, int32_t iLength)
+{
+	buffer_cipher_xor(cipher, buffer_write_peek(buffer), iLength);
+	buffer_write_proceed(buffer, iLength);
+}
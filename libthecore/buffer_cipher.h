@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/* size of a cipher key (in bytes) */
+#define BUFFER_CIPHER_KEY_SIZE 32
+
+/* size of a cipher nonce (in bytes) */
+#define BUFFER_CIPHER_NONCE_SIZE 12
+
+/* size of a keystream block (in bytes) */
+#define BUFFER_CIPHER_BLOCK_SIZE 64
+
+/***
+ * TBufferCipher - the state of one direction of an encrypted connection.
+ * The cipher is ChaCha20 (RFC 8439): the data is XORed with a keystream, so
+ * encryption and decryption are the same operation and work in place. The
+ * unused part of the last keystream block is kept, so data can be processed
+ * in pieces of any size, e.g. as partial packets arrive, and gives the same
+ * result as processing it at once. A key and nonce pair must never be used
+ * twice, and can process at most 256 GB.
+ */
+typedef struct SBufferCipher
+{
+	/* The ChaCha20 state, word 12 is the block counter */
+	uint32_t state[16];
+
+	/* The last keystream block */
+	uint8_t keystream[BUFFER_CIPHER_BLOCK_SIZE];
+
+	/* The amount of bytes of keystream already used */
+	int32_t keystream_used;
+} TBufferCipher;
+
+/***
+ * buffer_cipher_blocks - XORs whole blocks with the keystream and advances the counter.
+ * Points to the fastest kernel the CPU supports (AVX2, SSE2 or portable), it
+ * can be replaced, e.g. to compare kernels.
+ */
+extern void (*buffer_cipher_blocks)(uint32_t* state, uint8_t* data, size_t blocks);
+
+/* Gets the name of the kernel buffer_cipher_blocks points to */
+extern const char* buffer_cipher_kernel_name();
+
+/* Initializes a cipher with a key and a nonce */
+extern void buffer_cipher_init(TBufferCipher* cipher, const uint8_t* key, const uint8_t* nonce, uint32_t dwCounter = 0);
+
+/* Encrypts or decrypts memory in place */
+extern void buffer_cipher_xor(TBufferCipher* cipher, void* pData, int32_t iLength);
+
+/* Encrypts or decrypts the unread data of a buffer past an offset, in place */
+extern int32_t buffer_cipher_apply(TBufferCipher* cipher, LPBUFFER buffer, int32_t iOffset);
+
+/* Encrypts or decrypts the bytes at the write point, then moves it past them */
+extern void buffer_cipher_write_proceed(TBufferCipher* cipher, LPBUFFER buffer, int32_t iLength);
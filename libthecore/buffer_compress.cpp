@@ -0,0 +1,482 @@
+#include "stdafx.h"
+#include "buffer_compress.h"
+
+/***
+ * The block format follows LZ4: a block is a list of sequences, each made of
+ * a token (literal length in the high nibble, match length - 4 in the low one,
+ * 15 meaning more length bytes follow, each adding up to 255), the literals,
+ * and a 2 byte little endian offset back to the match. The last sequence only
+ * has literals, it is recognized by ending the block.
+ */
+
+/* shortest match worth encoding */
+#define BUFFER_LZ_MIN_MATCH 4
+
+/* the hash table has 2^BUFFER_LZ_HASH_BITS positions */
+#define BUFFER_LZ_HASH_BITS 12
+
+/* farthest a match can be */
+#define BUFFER_LZ_MAX_OFFSET 0xFFFF
+
+/* the last bytes of a block are always literals */
+#define BUFFER_LZ_LAST_LITERALS 5
+
+/* no match starts in the last bytes of a block */
+#define BUFFER_LZ_MATCH_LIMIT 12
+
+/***
+ * buffer_lz_hash - Hashes the 4 bytes at a position.
+ * @uSequence: The 4 bytes.
+ *
+ * Return: The index in the hash table.
+ */
+static inline uint32_t buffer_lz_hash(uint32_t uSequence)
+{
+	return ((uSequence * 2654435761u) >> (32 - BUFFER_LZ_HASH_BITS));
+}
+
+/***
+ * buffer_lz_write_length - Writes the length bytes following a token nibble of 15.
+ * @dst: Where to write.
+ * @iLength: The length minus 15.
+ *
+ * Return: The end of the written bytes.
+ */
+static inline uint8_t* buffer_lz_write_length(uint8_t* dst, int32_t iLength)
+{
+	while (iLength >= 255)
+	{
+		*dst++ = 255;
+		iLength -= 255;
+	}
+
+	*dst++ = (uint8_t)iLength;
+	return (dst);
+}
+
+/***
+ * buffer_lz_read_length - Reads the length bytes following a token nibble of 15.
+ * @src: The position to read from, moved past the length bytes.
+ * @end: The end of the block.
+ * @piLength: The length to add to.
+ *
+ * Return: true on success, false if the block ends inside the length.
+ */
+static inline bool buffer_lz_read_length(const uint8_t*& src, const uint8_t* end, int32_t* piLength)
+{
+	uint8_t bByte;
+
+	do
+	{
+		if (src >= end || *piLength > BUFFER_COMPRESS_MAX_FRAME)
+		{
+			return (false);
+		}
+
+		bByte = *src++;
+		*piLength += bByte;
+	} while (bByte == 255);
+
+	return (true);
+}
+
+/***
+ * buffer_lz_emit - Writes one sequence.
+ * @dst: Where to write, moved past the sequence.
+ * @end: The end of the output.
+ * @literals: The literals of the sequence.
+ * @iLiterals: The amount of literals.
+ * @iOffset: The distance back to the match, unused if iMatch is 0.
+ * @iMatch: The length of the match, 0 for the last sequence.
+ *
+ * Return: true on success, false if the output is too small.
+ */
+static inline bool buffer_lz_emit(uint8_t*& dst, const uint8_t* end, const uint8_t* literals, int32_t iLiterals, int32_t iOffset, int32_t iMatch)
+{
+	/* token, length bytes, literals and offset */
+	if (end - dst < 1 + (iLiterals / 255 + 1) + iLiterals + 2 + (iMatch / 255 + 1))
+	{
+		return (false);
+	}
+
+	uint8_t* token = dst++;
+	const int32_t iMatchCode = iMatch ? iMatch - BUFFER_LZ_MIN_MATCH : 0;
+
+	*token = (uint8_t)((std::min<int32_t>(iLiterals, 15) << 4) | std::min<int32_t>(iMatchCode, 15));
+
+	if (iLiterals >= 15)
+	{
+		dst = buffer_lz_write_length(dst, iLiterals - 15);
+	}
+
+	memcpy(dst, literals, iLiterals);
+	dst += iLiterals;
+
+	if (iMatch)
+	{
+		*dst++ = (uint8_t)(iOffset & 0xFF);
+		*dst++ = (uint8_t)(iOffset >> 8);
+
+		if (iMatchCode >= 15)
+		{
+			dst = buffer_lz_write_length(dst, iMatchCode - 15);
+		}
+	}
+
+	return (true);
+}
+
+/***
+ * buffer_lz_bound - Gets the most bytes buffer_lz_compress can produce.
+ * @iLength: The amount of bytes to compress.
+ *
+ * Return: The size of an output that can't be too small.
+ */
+int32_t buffer_lz_bound(int32_t iLength)
+{
+	return (iLength + iLength / 255 + 16);
+}
+
+/***
+ * buffer_lz_compress - Compresses a block of memory.
+ * @src: The data to compress.
+ * @iLength: The amount of data (in bytes).
+ * @dst: Where to write the block.
+ * @iCapacity: The size of dst.
+ *
+ * A greedy single pass: the 4 bytes at each position are looked up in a hash
+ * table of recent positions, and a match is extended as far as it goes.
+ * Positions are skipped faster the longer no match is found, so data that
+ * does not compress is passed over quickly.
+ *
+ * Return: The size of the block, or 0 if it does not fit in iCapacity.
+ */
+int32_t buffer_lz_compress(const uint8_t* src, int32_t iLength, uint8_t* dst, int32_t iCapacity)
+{
+	int32_t aiTable[1 << BUFFER_LZ_HASH_BITS];
+	uint8_t* op = dst;
+	const uint8_t* op_end = dst + iCapacity;
+	int32_t iAnchor = 0;
+
+	if (iLength >= BUFFER_LZ_MATCH_LIMIT)
+	{
+		const int32_t iLimit = iLength - BUFFER_LZ_MATCH_LIMIT;
+		const int32_t iMatchLimit = iLength - BUFFER_LZ_LAST_LITERALS;
+		int32_t iPos = 0;
+
+		memset(aiTable, 0xFF, sizeof(aiTable));
+
+		while (iPos <= iLimit)
+		{
+			uint32_t uSequence;
+			memcpy(&uSequence, src + iPos, sizeof(uSequence));
+
+			const uint32_t uHash = buffer_lz_hash(uSequence);
+			int32_t iRef = aiTable[uHash];
+			aiTable[uHash] = iPos;
+
+			uint32_t uRefSequence = 0;
+			if (iRef >= 0)
+			{
+				memcpy(&uRefSequence, src + iRef, sizeof(uRefSequence));
+			}
+
+			if (iRef < 0 || iPos - iRef > BUFFER_LZ_MAX_OFFSET || uRefSequence != uSequence)
+			{
+				iPos += 1 + ((iPos - iAnchor) >> 6);
+				continue;
+			}
+
+			int32_t iEnd = iPos + BUFFER_LZ_MIN_MATCH;
+			while (iEnd < iMatchLimit && src[iEnd] == src[iRef + (iEnd - iPos)])
+			{
+				++iEnd;
+			}
+
+			/* extend the match backwards over literals that match too */
+			while (iPos > iAnchor && iRef > 0 && src[iPos - 1] == src[iRef - 1])
+			{
+				--iPos;
+				--iRef;
+			}
+
+			if (!buffer_lz_emit(op, op_end, src + iAnchor, iPos - iAnchor, iPos - iRef, iEnd - iPos))
+			{
+				return (0);
+			}
+
+			iPos = iAnchor = iEnd;
+		}
+	}
+
+	if (!buffer_lz_emit(op, op_end, src + iAnchor, iLength - iAnchor, 0, 0))
+	{
+		return (0);
+	}
+
+	return ((int32_t)(op - dst));
+}
+
+/***
+ * buffer_lz_decompress - Decompresses a block made by buffer_lz_compress.
+ * @src: The block.
+ * @iLength: The size of the block.
+ * @dst: Where to write the data.
+ * @iCapacity: The size of dst.
+ *
+ * Every length and offset is checked, a malformed block can't read or
+ * write out of bounds.
+ *
+ * Return: The amount of bytes written, or -1 if the block is malformed or does not fit.
+ */
+int32_t buffer_lz_decompress(const uint8_t* src, int32_t iLength, uint8_t* dst, int32_t iCapacity)
+{
+	const uint8_t* ip = src;
+	const uint8_t* ip_end = src + iLength;
+	uint8_t* op = dst;
+	uint8_t* op_end = dst + iCapacity;
+
+	while (ip < ip_end)
+	{
+		const uint8_t bToken = *ip++;
+		int32_t iLiterals = bToken >> 4;
+
+		if (iLiterals == 15 && !buffer_lz_read_length(ip, ip_end, &iLiterals))
+		{
+			return (-1);
+		}
+
+		if (iLiterals > ip_end - ip || iLiterals > op_end - op)
+		{
+			return (-1);
+		}
+
+		memcpy(op, ip, iLiterals);
+		ip += iLiterals;
+		op += iLiterals;
+
+		/* the last sequence has no match */
+		if (ip == ip_end)
+		{
+			break;
+		}
+
+		if (ip_end - ip < 2)
+		{
+			return (-1);
+		}
+
+		const int32_t iOffset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		if (iOffset == 0 || iOffset > op - dst)
+		{
+			return (-1);
+		}
+
+		int32_t iMatch = bToken & 15;
+
+		if (iMatch == 15 && !buffer_lz_read_length(ip, ip_end, &iMatch))
+		{
+			return (-1);
+		}
+
+		iMatch += BUFFER_LZ_MIN_MATCH;
+
+		if (iMatch > op_end - op)
+		{
+			return (-1);
+		}
+
+		const uint8_t* match = op - iOffset;
+
+		if (iOffset >= iMatch)
+		{
+			memcpy(op, match, iMatch);
+			op += iMatch;
+		}
+		else
+		{
+			/* the match overlaps what it writes, e.g. a run of one byte */
+			for (int32_t i = 0; i < iMatch; ++i)
+			{
+				*op++ = *match++;
+			}
+		}
+	}
+
+	return ((int32_t)(op - dst));
+}
+
+/***
+ * buffer_compress_write_header - Writes a frame header.
+ * @dst: Where to write, BUFFER_COMPRESS_HEADER_SIZE bytes.
+ * @bType: The frame type.
+ * @iSize: The payload size.
+ * @iOriginal: The decoded size.
+ *
+ * Return: Nothing (void)
+ */
+static void buffer_compress_write_header(uint8_t* dst, uint8_t bType, int32_t iSize, int32_t iOriginal)
+{
+	dst[0] = bType;
+
+	for (int32_t i = 0; i < 4; ++i)
+	{
+		dst[1 + i] = (uint8_t)((uint32_t)iSize >> (8 * i));
+		dst[5 + i] = (uint8_t)((uint32_t)iOriginal >> (8 * i));
+	}
+}
+
+/***
+ * buffer_compress_init - Initializes the compression state of a connection.
+ * @compress: The state to initialize.
+ * @iThreshold: Flushes smaller than this are sent uncompressed.
+ *
+ * The compression starts disabled.
+ *
+ * Return: Nothing (void)
+ */
+void buffer_compress_init(TBufferCompress* compress, int32_t iThreshold)
+{
+	memset(compress, 0, sizeof(TBufferCompress));
+	compress->threshold = iThreshold;
+}
+
+/***
+ * buffer_compress_set_enabled - Turns the compression of a connection on or off.
+ * @compress: The state of the connection.
+ * @bEnabled: Whether the output is framed and compressed.
+ *
+ * Must be switched at a point both ends agree on, between two flushes.
+ *
+ * Return: Nothing (void)
+ */
+void buffer_compress_set_enabled(TBufferCompress* compress, bool bEnabled)
+{
+	compress->enabled = bEnabled;
+}
+
+/***
+ * buffer_compress_output - Turns the unread data of an output buffer into a frame.
+ * @compress: The state of the connection.
+ * @buffer: The output buffer, replaced by the framed one.
+ *
+ * Called once per flush, before sending. The frame is built in a pooled
+ * scratch buffer which then takes the place of the output buffer, the old one
+ * returns to the pool. Data under the threshold, or that does not get smaller,
+ * is framed uncompressed. Nothing is done when the compression is disabled.
+ *
+ * Return: Nothing (void)
+ */
+void buffer_compress_output(TBufferCompress* compress, LPBUFFER& buffer)
+{
+	const int32_t iLength = buffer->length;
+
+	if (!compress->enabled || iLength == 0)
+	{
+		return;
+	}
+
+	LPBUFFER scratch = buffer_new(BUFFER_COMPRESS_HEADER_SIZE + buffer_lz_bound(iLength));
+	uint8_t* pFrame = (uint8_t*)buffer_write_peek(scratch);
+	const uint8_t* pData = (const uint8_t*)buffer_read_peek(buffer);
+	int32_t iSize = 0;
+
+	if (iLength >= compress->threshold)
+	{
+		/* only worth it if the frame gets smaller */
+		iSize = buffer_lz_compress(pData, iLength, pFrame + BUFFER_COMPRESS_HEADER_SIZE, iLength - 1);
+	}
+
+	if (iSize > 0)
+	{
+		buffer_compress_write_header(pFrame, BUFFER_COMPRESS_FRAME_LZ, iSize, iLength);
+		++compress->compressed_frames;
+	}
+	else
+	{
+		iSize = iLength;
+		buffer_compress_write_header(pFrame, BUFFER_COMPRESS_FRAME_RAW, iSize, iLength);
+		thecore_memcpy(pFrame + BUFFER_COMPRESS_HEADER_SIZE, pData, iLength);
+		++compress->raw_frames;
+	}
+
+	buffer_write_proceed(scratch, BUFFER_COMPRESS_HEADER_SIZE + iSize);
+
+	compress->raw_bytes += iLength;
+	compress->wire_bytes += BUFFER_COMPRESS_HEADER_SIZE + iSize;
+
+	buffer_delete(buffer);
+	buffer = scratch;
+}
+
+/***
+ * buffer_decompress_input - Decodes the complete frames of an input buffer.
+ * @compress: The state of the connection.
+ * @input: The received data, the decoded frames are consumed from it.
+ * @output: Receives the decoded data, it grows when needed.
+ *
+ * A frame cut at the end of the input stays there for the next call. When
+ * the compression is disabled the input is moved to the output as is.
+ *
+ * Return: The amount of bytes written to output, or -1 if a frame is
+ * malformed (the connection should be closed).
+ */
+int32_t buffer_decompress_input(TBufferCompress* compress, LPBUFFER input, LPBUFFER& output)
+{
+	int32_t iWritten = 0;
+
+	if (!compress->enabled)
+	{
+		iWritten = input->length;
+		buffer_write(output, buffer_read_peek(input), iWritten);
+		buffer_read_proceed(input, iWritten);
+		return (iWritten);
+	}
+
+	while (input->length >= BUFFER_COMPRESS_HEADER_SIZE)
+	{
+		const uint8_t* pFrame = (const uint8_t*)buffer_read_peek(input);
+		const uint8_t bType = pFrame[0];
+		const uint32_t dwSize = buffer_load_le32(pFrame + 1);
+		const uint32_t dwOriginal = buffer_load_le32(pFrame + 5);
+
+		if (bType > BUFFER_COMPRESS_FRAME_LZ || dwSize > BUFFER_COMPRESS_MAX_FRAME || dwOriginal > BUFFER_COMPRESS_MAX_FRAME ||
+			(bType == BUFFER_COMPRESS_FRAME_RAW && dwSize != dwOriginal))
+		{
+			sys_err("buffer_decompress_input: malformed frame header [Type: %u] [Size: %u] [Original: %u]", bType, dwSize, dwOriginal);
+			return (-1);
+		}
+
+		/* wait for the rest of the frame */
+		if (input->length < BUFFER_COMPRESS_HEADER_SIZE + (int32_t)dwSize)
+		{
+			break;
+		}
+
+		const uint8_t* pPayload = pFrame + BUFFER_COMPRESS_HEADER_SIZE;
+
+		if (bType == BUFFER_COMPRESS_FRAME_RAW)
+		{
+			buffer_write(output, pPayload, dwSize);
+		}
+		else
+		{
+			buffer_adjust_size(output, dwOriginal);
+
+			if (buffer_lz_decompress(pPayload, dwSize, (uint8_t*)buffer_write_peek(output), dwOriginal) != (int32_t)dwOriginal)
+			{
+				sys_err("buffer_decompress_input: malformed compressed frame [Size: %u] [Original: %u]", dwSize, dwOriginal);
+				return (-1);
+			}
+
+			buffer_write_proceed(output, dwOriginal);
+		}
+
+		iWritten += dwOriginal;
+		buffer_read_proceed(input, BUFFER_COMPRESS_HEADER_SIZE + dwSize);
+	}
+
+	return (iWritten);
+}
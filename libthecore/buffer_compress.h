@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+
+/* flushes smaller than this are sent uncompressed */
+#define BUFFER_COMPRESS_THRESHOLD 256
+
+/* largest frame a peer may send, bounds what a malformed frame can make us allocate */
+#define BUFFER_COMPRESS_MAX_FRAME (16 * 1024 * 1024)
+
+/* size of the header in front of every frame */
+#define BUFFER_COMPRESS_HEADER_SIZE 9
+
+/***
+ * Frame header, BUFFER_COMPRESS_HEADER_SIZE bytes, little endian:
+ *	uint8_t  type      - BUFFER_COMPRESS_FRAME_RAW or BUFFER_COMPRESS_FRAME_LZ
+ *	uint32_t size      - the amount of payload bytes following the header
+ *	uint32_t original  - the amount of bytes the payload decodes to
+ */
+enum EBufferCompressFrame
+{
+	BUFFER_COMPRESS_FRAME_RAW,
+	BUFFER_COMPRESS_FRAME_LZ,
+};
+
+/***
+ * TBufferCompress - the compression state of one connection. When enabled,
+ * every flush of the output buffer is sent as one frame, compressed if it is
+ * at least threshold bytes and compression makes it smaller. Both ends of a
+ * connection must agree on enabled, e.g. through a login packet.
+ */
+typedef struct SBufferCompress
+{
+	/* Whether the output is framed and compressed */
+	bool enabled;
+
+	/* Flushes smaller than this are sent uncompressed */
+	int32_t threshold;
+
+	/* The amount of bytes given to buffer_compress_output */
+	int64_t raw_bytes;
+
+	/* The amount of bytes buffer_compress_output produced, headers included */
+	int64_t wire_bytes;
+
+	/* The amount of frames sent compressed */
+	int64_t compressed_frames;
+
+	/* The amount of frames sent uncompressed */
+	int64_t raw_frames;
+} TBufferCompress;
+
+/* Gets the most bytes buffer_lz_compress can produce for iLength bytes */
+extern int32_t buffer_lz_bound(int32_t iLength);
+
+/* Compresses a block of memory */
+extern int32_t buffer_lz_compress(const uint8_t* src, int32_t iLength, uint8_t* dst, int32_t iCapacity);
+
+/* Decompresses a block made by buffer_lz_compress */
+extern int32_t buffer_lz_decompress(const uint8_t* src, int32_t iLength, uint8_t* dst, int32_t iCapacity);
+
+/* Initializes the compression state of a connection, disabled */
+extern void buffer_compress_init(TBufferCompress* compress, int32_t iThreshold = BUFFER_COMPRESS_THRESHOLD);
+
+/* Turns the compression of a connection on or off */
+extern void buffer_compress_set_enabled(TBufferCompress* compress, bool bEnabled);
+
+/* Turns the unread data of an output buffer into a frame, ready to be sent */
+extern void buffer_compress_output(TBufferCompress* compress, LPBUFFER& buffer);
+
+/* Decodes the complete frames of an input buffer */
+extern int32_t buffer_decompress_input(TBufferCompress* compress, LPBUFFER input, LPBUFFER& output);
@@ -6,13 +6,16 @@
  * @iSize: Initial size of the buffer
  * @bForceDelete: Boolean flag indicating whether the buffer size should be forced to a minimum
  *
- * This constructor initializes the CTempBuffer object. If the bForceDelete flag is set to true,
- * it ensures that the buffer size is at least 128KB by using the std::max function. The buffer
- * is then created using the buffer_new function, with the final size passed as an argument.
+ * This constructor initializes the CTempBuffer object. Sizes up to TEMP_BUFFER_INLINE_SIZE
+ * use the storage inside the object, so assembling a small packet never touches the pool,
+ * the data moves to a pooled buffer of at least TEMP_BUFFER_SPILL_SIZE (the default capacity
+ * before the inline storage existed) only if it outgrows it. If the bForceDelete flag is set
+ * to true, it ensures that the buffer size is at least 128KB by using the std::max function,
+ * and the buffer is then created using the buffer_new function.
  * 
  * Return: Nothing (Constructor)
  */
-CTempBuffer::CTempBuffer(int32_t iSize, bool bForceDelete)
+CTempBuffer::CTempBuffer(int32_t iSize, bool bForceDelete) : m_tInline()
 {
 	m_bForceDelete = bForceDelete;
 
@@ -21,21 +24,133 @@ CTempBuffer::CTempBuffer(int32_t iSize, bool bForceDelete)
 		iSize = std::max<int32_t>(iSize, 128 * 1024);
 	}
 
-	m_bBuffer = buffer_new(iSize);
+	if (iSize <= TEMP_BUFFER_INLINE_SIZE)
+	{
+		InitInline();
+	}
+	else
+	{
+		m_bBuffer = buffer_new(iSize);
+	}
 }
 
 /***
  * CTempBuffer::~CTempBuffer - Destructor for the CTempBuffer class
  *
  * This destructor is responsible for cleaning up the memory allocated for the buffer.
- * It calls buffer_delete to free the buffer, and logs a message indicating that the
- * buffer has been deleted.
+ * It calls buffer_delete to return a pooled buffer, the inline storage needs nothing.
  *
  * Return: Nothing (Destructor)
  */
 CTempBuffer::~CTempBuffer()
 {
-	buffer_delete(m_bBuffer);
+	if (!IsInline())
+	{
+		buffer_delete(m_bBuffer);
+	}
+}
+
+/***
+ * CTempBuffer::CTempBuffer - Move constructor
+ * @rOther: The CTempBuffer to take the buffer from, it is left empty
+ *
+ * A pooled buffer is taken over by pointer, inline data (at most
+ * TEMP_BUFFER_INLINE_SIZE bytes) is copied.
+ *
+ * Return: Nothing (Constructor)
+ */
+CTempBuffer::CTempBuffer(CTempBuffer&& rOther) noexcept : m_tInline()
+{
+	MoveFrom(rOther);
+}
+
+/***
+ * CTempBuffer::operator= - Move assignment
+ * @rOther: The CTempBuffer to take the buffer from, it is left empty
+ *
+ * Return: This CTempBuffer.
+ */
+CTempBuffer& CTempBuffer::operator=(CTempBuffer&& rOther) noexcept
+{
+	if (this != &rOther)
+	{
+		if (!IsInline())
+		{
+			buffer_delete(m_bBuffer);
+		}
+
+		MoveFrom(rOther);
+	}
+
+	return (*this);
+}
+
+/***
+ * CTempBuffer::InitInline - Points the buffer at the inline storage
+ *
+ * Return: Nothing (void)
+ */
+void CTempBuffer::InitInline()
+{
+	m_tInline.mem_data = m_acInline;
+	m_tInline.mem_size = TEMP_BUFFER_INLINE_SIZE;
+	buffer_reset(&m_tInline);
+	m_bBuffer = &m_tInline;
+}
+
+/***
+ * CTempBuffer::Spill - Moves the data from the inline storage to a pooled buffer
+ * @iLength: Length of the data about to be written
+ *
+ * Return: Nothing (void)
+ */
+void CTempBuffer::Spill(int32_t iLength)
+{
+	LPBUFFER buffer = buffer_new(std::max<int32_t>(m_tInline.length + iLength, TEMP_BUFFER_SPILL_SIZE));
+
+	thecore_memcpy(buffer_write_peek(buffer), m_tInline.read_point, m_tInline.length);
+	buffer_write_proceed(buffer, m_tInline.length);
+
+	buffer_reset(&m_tInline);
+	m_bBuffer = buffer;
+}
+
+/***
+ * CTempBuffer::Compact - Moves the unread inline data to the front of the inline storage
+ *
+ * Return: Nothing (void)
+ */
+void CTempBuffer::Compact()
+{
+	const int32_t iLength = m_tInline.length;
+
+	memmove(m_acInline, m_tInline.read_point, iLength);
+	buffer_reset(&m_tInline);
+	buffer_write_proceed(&m_tInline, iLength);
+}
+
+/***
+ * CTempBuffer::MoveFrom - Takes over the buffer of another CTempBuffer
+ * @rOther: The CTempBuffer to take the buffer from, it is left empty and inline
+ *
+ * Return: Nothing (void)
+ */
+void CTempBuffer::MoveFrom(CTempBuffer& rOther)
+{
+	m_bForceDelete = rOther.m_bForceDelete;
+
+	if (rOther.IsInline())
+	{
+		InitInline();
+		thecore_memcpy(m_acInline, rOther.m_tInline.read_point, rOther.m_tInline.length);
+		buffer_write_proceed(&m_tInline, rOther.m_tInline.length);
+	}
+	else
+	{
+		m_bBuffer = rOther.m_bBuffer;
+	}
+
+	rOther.InitInline();
 }
 
 /***
@@ -44,13 +159,27 @@ CTempBuffer::~CTempBuffer()
  * @iLength: Length of the data to be written
  *
  * This function writes a specified length of data from the provided pointer
- * to the internal buffer using the buffer_write function.
+ * to the internal buffer using the buffer_write function. Data that doesn't
+ * fit after the write point of the inline storage is moved to its front, or
+ * to a pooled buffer if it outgrows it.
  * 
  * Return: Nothing (void)
  */
 void CTempBuffer::Write(const void* pData, int32_t iLength)
 {
-	sys_log(0, "CTempBuffer::Write Called void* Function");
+	/* buffer_write must never compact nor reallocate the inline storage, it would hand it to the pool */
+	if (IsInline() && m_tInline.write_point_pos + iLength > m_tInline.mem_size)
+	{
+		if (m_tInline.length + iLength <= m_tInline.mem_size)
+		{
+			Compact();
+		}
+		else
+		{
+			Spill(iLength);
+		}
+	}
+
 	buffer_write(m_bBuffer, pData, iLength);
 }
 
@@ -72,15 +201,13 @@ const void* CTempBuffer::ReadPeek()
  * @pData: Pointer to the memory where the read data will be stored
  * @iSize: Number of bytes to read from the buffer
  *
- * This function logs the call to the Read function and reads a specified
- * number of bytes from the buffer into the provided memory location
- * using the buffer_read function.
+ * This function reads a specified number of bytes from the buffer into the
+ * provided memory location using the buffer_read function.
  *
  * Return: Nothing (void).
  */
 void CTempBuffer::Read(void* pData, int32_t iSize)
 {
-	sys_log(0, "CTempBuffer::Read Called void* Function");
 	buffer_read(m_bBuffer, pData, iSize);
 }
 
@@ -89,7 +216,9 @@ void CTempBuffer::Read(void* pData, int32_t iSize)
  *
  * This function returns a pointer to the buffer managed by the
  * CTempBuffer object. This function is marked as const, ensuring that it
- * does not modify the state of the object.
+ * does not modify the state of the object. The buffer may be the inline
+ * storage, so it must not be deleted nor reallocated, use Release to take
+ * ownership of the data.
  *
  * Return: A pointer to the buffer (LPBUFFER).
  */
@@ -98,6 +227,27 @@ LPBUFFER CTempBuffer::GetBuffer() const
 	return (m_bBuffer);
 }
 
+/***
+ * CTempBuffer::Release - Gives the written data away as a pooled buffer
+ *
+ * Used to hand an assembled packet over, e.g. to buffer_chain_append. A pooled
+ * buffer is given as is, inline data is copied to a pooled buffer of its size.
+ * The CTempBuffer is left empty and can be reused.
+ *
+ * Return: A pooled buffer owned by the caller.
+ */
+LPBUFFER CTempBuffer::Release()
+{
+	if (IsInline())
+	{
+		Spill(0);
+	}
+
+	LPBUFFER buffer = m_bBuffer;
+	InitInline();
+	return (buffer);
+}
+
 /***
  * CTempBuffer::GetSize - Gets the size of the buffer
  *
@@ -124,4 +274,4 @@ uint32_t CTempBuffer::GetSize()
 void CTempBuffer::Reset()
 {
 	buffer_reset(m_bBuffer);
-}
\ No newline at end of file
+}
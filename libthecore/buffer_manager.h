@@ -2,24 +2,55 @@
 
 #include "stdafx.h"
 
+/* packets up to this size are assembled inside the CTempBuffer itself, without touching the pool */
+#define TEMP_BUFFER_INLINE_SIZE 256
+
+/* a packet outgrowing the inline storage moves to a pooled buffer of at least this size, the old default capacity */
+#define TEMP_BUFFER_SPILL_SIZE 8192
+
 class CTempBuffer
 {
 public:
 	/* Constructor for the CTempBuffer class */
-	CTempBuffer(int32_t iSize = 8192, bool bForceDelete = false);
+	CTempBuffer(int32_t iSize = TEMP_BUFFER_INLINE_SIZE, bool bForceDelete = false);
 
 	/* Destructor for the CTempBuffer class */
 	~CTempBuffer();
 
+	/* Move constructor, takes over the buffer of another CTempBuffer */
+	CTempBuffer(CTempBuffer&& rOther) noexcept;
+
+	/* Move assignment, takes over the buffer of another CTempBuffer */
+	CTempBuffer& operator=(CTempBuffer&& rOther) noexcept;
+
+	/* A CTempBuffer owns its buffer, it can be moved but not copied */
+	CTempBuffer(const CTempBuffer&) = delete;
+	CTempBuffer& operator=(const CTempBuffer&) = delete;
+
 	/* Writes data to the buffer */
 	void Write(const void* pData, int32_t iLength);
 
-	/* Writes data to the buffer */
-	template <typename T>
+	/* Writes an object to the buffer, pointers go to the overload above */
+	template <typename T, typename = typename std::enable_if<!std::is_pointer<T>::value>::type>
 	void Write(const T& pData, int32_t iLength)
 	{
-		sys_log(0, "CTempBuffer::Write Used Template& Function");
-		buffer_write(m_bBuffer, &pData, iLength);
+		Write(static_cast<const void*>(&pData), iLength);
+	}
+
+	/* Writes an object whose size is known at compile time, the copy is inlined */
+	template <typename T>
+	void Write(const T& object)
+	{
+		static_assert(std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value, "CTempBuffer::Write: T must be trivially copyable and not a pointer");
+
+		/* the inline storage and pooled buffers alike take it in place when it fits */
+		if (m_bBuffer->write_point_pos + (int32_t)sizeof(T) > m_bBuffer->mem_size)
+		{
+			Write(static_cast<const void*>(&object), (int32_t)sizeof(T));
+			return;
+		}
+
+		buffer_write_object(m_bBuffer, object);
 	}
 
 	/* Peeks at the data in the buffer without removing it */
@@ -28,17 +59,26 @@ public:
 	/* Reads data from the buffer */
 	void Read(void* pData, int32_t iSize);
 
-	/* Reads data from the buffer */
-	template <typename T>
+	/* Reads an object from the buffer, pointers go to the overload above */
+	template <typename T, typename = typename std::enable_if<!std::is_pointer<T>::value>::type>
 	void Read(T& pData, int32_t iSize)
 	{
-		sys_log(0, "CTempBuffer::Read Used Template& Function")
-			buffer_read(m_bBuffer, &pData, iSize);
+		Read(static_cast<void*>(&pData), iSize);
+	}
+
+	/* Reads an object whose size is known at compile time, the copy is inlined */
+	template <typename T>
+	void Read(T& object)
+	{
+		buffer_read_object(m_bBuffer, object);
 	}
 
 	/* Returns a Pointer to the buffer */
 	LPBUFFER GetBuffer() const;
 
+	/* Gives the written data away as a pooled buffer, leaving this one empty */
+	LPBUFFER Release();
+
 	/* Gets the size of the buffer */
 	uint32_t GetSize();
 
@@ -46,10 +86,30 @@ public:
 	void Reset();
 
 private:
+	/* Points the buffer at the inline storage */
+	void InitInline();
 
-	/* a pointer to the buffer of the class */
+	/* Moves the data from the inline storage to a pooled buffer */
+	void Spill(int32_t iLength);
+
+	/* Moves the unread inline data to the front of the inline storage */
+	void Compact();
+
+	/* Takes over the buffer of another CTempBuffer */
+	void MoveFrom(CTempBuffer& rOther);
+
+	/* Returns true when the data lives in the inline storage */
+	bool IsInline() const { return (m_bBuffer == &m_tInline); }
+
+	/* a pointer to the buffer of the class, either m_tInline or a pooled buffer */
 	LPBUFFER m_bBuffer;
 
 	/* when true, force to delete the buffer after using it */
 	bool m_bForceDelete;
-};
\ No newline at end of file
+
+	/* the header of the inline storage */
+	TBuffer m_tInline;
+
+	/* the inline storage, used until the data outgrows it */
+	char m_acInline[TEMP_BUFFER_INLINE_SIZE];
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	#define BUFFER_BIG_ENDIAN
+#endif
+
+#if defined(_MSC_VER)
+	#include <cstdlib>
+	#define BUFFER_BSWAP16(x) _byteswap_ushort(x)
+	#define BUFFER_BSWAP32(x) _byteswap_ulong(x)
+	#define BUFFER_BSWAP64(x) _byteswap_uint64(x)
+#else
+	#define BUFFER_BSWAP16(x) __builtin_bswap16(x)
+	#define BUFFER_BSWAP32(x) __builtin_bswap32(x)
+	#define BUFFER_BSWAP64(x) __builtin_bswap64(x)
+#endif
+
+/***
+ * Unaligned loads of integers in an explicit byte order. They go through
+ * memcpy, which compilers turn into a single (possibly byte swapping) load.
+ */
+inline uint16_t buffer_load_le16(const void* src)
+{
+	uint16_t val;
+	memcpy(&val, src, sizeof(val));
+#if defined(BUFFER_BIG_ENDIAN)
+	val = BUFFER_BSWAP16(val);
+#endif
+	return (val);
+}
+
+inline uint32_t buffer_load_le32(const void* src)
+{
+	uint32_t val;
+	memcpy(&val, src, sizeof(val));
+#if defined(BUFFER_BIG_ENDIAN)
+	val = BUFFER_BSWAP32(val);
+#endif
+	return (val);
+}
+
+inline uint64_t buffer_load_le64(const void* src)
+{
+	uint64_t val;
+	memcpy(&val, src, sizeof(val));
+#if defined(BUFFER_BIG_ENDIAN)
+	val = BUFFER_BSWAP64(val);
+#endif
+	return (val);
+}
+
+inline uint16_t buffer_load_be16(const void* src)
+{
+	uint16_t val;
+	memcpy(&val, src, sizeof(val));
+#if !defined(BUFFER_BIG_ENDIAN)
+	val = BUFFER_BSWAP16(val);
+#endif
+	return (val);
+}
+
+inline uint32_t buffer_load_be32(const void* src)
+{
+	uint32_t val;
+	memcpy(&val, src, sizeof(val));
+#if !defined(BUFFER_BIG_ENDIAN)
+	val = BUFFER_BSWAP32(val);
+#endif
+	return (val);
+}
+
+inline uint64_t buffer_load_be64(const void* src)
+{
+	uint64_t val;
+	memcpy(&val, src, sizeof(val));
+#if !defined(BUFFER_BIG_ENDIAN)
+	val = BUFFER_BSWAP64(val);
+#endif
+	return (val);
+}
+
+/***
+ * TBufferReader - a cursor decoding a packet at the read point of a buffer.
+ * buffer_reader_open checks once that the whole packet is there, the reads
+ * then only advance the cursor (their bounds are asserted in debug builds),
+ * and buffer_reader_commit consumes what was read with one buffer_read_proceed.
+ *
+ *	TBufferReader reader;
+ *	if (!buffer_reader_open(&reader, buffer, sizeof(TPacketGCMove)))
+ *		return; // wait for more data
+ *	uint8_t bHeader = buffer_reader_u8(&reader);
+ *	uint32_t dwVID = buffer_reader_le32(&reader);
+ *	...
+ *	buffer_reader_commit(&reader);
+ */
+typedef struct SBufferReader
+{
+	/* The buffer to consume from on commit, nullptr for plain memory */
+	LPBUFFER buffer;
+
+	/* The start of the packet */
+	const uint8_t* data;
+
+	/* The length validated by buffer_reader_open (in bytes) */
+	int32_t length;
+
+	/* The position of the cursor from data (in bytes) */
+	int32_t offset;
+} TBufferReader;
+
+/***
+ * buffer_reader_open - Starts reading a packet at the read point of a buffer
+ * @reader: The reader to initialize
+ * @buffer: The buffer holding the packet
+ * @iLength: The length of the packet, the only bounds check is done against it
+ *
+ * Return: true if the buffer holds iLength bytes, false otherwise (nothing is read).
+ */
+inline bool buffer_reader_open(TBufferReader* reader, LPBUFFER buffer, int32_t iLength)
+{
+	if (iLength < 0 || buffer->length < iLength)
+	{
+		return (false);
+	}
+
+	reader->buffer = buffer;
+	reader->data = static_cast<const uint8_t*>(buffer_read_peek(buffer));
+	reader->length = iLength;
+	reader->offset = 0;
+	return (true);
+}
+
+/***
+ * buffer_reader_open_data - Starts reading a packet in memory, e.g. in a packet handler
+ * @reader: The reader to initialize
+ * @pData: The packet
+ * @iLength: The length of the packet (in bytes)
+ *
+ * Return: Nothing (void)
+ */
+inline void buffer_reader_open_data(TBufferReader* reader, const void* pData, int32_t iLength)
+{
+	reader->buffer = nullptr;
+	reader->data = static_cast<const uint8_t*>(pData);
+	reader->length = iLength;
+	reader->offset = 0;
+}
+
+/***
+ * buffer_reader_advance - Moves the cursor past iSize bytes
+ * @reader: The reader
+ * @iSize: The amount of bytes
+ *
+ * Return: A pointer to the skipped bytes.
+ */
+inline const uint8_t* buffer_reader_advance(TBufferReader* reader, int32_t iSize)
+{
+	assert(iSize >= 0 && reader->offset + iSize <= reader->length);
+
+	const uint8_t* src = reader->data + reader->offset;
+	reader->offset += iSize;
+	return (src);
+}
+
+inline uint8_t buffer_reader_u8(TBufferReader* reader)
+{
+	return (*buffer_reader_advance(reader, sizeof(uint8_t)));
+}
+
+inline uint16_t buffer_reader_le16(TBufferReader* reader)
+{
+	return (buffer_load_le16(buffer_reader_advance(reader, sizeof(uint16_t))));
+}
+
+inline uint32_t buffer_reader_le32(TBufferReader* reader)
+{
+	return (buffer_load_le32(buffer_reader_advance(reader, sizeof(uint32_t))));
+}
+
+inline uint64_t buffer_reader_le64(TBufferReader* reader)
+{
+	return (buffer_load_le64(buffer_reader_advance(reader, sizeof(uint64_t))));
+}
+
+inline uint16_t buffer_reader_be16(TBufferReader* reader)
+{
+	return (buffer_load_be16(buffer_reader_advance(reader, sizeof(uint16_t))));
+}
+
+inline uint32_t buffer_reader_be32(TBufferReader* reader)
+{
+	return (buffer_load_be32(buffer_reader_advance(reader, sizeof(uint32_t))));
+}
+
+inline uint64_t buffer_reader_be64(TBufferReader* reader)
+{
+	return (buffer_load_be64(buffer_reader_advance(reader, sizeof(uint64_t))));
+}
+
+/***
+ * buffer_reader_bytes - Copies bytes out of the packet
+ * @reader: The reader
+ * @dst: Where to copy to
+ * @iSize: The amount of bytes
+ *
+ * Return: Nothing (void)
+ */
+inline void buffer_reader_bytes(TBufferReader* reader, void* dst, int32_t iSize)
+{
+	memcpy(dst, buffer_reader_advance(reader, iSize), iSize);
+}
+
+/***
+ * buffer_reader_skip - Skips bytes of the packet
+ * @reader: The reader
+ * @iSize: The amount of bytes
+ *
+ * Return: Nothing (void)
+ */
+inline void buffer_reader_skip(TBufferReader* reader, int32_t iSize)
+{
+	buffer_reader_advance(reader, iSize);
+}
+
+/***
+ * buffer_reader_remaining - Gets the amount of bytes left in the packet
+ * @reader: The reader
+ *
+ * Return: The amount of bytes after the cursor.
+ */
+inline int32_t buffer_reader_remaining(const TBufferReader* reader)
+{
+	return (reader->length - reader->offset);
+}
+
+/***
+ * buffer_reader_commit - Consumes everything read from the buffer
+ * @reader: The reader, it can't be used afterwards
+ *
+ * Return: The amount of bytes consumed.
+ */
+inline int32_t buffer_reader_commit(TBufferReader* reader)
+{
+	const int32_t iRead = reader->offset;
+
+	if (reader->buffer && iRead > 0)
+	{
+		buffer_read_proceed(reader->buffer, iRead);
+	}
+
+	reader->buffer = nullptr;
+	return (iRead);
+}
@@ -0,0 +1,286 @@
+#include "stdafx.h"
+
+#if !defined(_WIN64)
+#include <sys/mman.h>
+#endif
+
+/* chunks and the slab header are aligned to a cache line */
+#define BUFFER_SLAB_ALIGN 64
+
+/* payloads start right after the buffer header, aligned for any scalar type */
+#define BUFFER_SLAB_HEADER_SIZE ((sizeof(TBuffer) + 15) & ~(size_t)15)
+
+/* align a size up to the given power of two */
+#define BUFFER_SLAB_ALIGN_UP(size, align) (((size) + (align) - 1) & ~((size_t)(align) - 1))
+
+/***
+ * TBufferSlab - a block of pre-mapped memory carved into equally sized chunks.
+ * Each chunk holds a TBuffer header immediately followed by its payload, so a
+ * buffer costs a single allocation and its header shares locality with its data.
+ * The slab header itself lives at the start of the mapping.
+ */
+typedef struct SBufferSlab
+{
+	/* Links of the list of slabs that still have free chunks */
+	SBufferSlab* next;
+	SBufferSlab* prev;
+
+	/* The size class this slab serves */
+	int32_t pool_index;
+
+	/* The payload size of every buffer of this slab */
+	int32_t payload_size;
+
+	/* The size of a chunk (header + payload, aligned) */
+	size_t chunk_size;
+
+	/* The total amount of chunks of the slab */
+	int32_t chunk_count;
+
+	/* The amount of chunks carved so far, chunks past it were never used */
+	int32_t carved;
+
+	/* The amount of chunks currently handed out */
+	int32_t live;
+
+	/* Chunks that were returned to the slab, linked through TBuffer::next */
+	LPBUFFER free_list;
+
+	/* The first chunk of the slab */
+	char* chunks;
+
+	/* The size of the whole mapping */
+	size_t map_size;
+} TBufferSlab;
+
+/***
+ * TBufferSlabClass - the slabs of one size class.
+ * The slab path is only taken when the pool has no buffer to reuse, so a plain
+ * mutex is enough here, the magazines in front of it keep it off the hot path.
+ */
+typedef struct SBufferSlabClass
+{
+	/* Guards every slab of the class */
+	std::mutex lock;
+
+	/* Slabs that have free or uncarved chunks */
+	TBufferSlab* partial;
+} TBufferSlabClass;
+
+/* the slab classes, indexed like normalized_buffer_pool, only the ones up to BUFFER_SLAB_MAX_PAYLOAD are used */
+static TBufferSlabClass buffer_slab_classes[BUFFER_POOL_COUNT];
+
+/***
+ * buffer_slab_map - Map fresh memory for a slab.
+ * @size: The amount of bytes to map.
+ *
+ * Return: The mapped memory, or nullptr on failure.
+ */
+static void* buffer_slab_map(size_t size)
+{
+#if defined(_WIN64)
+	return (VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+	void* pMemory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return (pMemory == MAP_FAILED ? nullptr : pMemory);
+#endif
+}
+
+/***
+ * buffer_slab_unmap - Give the memory of a slab back to the system.
+ * @pMemory: The mapped memory.
+ * @size: The size of the mapping.
+ *
+ * Return: Nothing (void.)
+ */
+static void buffer_slab_unmap(void* pMemory, size_t size)
+{
+#if defined(_WIN64)
+	VirtualFree(pMemory, 0, MEM_RELEASE);
+#else
+	munmap(pMemory, size);
+#endif
+}
+
+/***
+ * buffer_slab_link - Add a slab to the partial list of its class.
+ * Return: Nothing (void.)
+ */
+static void buffer_slab_link(TBufferSlabClass* slabClass, TBufferSlab* slab)
+{
+	slab->prev = nullptr;
+	slab->next = slabClass->partial;
+
+	if (slabClass->partial)
+	{
+		slabClass->partial->prev = slab;
+	}
+
+	slabClass->partial = slab;
+}
+
+/***
+ * buffer_slab_unlink - Remove a slab from the partial list of its class.
+ * Return: Nothing (void.)
+ */
+static void buffer_slab_unlink(TBufferSlabClass* slabClass, TBufferSlab* slab)
+{
+	if (slab->prev)
+	{
+		slab->prev->next = slab->next;
+	}
+	else
+	{
+		slabClass->partial = slab->next;
+	}
+
+	if (slab->next)
+	{
+		slab->next->prev = slab->prev;
+	}
+
+	slab->next = nullptr;
+	slab->prev = nullptr;
+}
+
+/***
+ * buffer_slab_create - Map a new slab for a size class.
+ * @iPoolIndex: The index of the size class.
+ * @iSize: The payload size of the class.
+ *
+ * The slab is at least BUFFER_SLAB_SIZE big, and always holds a few chunks.
+ *
+ * Return: The new slab, or nullptr if mapping failed.
+ */
+static TBufferSlab* buffer_slab_create(int32_t iPoolIndex, int32_t iSize)
+{
+	size_t chunkSize = BUFFER_SLAB_ALIGN_UP(BUFFER_SLAB_HEADER_SIZE + iSize, BUFFER_SLAB_ALIGN);
+	size_t headerSize = BUFFER_SLAB_ALIGN_UP(sizeof(TBufferSlab), BUFFER_SLAB_ALIGN);
+	size_t mapSize = BUFFER_SLAB_SIZE;
+
+	if (headerSize + chunkSize * 8 > mapSize)
+	{
+		mapSize = BUFFER_SLAB_ALIGN_UP(headerSize + chunkSize * 8, 4096);
+	}
+
+	char* pMemory = (char*)buffer_slab_map(mapSize);
+	if (!pMemory)
+	{
+		sys_err("failed to map buffer slab of %zu bytes, Error[%d] : %s", mapSize, errno, strerror(errno));
+		return (nullptr);
+	}
+
+	/* the mapping is zero filled, only the non zero fields need to be set */
+	TBufferSlab* slab = (TBufferSlab*)pMemory;
+	slab->pool_index = iPoolIndex;
+	slab->payload_size = iSize;
+	slab->chunk_size = chunkSize;
+	slab->chunk_count = (int32_t)((mapSize - headerSize) / chunkSize);
+	slab->chunks = pMemory + headerSize;
+	slab->map_size = mapSize;
+
+	return (slab);
+}
+
+/***
+ * buffer_slab_alloc - Allocates a buffer from a slab of the given size class
+ * @iPoolIndex: The index of the size class of the buffer.
+ * @iSize: The payload size of the size class.
+ *
+ * The returned buffer header is followed by its payload in the same chunk,
+ * mem_data points right after the header. Freed chunks are reused before new
+ * ones are carved, and a new slab is mapped when the class has no room left.
+ *
+ * Return: The new buffer, or nullptr if no slab could be mapped.
+ */
+LPBUFFER buffer_slab_alloc(int32_t iPoolIndex, int32_t iSize)
+{
+	assert(iSize <= BUFFER_SLAB_MAX_PAYLOAD);
+	assert(iPoolIndex >= 0 && iPoolIndex < BUFFER_POOL_COUNT);
+
+	TBufferSlabClass* slabClass = &buffer_slab_classes[iPoolIndex];
+	LPBUFFER buffer = nullptr;
+
+	{
+		std::lock_guard<std::mutex> guard(slabClass->lock);
+
+		TBufferSlab* slab = slabClass->partial;
+		if (!slab)
+		{
+			slab = buffer_slab_create(iPoolIndex, iSize);
+			if (!slab)
+			{
+				return (nullptr);
+			}
+
+			buffer_slab_link(slabClass, slab);
+		}
+
+		/* reuse a returned chunk first, carve a new one otherwise */
+		if (slab->free_list)
+		{
+			buffer = slab->free_list;
+			slab->free_list = buffer->next;
+		}
+		else
+		{
+			buffer = (LPBUFFER)(slab->chunks + slab->chunk_size * slab->carved);
+			slab->carved++;
+		}
+
+		slab->live++;
+
+		/* no room left, the slab leaves the partial list until a chunk comes back */
+		if (!slab->free_list && slab->carved == slab->chunk_count)
+		{
+			buffer_slab_unlink(slabClass, slab);
+		}
+
+		memset((void*)buffer, 0, sizeof(TBuffer));
+		buffer->slab = slab;
+	}
+
+	buffer->alloc_type = BUFFER_ALLOC_SLAB;
+	buffer->mem_data = (char*)buffer + BUFFER_SLAB_HEADER_SIZE;
+	buffer->mem_size = iSize;
+
+	return (buffer);
+}
+
+/***
+ * buffer_slab_free - Returns a slab backed buffer to its slab
+ * @buffer: The buffer to release, allocated by buffer_slab_alloc.
+ *
+ * The chunk becomes available for the next allocation of the class. When the
+ * slab has no buffer left and the class has another slab with room, the empty
+ * slab is given back to the system.
+ *
+ * Return: Nothing (void.)
+ */
+void buffer_slab_free(LPBUFFER buffer)
+{
+	assert(buffer->alloc_type == BUFFER_ALLOC_SLAB);
+
+	TBufferSlab* slab = buffer->slab;
+	TBufferSlabClass* slabClass = &buffer_slab_classes[slab->pool_index];
+
+	std::lock_guard<std::mutex> guard(slabClass->lock);
+
+	bool bWasFull = !slab->free_list && slab->carved == slab->chunk_count;
+
+	buffer->next = slab->free_list;
+	slab->free_list = buffer;
+	slab->live--;
+
+	if (bWasFull)
+	{
+		buffer_slab_link(slabClass, slab);
+	}
+
+	/* keep one slab of the class mapped, so a single buffer bouncing doesn't map and unmap */
+	if (slab->live == 0 && (slab->prev || slab->next))
+	{
+		buffer_slab_unlink(slabClass, slab);
+		buffer_slab_unmap(slab, slab->map_size);
+	}
+}
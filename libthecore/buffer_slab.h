@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+/* biggest payload that is carved from slabs, bigger buffers use two heap allocations */
+#define BUFFER_SLAB_MAX_PAYLOAD (64 * 1024)
+
+/* size of the memory mapped by one slab */
+#define BUFFER_SLAB_SIZE (1024 * 1024)
+
+/* Allocates a buffer header followed by its payload from a slab of the given size class */
+extern LPBUFFER buffer_slab_alloc(int32_t iPoolIndex, int32_t iSize);
+
+/* Returns a slab backed buffer to the slab it was carved from */
+extern void buffer_slab_free(LPBUFFER buffer);
@@ -0,0 +1,196 @@
+#include "stdafx.h"
+
+#if defined(CPU_X86_64) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+#if defined(CPU_X86_64)
+/***
+ * cpu_cpuid - Runs the cpuid instruction.
+ * @iLeaf: The leaf to query.
+ * @iSubLeaf: The sub-leaf to query.
+ * @adwRegs: Receives eax, ebx, ecx and edx.
+ *
+ * Return: Nothing (void)
+ */
+static void cpu_cpuid(int32_t iLeaf, int32_t iSubLeaf, uint32_t adwRegs[4])
+{
+#if defined(_MSC_VER)
+	int aiRegs[4];
+	__cpuidex(aiRegs, iLeaf, iSubLeaf);
+
+	for (int32_t i = 0; i < 4; ++i)
+	{
+		adwRegs[i] = (uint32_t)aiRegs[i];
+	}
+#else
+	__cpuid_count(iLeaf, iSubLeaf, adwRegs[0], adwRegs[1], adwRegs[2], adwRegs[3]);
+#endif
+}
+
+/***
+ * cpu_xgetbv - Reads the register telling which vector states the OS saves.
+ *
+ * Return: The value of XCR0.
+ */
+static uint64_t cpu_xgetbv()
+{
+#if defined(_MSC_VER)
+	return (_xgetbv(0));
+#else
+	uint32_t dwLow, dwHigh;
+	__asm__ volatile ("xgetbv" : "=a"(dwLow), "=d"(dwHigh) : "c"(0));
+	return (((uint64_t)dwHigh << 32) | dwLow);
+#endif
+}
+#endif
+
+/***
+ * cpu_detect_features - Queries the features of the CPU.
+ *
+ * AVX2 and AVX-512 are only reported when the OS saves the wider registers
+ * on context switches, otherwise using them would corrupt other threads.
+ *
+ * Return: The ECpuFeature flags.
+ */
+static uint32_t cpu_detect_features()
+{
+	uint32_t dwFeatures = 0;
+
+#if defined(CPU_X86_64)
+	uint32_t adwRegs[4];
+
+	cpu_cpuid(0, 0, adwRegs);
+	const uint32_t dwMaxLeaf = adwRegs[0];
+
+	cpu_cpuid(1, 0, adwRegs);
+
+	/* part of x86-64 */
+	dwFeatures |= CPU_FEATURE_SSE2;
+
+	if (adwRegs[2] & (1 << 9))
+	{
+		dwFeatures |= CPU_FEATURE_SSSE3;
+	}
+
+	/* OSXSAVE and AVX, then ask the OS which register states it saves */
+	uint64_t qwXcr0 = 0;
+	if ((adwRegs[2] & (1 << 27)) && (adwRegs[2] & (1 << 28)))
+	{
+		qwXcr0 = cpu_xgetbv();
+	}
+
+	const bool bOsAvx = (qwXcr0 & 0x6) == 0x6;
+	const bool bOsAvx512 = (qwXcr0 & 0xE6) == 0xE6;
+
+	if (dwMaxLeaf >= 7)
+	{
+		cpu_cpuid(7, 0, adwRegs);
+
+		if (bOsAvx && (adwRegs[1] & (1 << 5)))
+		{
+			dwFeatures |= CPU_FEATURE_AVX2;
+		}
+
+		if (bOsAvx512 && (adwRegs[1] & (1 << 16)))
+		{
+			dwFeatures |= CPU_FEATURE_AVX512F;
+		}
+
+		if (bOsAvx512 && (adwRegs[1] & (1 << 30)))
+		{
+			dwFeatures |= CPU_FEATURE_AVX512BW;
+		}
+
+		if (adwRegs[1] & (1 << 9))
+		{
+			dwFeatures |= CPU_FEATURE_ERMS;
+		}
+
+		/* fast short rep movsb */
+		if (adwRegs[3] & (1 << 4))
+		{
+			dwFeatures |= CPU_FEATURE_FSRM;
+		}
+	}
+#endif
+
+	return (dwFeatures);
+}
+
+/***
+ * cpu_get_features - Gets the features of the CPU that the OS also supports.
+ *
+ * The CPU is queried once, on the first call.
+ *
+ * Return: The ECpuFeature flags.
+ */
+uint32_t cpu_get_features()
+{
+	static const uint32_t s_dwFeatures = cpu_detect_features();
+	return (s_dwFeatures);
+}
+
+/***
+ * cpu_has_feature - Checks whether the CPU supports every given feature.
+ * @dwFeatures: ECpuFeature flags.
+ *
+ * Return: true if all of them are supported.
+ */
+bool cpu_has_feature(uint32_t dwFeatures)
+{
+	return ((cpu_get_features() & dwFeatures) == dwFeatures);
+}
+
+/***
+ * cpu_format_features - Writes the names of the supported features.
+ * @szBuf: Where to write.
+ * @iSize: The size of szBuf.
+ *
+ * Return: true (so it can initialize a static).
+ */
+static bool cpu_format_features(char* szBuf, int32_t iSize)
+{
+	static const struct
+	{
+		uint32_t dwFeature;
+		const char* szName;
+	} s_aNames[] =
+	{
+		{ CPU_FEATURE_SSE2, "sse2" },
+		{ CPU_FEATURE_SSSE3, "ssse3" },
+		{ CPU_FEATURE_AVX2, "avx2" },
+		{ CPU_FEATURE_AVX512F, "avx512f" },
+		{ CPU_FEATURE_AVX512BW, "avx512bw" },
+		{ CPU_FEATURE_ERMS, "erms" },
+		{ CPU_FEATURE_FSRM, "fsrm" },
+	};
+
+	int32_t iWritten = 0;
+
+	snprintf(szBuf, iSize, "none");
+
+	for (const auto& rName : s_aNames)
+	{
+		if (cpu_has_feature(rName.dwFeature) && iWritten < iSize)
+		{
+			iWritten += snprintf(szBuf + iWritten, iSize - iWritten, "%s%s", iWritten ? " " : "", rName.szName);
+		}
+	}
+
+	return (true);
+}
+
+/***
+ * cpu_get_features_string - Gets the features as text, for logging.
+ *
+ * Return: The names of the supported features separated by spaces, "none" if there are none.
+ */
+const char* cpu_get_features_string()
+{
+	static char s_szFeatures[64];
+	static const bool s_bFormatted = cpu_format_features(s_szFeatures, sizeof(s_szFeatures));
+
+	(void)s_bFormatted;
+	return (s_szFeatures);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+/* x86-64 builds can use the SIMD kernels, other targets stay on the portable code */
+#if defined(__x86_64__) || defined(_M_X64)
+	#define CPU_X86_64
+#endif
+
+/* Instruction set extensions the kernels can be picked by */
+enum ECpuFeature
+{
+	CPU_FEATURE_SSE2 = (1 << 0),
+	CPU_FEATURE_SSSE3 = (1 << 1),
+	CPU_FEATURE_AVX2 = (1 << 2),
+	CPU_FEATURE_AVX512F = (1 << 3),
+	CPU_FEATURE_AVX512BW = (1 << 4),
+	CPU_FEATURE_ERMS = (1 << 5),
+	CPU_FEATURE_FSRM = (1 << 6),
+};
+
+/* Gets the features of the CPU that the OS also supports (ECpuFeature flags) */
+extern uint32_t cpu_get_features();
+
+/* Checks whether the CPU supports every given feature */
+extern bool cpu_has_feature(uint32_t dwFeatures);
+
+/* Gets the features as text, for logging */
+extern const char* cpu_get_features_string();
@@ -18,6 +18,15 @@ static char log_dir[32] = {0, };
 int log_keep_days = 3;
 static unsigned int log_level_bits = 0;
 
+/*** the tag of the calling thread, e.g. its reactor shard, printed before each of its lines ***/
+static thread_local char log_thread_tag[16] = {0, };
+
+/*** keeps the lines of several threads from interleaving, held only to write a formatted line ***/
+static std::mutex log_write_lock;
+
+/*** the line being logged by the calling thread, formatted outside log_write_lock ***/
+static thread_local char log_line[4096 + 2];
+
 /***
  * logs_init - Initialize Logs & Allocate Memory
  * Return: true on success, otherwise false.
@@ -372,6 +381,94 @@ void log_file_rotate(LPLOGFILE logFile)
     }
 }
 
+/***
+ * log_set_thread_tag - Set the tag printed before the lines logged by the calling thread.
+ * @tag: a short name (truncated to 15 characters), nullptr or empty to clear it.
+ * Return: Nothing (void).
+ */
+void log_set_thread_tag(const char* tag)
+{
+    if (!tag)
+    {
+        log_thread_tag[0] = '\0';
+        return;
+    }
+
+    strncpy(log_thread_tag, tag, sizeof(log_thread_tag) - 1);
+    log_thread_tag[sizeof(log_thread_tag) - 1] = '\0';
+}
+
+/***
+ * log_get_thread_tag - Get the tag of the calling thread.
+ * Return: the tag, an empty string if the thread has none.
+ */
+const char* log_get_thread_tag()
+{
+    return (log_thread_tag);
+}
+
+/***
+ * log_format_time - Format a time like the "Mmm dd hh:mm:ss" part of asctime.
+ * @buf: the buffer the time is written into.
+ * @size: the size of the buffer.
+ * @ct: the time to format.
+ * Return: true on success, otherwise false.
+ */
+static bool log_format_time(char* buf, size_t size, time_t ct)
+{
+    std::tm localTime;
+
+    /*** localtime and asctime share a static buffer, the reentrant version lets threads format at once ***/
+#if defined(_WIN64)
+    if (localtime_s(&localTime, &ct) != 0)
+    {
+        return (false);
+    }
+#else
+    if (localtime_r(&ct, &localTime) == nullptr)
+    {
+        return (false);
+    }
+#endif
+
+    return (strftime(buf, size, "%b %e %H:%M:%S", &localTime) != 0);
+}
+
+/***
+ * log_format_line - Finish a line after its prefix with the formatted message and a newline.
+ * @len: the length of the prefix already in log_line.
+ * @format: the format of the message.
+ * @args: the arguments of the format.
+ * Return: the length of the whole line.
+ */
+static int log_format_line(int len, const char* format, va_list args)
+{
+    /*** leave room for the newline ***/
+    const int size = (int)sizeof(log_line) - 1;
+
+    if (len < 0)
+    {
+        len = 0;
+    }
+    else if (len >= size)
+    {
+        len = size - 1;
+    }
+    else
+    {
+        const int body = vsnprintf(log_line + len, static_cast<size_t>(size - len), format, args);
+
+        if (body > 0)
+        {
+            len = std::min(len + body, size - 1);
+        }
+    }
+
+    log_line[len++] = '\n';
+    log_line[len] = '\0';
+    return (len);
+}
+
 /***
  * _sys_err - Print to system Error Output Function.
  * @func: the function name which have been calling this sys_err function.
@@ -382,66 +479,63 @@ void log_file_rotate(LPLOGFILE logFile)
 void _sys_err(const char *func, int line, const char *format, ...)
 {
     va_list args;
-    time_t ct = time(0);
-    std::tm* localTime = localtime(&ct);
-    char* time_string = nullptr;
+    char time_string[32];
+    int len;
 
-    if (localTime != nullptr)
+    /*** make sure the system error log file is initialized ***/
+    if (!log_file_syserr)
     {
-        time_string = asctime(localTime);
+        return;
     }
 
-    if (time_string == nullptr)
+    if (!log_format_time(time_string, sizeof(time_string), time(0)))
     {
         return;
     }
-    char buf[4096 + 2]; /*** to add \n at the end ***/
-    int len;
 
-    /*** make sure the system error log file is initialized ***/
-    if (!log_file_syserr)
+    /*** the line is built in the buffer of the thread, only writing it takes the lock ***/
+    if (log_thread_tag[0])
     {
-        return;
+        len = snprintf(log_line, 4096, "SYSERR: %-15.15s [%s] :: %s: ", time_string, log_thread_tag, func);
+    }
+    else
+    {
+        len = snprintf(log_line, 4096, "SYSERR: %-15.15s :: %s: ", time_string, func);
     }
 
-    /*** set last character in time string as null terminator ***/
-    time_string[strlen(time_string) - 1] = '\0';
-
-    /*** calculate the len of the buffer ***/
-    len = snprintf(buf, 4096, "SYSERR: %-15.15s :: %s: ", time_string + 4, func);
+    va_start(args, format);
+    len = log_format_line(len, format, args);
+    va_end(args);
 
-    /*** set last character in the buffer string as null terminator ***/
-    buf[4096 + 1] = '\0';
+    FILE* syserrFile = log_file_syserr->fp;
+    FILE* syslogFile = log_file_syslog ? log_file_syslog->fp : nullptr;
 
-    /*** if there is a space in the file length */
-    if (len < 4096)
+    /*** print the output into log_file_syserr, and into log_file_syslog since it contains both logs and errors of our application ***/
     {
-        va_start(args, format);
-        vsnprintf(buf + len, 4096 - static_cast<size_t>(len), format, args);
-        va_end(args);
-    }
+        std::lock_guard<std::mutex> lock(log_write_lock);
+
+        fwrite(log_line, 1, len, syserrFile);
 
-    /*** Add newline to the end of the string ***/
-    strcat(buf, "\n");
+        if (syslogFile)
+        {
+            fwrite(log_line, 1, len, syslogFile);
+        }
+    }
 
-    /*** print the output into log_file_syserr ***/
-    fputs(buf, log_file_syserr->fp);
-    fflush(log_file_syserr->fp);
+    fflush(syserrFile);
 
-    /*** print the output into log_file_syslog, since it contains both logs and errors of our application, but make sure it's initialized ***/
-    if (log_file_syslog)
+    if (syslogFile)
     {
-        fputs(buf, log_file_syslog->fp);
-        fflush(log_file_syslog->fp);
+        fflush(syslogFile);
     }
 
 #if defined(_WIN64)
-    fputs(buf, stdout);
+    fwrite(log_line, 1, len, stdout);
     fflush(stdout);
 #endif
 }
 
-long lastSysLog = 0;
+static std::atomic<long> lastSysLog(0);
 
 /***
  * sys_log - Print to system Logs Output Function.
@@ -454,7 +548,6 @@ void sys_log(unsigned int level, const char *format, ...)
     va_list args;
 
     struct timeval timeVal;
-    int iMilliSec = 0;
     gettimeofday(&timeVal, nullptr);
 
     if (level != 0 && !(log_level_bits & level))
@@ -462,60 +555,77 @@ void sys_log(unsigned int level, const char *format, ...)
         return;
     }
 
-    if (log_file_syslog)
+    char time_string[32];
+
+    if (!log_format_time(time_string, sizeof(time_string), time(0)))
     {
-        time_t curTime = time(0);
-        std::tm* localTime = localtime(&curTime);
-        char* time_string = nullptr;
+        return;
+    }
 
-        if (localTime != nullptr)
-        {
-            time_string = asctime(localTime);
-        }
+    /*** the time since the previous line of any thread ***/
+    const long lastTime = lastSysLog.exchange(timeVal.tv_usec, std::memory_order_relaxed);
+    long calcTime;
 
-        if (time_string == nullptr)
-        {
-            return;
-        }
+    if (timeVal.tv_usec > lastTime)
+    {
+        calcTime = timeVal.tv_usec - lastTime;
+    }
+    else
+    {
+        calcTime = 1000000 - lastTime + timeVal.tv_usec;
+    }
 
-        time_string[strlen(time_string) - 1] = '\0';
+    /*** the line is built in the buffer of the thread, only writing it takes the lock ***/
+    int prefix;
 
-        long calcTime;
-        if (timeVal.tv_usec > lastSysLog)
-        {
-            calcTime = timeVal.tv_usec - lastSysLog;
-        }
-        else
-        {
-            calcTime = 1000000 - lastSysLog + timeVal.tv_usec;
-        }
+    if (log_thread_tag[0])
+    {
+        prefix = snprintf(log_line, 4096, "%-15.15s.%ld [%ld] [%s] :: ", time_string, (long)timeVal.tv_usec, calcTime, log_thread_tag);
+    }
+    else
+    {
+        prefix = snprintf(log_line, 4096, "%-15.15s.%ld [%ld] :: ", time_string, (long)timeVal.tv_usec, calcTime);
+    }
 
-        fprintf(log_file_syslog->fp, "%-15.15s.%d [%d] :: ", time_string + 4, timeVal.tv_usec, calcTime);
-        lastSysLog = timeVal.tv_usec;
+    va_start(args, format);
+    const int len = log_format_line(prefix, format, args);
+    va_end(args);
 
-        va_start(args, format);
-        vfprintf(log_file_syslog->fp, format, args);
-        va_end(args);
+    /*** stdout gets the message without the prefix ***/
+    prefix = std::max(0, std::min(prefix, len - 1));
 
-        fputc('\n', log_file_syslog->fp);
-        fflush(log_file_syslog->fp);
-    }
+    FILE* syslogFile = log_file_syslog ? log_file_syslog->fp : nullptr;
 
 #if !defined(_WIN64)
     // If log_level is 1 or higher, it is often a test, so it is also printed to stdout.
-    if (log_level_bits > 1)
-    {
+    const bool bStdout = log_level_bits > 1;
+#else
+    const bool bStdout = true;
 #endif
 
-        va_start(args, format);
-        vfprintf(stdout, format, args);
-        va_end(args);
+    {
+        std::lock_guard<std::mutex> lock(log_write_lock);
 
-        fputc('\n', stdout);
+        if (syslogFile)
+        {
+            fwrite(log_line, 1, len, syslogFile);
+        }
+
+        if (bStdout)
+        {
+            fwrite(log_line + prefix, 1, len - prefix, stdout);
+        }
+    }
+
+    if (syslogFile)
+    {
+        fflush(syslogFile);
+    }
+
+    if (bStdout)
+    {
         fflush(stdout);
-#if !defined(_WIN64)
     }
-#endif
 }
 
 /***
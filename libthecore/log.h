@@ -48,6 +48,12 @@ void log_file_delete_old(const std::string& fileName);
 /* Rotate & Check log file and move/create and modify it */
 void log_file_rotate(LPLOGFILE logFile);
 
+/* Set the tag printed before the lines logged by the calling thread, nullptr to clear it */
+extern void log_set_thread_tag(const char* tag);
+
+/* Get the tag of the calling thread, an empty string if it has none */
+extern const char* log_get_thread_tag();
+
 /* Print to system Error Output Function */
 extern void _sys_err(const char* func, int line, const char* format, ...);
 
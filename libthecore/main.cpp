@@ -1,6 +1,11 @@
 #include "stdafx.h"
 #include <iostream>
 
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
 #define PLAYER_MAX_NAME 64
 
 enum Packets
@@ -11,29 +16,384 @@ enum Packets
 
 typedef struct SPacketGCTest
 {
-    int32_t iHeader;
+    uint8_t bHeader;
     char szPlayerName[PLAYER_MAX_NAME + 1];
 } TPacketGCTest;
 
-int main()
+typedef TPacketSchema<TPacketGCTest,
+    TPacketFixed<&TPacketGCTest::bHeader>,
+    TPacketString<&TPacketGCTest::szPlayerName>> TPacketGCTestSchema;
+
+static_assert(TPacketGCTestSchema::max_size == 1 + 1 + PLAYER_MAX_NAME, "TPacketGCTest: unexpected wire size");
+
+static bool OnTestPacket(void* /* pContext */, const void* pData, int32_t iSize)
+{
+    TPacketGCTest testPackReceived;
+    if (TPacketGCTestSchema::Decode(pData, iSize, testPackReceived) <= 0)
+    {
+        return (false);
+    }
+
+    std::cout << "Header Num: " << static_cast<int32_t>(testPackReceived.bHeader) << std::endl;
+    std::cout << "Header szPlayerName:: " << testPackReceived.szPlayerName << std::endl;
+    return (true);
+}
+
+static int BenchmarkMemcpy()
+{
+    TMemcpyPollution result;
+    if (!thecore_memcpy_measure_pollution(16 * 1024 * 1024, 1024 * 1024, 20, &result))
+    {
+        return (EXIT_FAILURE);
+    }
+
+    std::cout << "memcpy kernel: " << thecore_memcpy_kernel_name() << " (" << cpu_get_features_string() << ")" << std::endl;
+    std::cout << "copy " << (result.copy_size >> 20) << " MB, hot set " << (result.hot_size >> 10) << " KB" << std::endl;
+    std::cout << "hot set access, no copy:          " << result.hot_ns_idle << " ns" << std::endl;
+    std::cout << "hot set access, after memcpy:     " << result.hot_ns_memcpy << " ns (copy " << result.copy_gbps_memcpy << " GB/s)" << std::endl;
+    std::cout << "hot set access, after stream:     " << result.hot_ns_stream << " ns (copy " << result.copy_gbps_stream << " GB/s)" << std::endl;
+    return (EXIT_SUCCESS);
+}
+
+// Write, read part of it, then write more than fits after the write point: the inline storage must never reach the pool
+static bool CheckTempBufferRefill()
+{
+    char acData[300];
+    for (int32_t i = 0; i < (int32_t)sizeof(acData); ++i)
+    {
+        acData[i] = (char)i;
+    }
+
+    uintptr_t pObjectBegin;
+    uintptr_t pObjectEnd;
+    bool bDataOk;
+
+    {
+        CTempBuffer buf;
+        pObjectBegin = reinterpret_cast<uintptr_t>(&buf);
+        pObjectEnd = pObjectBegin + sizeof(buf);
+
+        char acRead[250];
+        buf.Write(acData, 200);
+        buf.Read(acRead, 50);
+        buf.Write(acData + 200, 100);
+        buf.Read(acRead, 250);
+
+        bDataOk = !memcmp(acRead, acData + 50, 250) && buf.GetSize() == 0;
+    }
+
+    LPBUFFER buffer = buffer_new(TEMP_BUFFER_INLINE_SIZE);
+    const uintptr_t pBuffer = reinterpret_cast<uintptr_t>(buffer);
+    const bool bPoolOk = pBuffer < pObjectBegin || pBuffer >= pObjectEnd;
+    buffer_delete(buffer);
+
+    if (!bDataOk || !bPoolOk)
+    {
+        std::cout << "CTempBuffer refill check failed (data " << bDataOk << ", pool " << bPoolOk << ")" << std::endl;
+        return (false);
+    }
+
+    return (true);
+}
+
+// Drain the chain, then append a buffer and a shared view: the drained tail must not stay in front of them
+static bool CheckBufferChainDrain()
+{
+    LPBUFFERCHAIN chain = buffer_chain_new();
+    char acRead[16];
+
+    buffer_chain_write(chain, "abcd", 4);
+    bool bOk = buffer_chain_read(chain, acRead, 4);
+
+    LPBUFFER buffer = buffer_new(16);
+    buffer_write(buffer, "efgh", 4);
+    buffer_chain_append(chain, buffer);
+    bOk = bOk && buffer_chain_read(chain, acRead, 4) && !memcmp(acRead, "efgh", 4);
+
+    LPBUFFER shared = buffer_shared_new("ijkl", 4);
+    buffer_chain_append_shared(chain, shared);
+    buffer_shared_release(shared);
+    bOk = bOk && buffer_chain_read(chain, acRead, 4) && !memcmp(acRead, "ijkl", 4);
+
+    buffer_chain_write(chain, "mnop", 4);
+    bOk = bOk && buffer_chain_read(chain, acRead, 4) && !memcmp(acRead, "mnop", 4);
+    bOk = bOk && buffer_chain_size(chain) == 0 && chain->segment_count <= 1;
+
+    buffer_chain_delete(chain);
+
+    if (!bOk)
+    {
+        std::cout << "buffer chain drain check failed" << std::endl;
+        return (false);
+    }
+
+    return (true);
+}
+
+// Every write path must leave a shared buffer and its views alone, even with room after the write point (each refused write logs a sys_err)
+static bool CheckSharedBufferWrites()
+{
+    char acData[100];
+    memset(acData, 's', sizeof(acData));
+    const uint32_t dwValue = 0x77777777;
+
+    LPBUFFER shared = buffer_shared_new(acData, sizeof(acData));
+    LPBUFFER view = buffer_shared_view(shared);
+    const bool bRoom = buffer_has_space(shared) >= (int32_t)sizeof(dwValue);
+
+    buffer_write(shared, &dwValue, sizeof(dwValue));
+    buffer_write_fixed<sizeof(dwValue)>(shared, &dwValue);
+    buffer_write_object(shared, dwValue);
+    buffer_write_fixed<sizeof(dwValue)>(view, &dwValue);
+    buffer_write_object(view, dwValue);
+
+    char acRead[sizeof(acData)];
+    const bool bLengthOk = buffer_size(shared) == sizeof(acData) && buffer_size(view) == sizeof(acData);
+    buffer_read(view, acRead, sizeof(acRead));
+    const bool bDataOk = !memcmp(acRead, acData, sizeof(acData));
+
+    buffer_delete(view);
+    buffer_shared_release(shared);
+
+    if (!bRoom || !bLengthOk || !bDataOk)
+    {
+        std::cout << "shared buffer write check failed (room " << bRoom << ", length " << bLengthOk << ", data " << bDataOk << ")" << std::endl;
+        return (false);
+    }
+
+    return (true);
+}
+
+#if defined(__linux__)
+// Sends a datagram in the format of the UDP channel from a plain socket: the session id and the sequence number (little endian), then the payload
+static void SendUdpDatagram(int iSocket, const sockaddr_in& addr, uint32_t dwId, uint32_t dwSequence, const char* szPayload)
 {
+    uint8_t abData[UDP_CHANNEL_MAX_DATAGRAM];
+    const size_t iLength = strlen(szPayload);
+
+    for (int32_t i = 0; i < 4; ++i)
+    {
+        abData[i] = (uint8_t)(dwId >> (8 * i));
+        abData[4 + i] = (uint8_t)(dwSequence >> (8 * i));
+    }
+
+    memcpy(abData + UDP_CHANNEL_HEADER_SIZE, szPayload, iLength);
+    sendto(iSocket, abData, UDP_CHANNEL_HEADER_SIZE + iLength, 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+}
+
+// Runs a UDP channel against a plain socket over loopback: stale, unknown and malformed datagrams are dropped, the newest one of a tick wins and the replies leave in one sendmmsg
+static int LoopbackUdp()
+{
+    const uint32_t dwSessionId = 0x5EED1234;
+
+    LPUDPCHANNEL channel = udp_channel_new("127.0.0.1", 0, UDP_CHANNEL_LATEST_ONLY);
+    if (!channel)
+    {
+        return (EXIT_FAILURE);
+    }
+
+    LPUDPSESSION session = udp_channel_add_session(channel, dwSessionId, nullptr);
+
+    int iSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(channel->port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // loopback queues a datagram before sendto returns, so a single poll sees all of them
+    SendUdpDatagram(iSocket, addr, dwSessionId, 1, "move 1");
+    SendUdpDatagram(iSocket, addr, dwSessionId, 3, "move 3");
+    SendUdpDatagram(iSocket, addr, dwSessionId, 2, "move 2");
+    SendUdpDatagram(iSocket, addr, dwSessionId + 1, 4, "stranger");
+    sendto(iSocket, "bad", 3, 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+
+    TUdpDatagram* pDatagrams;
+    const int32_t iCount = udp_channel_poll(channel, &pDatagrams);
+
+    bool bOk = iCount == 1 && pDatagrams[0].session == session && pDatagrams[0].sequence == 3 &&
+        pDatagrams[0].buffer->length == 6 && !memcmp(buffer_read_peek(pDatagrams[0].buffer), "move 3", 6);
+    udp_channel_release(channel);
+
+    const TUdpChannelStats& stats = channel->stats;
+    std::cout << "udp received " << stats.received << ", accepted " << stats.accepted << ", superseded " << stats.superseded
+        << ", stale " << stats.dropped_stale << ", unknown " << stats.dropped_unknown << ", malformed " << stats.dropped_malformed << std::endl;
+
+    bOk = bOk && stats.received == 5 && stats.accepted == 1 && stats.superseded == 1 &&
+        stats.dropped_stale == 1 && stats.dropped_unknown == 1 && stats.dropped_malformed == 1;
+
+    // the replies go to the address learned from the accepted datagrams
+    for (int32_t i = 0; i < 3; ++i)
+    {
+        udp_channel_send(channel, session, "ack", 3);
+    }
+
+    const int32_t iSent = udp_channel_flush(channel);
+
+    int32_t iReceived = 0;
+    uint8_t abReply[UDP_CHANNEL_MAX_DATAGRAM];
+    while (recv(iSocket, abReply, sizeof(abReply), MSG_DONTWAIT) == UDP_CHANNEL_HEADER_SIZE + 3)
+    {
+        ++iReceived;
+    }
+
+    std::cout << "udp sent " << iSent << " in " << stats.send_calls << " sendmmsg, received " << iReceived << std::endl;
+    bOk = bOk && iSent == 3 && stats.send_calls == 1 && iReceived == 3;
+
+    close(iSocket);
+    udp_channel_delete(channel);
+
+    std::cout << (bOk ? "udp loopback ok" : "udp loopback failed") << std::endl;
+    return (bOk ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+static LPREACTORCONN s_pLoopbackConn = nullptr;
+
+static bool OnLoopbackAccept(LPREACTORCONN conn)
+{
+    s_pLoopbackConn = conn;
+    return (true);
+}
+
+// Reads what the client socket holds without waiting
+static int32_t DrainClient(int iSocket)
+{
+    char acData[4096];
+    int32_t iTotal = 0;
+    ssize_t iRead;
+
+    while ((iRead = recv(iSocket, acData, sizeof(acData), MSG_DONTWAIT)) > 0)
+    {
+        iTotal += (int32_t)iRead;
+    }
+
+    return (iTotal);
+}
+
+// Runs a reactor against a plain socket over loopback: coalesced packets stay queued until the end of the tick and leave in one flush, uncoalesced ones leave right away
+static int LoopbackCoalesce(int32_t iBackend)
+{
+    TReactorCallbacks callbacks = {};
+    callbacks.on_accept = OnLoopbackAccept;
+
+    LPREACTOR reactor = reactor_new(&callbacks, iBackend);
+    if (!reactor || !reactor_listen(reactor, "127.0.0.1", 0))
+    {
+        return (EXIT_FAILURE);
+    }
+
+    int iSocket = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(reactor->listen_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    connect(iSocket, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+
+    for (int32_t i = 0; i < 100 && !s_pLoopbackConn; ++i)
+    {
+        reactor_poll(reactor, 10);
+    }
+
+    bool bOk = s_pLoopbackConn != nullptr;
+
+    if (bOk)
+    {
+        // a tick writing ten packets: nothing is sent until the flush, then all of it in one send
+        for (int32_t i = 0; i < 10; ++i)
+        {
+            reactor_send(s_pLoopbackConn, "0123456789", 10);
+        }
+
+        const int32_t iBeforeFlush = DrainClient(iSocket);
+        const int32_t iFlushed = reactor_flush_dirty(reactor);
+
+        int32_t iAfterFlush = 0;
+        for (int32_t i = 0; i < 100 && iAfterFlush < 100; ++i)
+        {
+            reactor_poll(reactor, 1);
+            iAfterFlush += DrainClient(iSocket);
+        }
+
+        std::cout << "coalesced: " << iBeforeFlush << " bytes before the flush, " << iFlushed << " connection flushed, " << iAfterFlush << " bytes after" << std::endl;
+        bOk = iBeforeFlush == 0 && iFlushed == 1 && iAfterFlush == 100;
+    }
+
+    // io_uring always queues until the flush
+    if (bOk && iBackend == REACTOR_BACKEND_EPOLL)
+    {
+        reactor_set_coalesce(reactor, false);
+        reactor_send(s_pLoopbackConn, "0123456789", 10);
+
+        const int32_t iImmediate = DrainClient(iSocket);
+        std::cout << "not coalesced: " << iImmediate << " bytes right after reactor_send" << std::endl;
+        bOk = iImmediate == 10;
+    }
+
+    close(iSocket);
+    reactor_delete(reactor);
+    s_pLoopbackConn = nullptr;
+
+    std::cout << (bOk ? "coalesce loopback ok" : "coalesce loopback failed") << std::endl;
+    return (bOk ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    // Measure the cache pollution of large copies instead of running the demo
+    if (argc > 1 && !strcmp(argv[1], "--bench-memcpy"))
+    {
+        return (BenchmarkMemcpy());
+    }
+
+#if defined(__linux__)
+    // Check the UDP channel over loopback
+    if (argc > 1 && !strcmp(argv[1], "--loopback-udp"))
+    {
+        return (LoopbackUdp());
+    }
+
+    // Check the end-of-tick output coalescing over loopback, "uring" for the io_uring backend
+    if (argc > 1 && !strcmp(argv[1], "--loopback-coalesce"))
+    {
+        return (LoopbackCoalesce((argc > 2 && !strcmp(argv[2], "uring")) ? REACTOR_BACKEND_URING : REACTOR_BACKEND_EPOLL));
+    }
+#endif
+
+    if (!CheckTempBufferRefill())
+    {
+        return (EXIT_FAILURE);
+    }
+
+    if (!CheckBufferChainDrain())
+    {
+        return (EXIT_FAILURE);
+    }
+
+    if (!CheckSharedBufferWrites())
+    {
+        return (EXIT_FAILURE);
+    }
+
     // Create new Buffer
     CTempBuffer buf;
 
     TPacketGCTest testPack;
-    testPack.iHeader = HEADER_GC_TEST;
+    testPack.bHeader = HEADER_GC_TEST;
     const char* playerName = "sharqawy";
     strncpy(testPack.szPlayerName, playerName, sizeof(testPack.szPlayerName));
 
-    buf.Write(testPack, sizeof(testPack));
+    TPacketGCTestSchema::Write(buf, testPack);
 
-    std::cout << "Buffer Size: " << buf.GetSize() << std::endl;
+    std::cout << "Buffer Size: " << buf.GetSize() << " (struct size: " << sizeof(testPack) << ")" << std::endl;
 
-    TPacketGCTest testPackReceived;
-    buf.Read(&testPackReceived, sizeof(testPackReceived));
+    CPacketDispatcher dispatcher;
+    dispatcher.Register(HEADER_GC_TEST, TPacketGCTestSchema::Size, OnTestPacket);
+
+    if (dispatcher.Process(buf.GetBuffer(), nullptr) != 1)
+    {
+        std::cout << "Failed to dispatch TPacketGCTest" << std::endl;
+        return (EXIT_FAILURE);
+    }
 
-    std::cout << "Header Num: " << testPackReceived.iHeader << std::endl;
-    std::cout << "Header szPlayerName:: " << testPackReceived.szPlayerName << std::endl;
     //buffer_write(buffer, str.c_str(), stringLen);
 
     // free the buffer before leaving the app
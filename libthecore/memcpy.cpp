@@ -1,5 +1,726 @@
 #include "stdafx.h" // For C++
+#include <chrono>
 
-#if !defined(_WIN64)
-void *(*thecore_memcpy) (void *to, const void *from, size_t len) = memcpy;
-#endif
\ No newline at end of file
+#if defined(CPU_X86_64)
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/* lets a function use AVX2/AVX-512 without building the whole file for it */
+#if defined(_MSC_VER)
+	#define MEMCPY_TARGET_AVX2
+	#define MEMCPY_TARGET_AVX512
+#else
+	#define MEMCPY_TARGET_AVX2 __attribute__((target("avx2")))
+	#define MEMCPY_TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+#endif
+
+/***
+ * memcpy_small - Copies up to 32 bytes.
+ * @d: The destination.
+ * @s: The source.
+ * @len: The size, at most 32.
+ *
+ * Two overlapping moves cover every size of a class (16-32, 8-15, 4-7,
+ * 2-3), so there is no loop and at most one branch per class. Packet
+ * headers and most fields go through here.
+ *
+ * Return: Nothing (void)
+ */
+static inline void memcpy_small(uint8_t* d, const uint8_t* s, size_t len)
+{
+	if (len >= 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)s);
+		__m128i b = _mm_loadu_si128((const __m128i*)(s + len - 16));
+		_mm_storeu_si128((__m128i*)d, a);
+		_mm_storeu_si128((__m128i*)(d + len - 16), b);
+	}
+	else if (len >= 8)
+	{
+		uint64_t a, b;
+		memcpy(&a, s, 8);
+		memcpy(&b, s + len - 8, 8);
+		memcpy(d, &a, 8);
+		memcpy(d + len - 8, &b, 8);
+	}
+	else if (len >= 4)
+	{
+		uint32_t a, b;
+		memcpy(&a, s, 4);
+		memcpy(&b, s + len - 4, 4);
+		memcpy(d, &a, 4);
+		memcpy(d + len - 4, &b, 4);
+	}
+	else if (len >= 2)
+	{
+		uint16_t a, b;
+		memcpy(&a, s, 2);
+		memcpy(&b, s + len - 2, 2);
+		memcpy(d, &a, 2);
+		memcpy(d + len - 2, &b, 2);
+	}
+	else if (len)
+	{
+		*d = *s;
+	}
+}
+
+/***
+ * memcpy_sse2 - Copies with 16 byte vectors.
+ * @to: The destination.
+ * @from: The source.
+ * @len: The size.
+ *
+ * Up to 64 bytes the head and the tail are copied overlapping. Longer
+ * copies align the destination, move 64 bytes per iteration and finish
+ * with the last 64 bytes, overlapping what the loop already wrote.
+ *
+ * Return: to
+ */
+static void* memcpy_sse2(void* to, const void* from, size_t len)
+{
+	uint8_t* d = (uint8_t*)to;
+	const uint8_t* s = (const uint8_t*)from;
+
+	if (len <= 32)
+	{
+		memcpy_small(d, s, len);
+		return (to);
+	}
+
+	if (len <= 64)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)s);
+		__m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(s + len - 32));
+		__m128i e = _mm_loadu_si128((const __m128i*)(s + len - 16));
+		_mm_storeu_si128((__m128i*)d, a);
+		_mm_storeu_si128((__m128i*)(d + 16), b);
+		_mm_storeu_si128((__m128i*)(d + len - 32), c);
+		_mm_storeu_si128((__m128i*)(d + len - 16), e);
+		return (to);
+	}
+
+	const __m128i head = _mm_loadu_si128((const __m128i*)s);
+	const size_t skip = 16 - ((uintptr_t)d & 15);
+
+	uint8_t* dd = d + skip;
+	const uint8_t* ss = s + skip;
+	size_t left = len - skip;
+
+	while (left > 64)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)ss);
+		__m128i b = _mm_loadu_si128((const __m128i*)(ss + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(ss + 32));
+		__m128i e = _mm_loadu_si128((const __m128i*)(ss + 48));
+		_mm_store_si128((__m128i*)dd, a);
+		_mm_store_si128((__m128i*)(dd + 16), b);
+		_mm_store_si128((__m128i*)(dd + 32), c);
+		_mm_store_si128((__m128i*)(dd + 48), e);
+
+		dd += 64;
+		ss += 64;
+		left -= 64;
+	}
+
+	__m128i a = _mm_loadu_si128((const __m128i*)(s + len - 64));
+	__m128i b = _mm_loadu_si128((const __m128i*)(s + len - 48));
+	__m128i c = _mm_loadu_si128((const __m128i*)(s + len - 32));
+	__m128i e = _mm_loadu_si128((const __m128i*)(s + len - 16));
+	_mm_storeu_si128((__m128i*)(d + len - 64), a);
+	_mm_storeu_si128((__m128i*)(d + len - 48), b);
+	_mm_storeu_si128((__m128i*)(d + len - 32), c);
+	_mm_storeu_si128((__m128i*)(d + len - 16), e);
+	_mm_storeu_si128((__m128i*)d, head);
+	return (to);
+}
+
+/***
+ * memcpy_avx2 - Copies with 32 byte vectors.
+ * @to: The destination.
+ * @from: The source.
+ * @len: The size.
+ *
+ * Same layout as memcpy_sse2, with overlapping copies up to 128 bytes and
+ * 128 bytes per iteration above.
+ *
+ * Return: to
+ */
+MEMCPY_TARGET_AVX2 static void* memcpy_avx2(void* to, const void* from, size_t len)
+{
+	uint8_t* d = (uint8_t*)to;
+	const uint8_t* s = (const uint8_t*)from;
+
+	if (len <= 32)
+	{
+		memcpy_small(d, s, len);
+		return (to);
+	}
+
+	if (len <= 64)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)s);
+		__m256i b = _mm256_loadu_si256((const __m256i*)(s + len - 32));
+		_mm256_storeu_si256((__m256i*)d, a);
+		_mm256_storeu_si256((__m256i*)(d + len - 32), b);
+		return (to);
+	}
+
+	if (len <= 128)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)s);
+		__m256i b = _mm256_loadu_si256((const __m256i*)(s + 32));
+		__m256i c = _mm256_loadu_si256((const __m256i*)(s + len - 64));
+		__m256i e = _mm256_loadu_si256((const __m256i*)(s + len - 32));
+		_mm256_storeu_si256((__m256i*)d, a);
+		_mm256_storeu_si256((__m256i*)(d + 32), b);
+		_mm256_storeu_si256((__m256i*)(d + len - 64), c);
+		_mm256_storeu_si256((__m256i*)(d + len - 32), e);
+		return (to);
+	}
+
+	if (len <= 256)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)s);
+		__m256i b = _mm256_loadu_si256((const __m256i*)(s + 32));
+		__m256i c = _mm256_loadu_si256((const __m256i*)(s + 64));
+		__m256i e = _mm256_loadu_si256((const __m256i*)(s + 96));
+		__m256i f = _mm256_loadu_si256((const __m256i*)(s + len - 128));
+		__m256i g = _mm256_loadu_si256((const __m256i*)(s + len - 96));
+		__m256i h = _mm256_loadu_si256((const __m256i*)(s + len - 64));
+		__m256i i = _mm256_loadu_si256((const __m256i*)(s + len - 32));
+		_mm256_storeu_si256((__m256i*)d, a);
+		_mm256_storeu_si256((__m256i*)(d + 32), b);
+		_mm256_storeu_si256((__m256i*)(d + 64), c);
+		_mm256_storeu_si256((__m256i*)(d + 96), e);
+		_mm256_storeu_si256((__m256i*)(d + len - 128), f);
+		_mm256_storeu_si256((__m256i*)(d + len - 96), g);
+		_mm256_storeu_si256((__m256i*)(d + len - 64), h);
+		_mm256_storeu_si256((__m256i*)(d + len - 32), i);
+		return (to);
+	}
+
+	const __m256i head = _mm256_loadu_si256((const __m256i*)s);
+	const size_t skip = 32 - ((uintptr_t)d & 31);
+
+	uint8_t* dd = d + skip;
+	const uint8_t* ss = s + skip;
+	size_t left = len - skip;
+
+	while (left > 128)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i*)ss);
+		__m256i b = _mm256_loadu_si256((const __m256i*)(ss + 32));
+		__m256i c = _mm256_loadu_si256((const __m256i*)(ss + 64));
+		__m256i e = _mm256_loadu_si256((const __m256i*)(ss + 96));
+		_mm256_store_si256((__m256i*)dd, a);
+		_mm256_store_si256((__m256i*)(dd + 32), b);
+		_mm256_store_si256((__m256i*)(dd + 64), c);
+		_mm256_store_si256((__m256i*)(dd + 96), e);
+
+		dd += 128;
+		ss += 128;
+		left -= 128;
+	}
+
+	__m256i a = _mm256_loadu_si256((const __m256i*)(s + len - 128));
+	__m256i b = _mm256_loadu_si256((const __m256i*)(s + len - 96));
+	__m256i c = _mm256_loadu_si256((const __m256i*)(s + len - 64));
+	__m256i e = _mm256_loadu_si256((const __m256i*)(s + len - 32));
+	_mm256_storeu_si256((__m256i*)(d + len - 128), a);
+	_mm256_storeu_si256((__m256i*)(d + len - 96), b);
+	_mm256_storeu_si256((__m256i*)(d + len - 64), c);
+	_mm256_storeu_si256((__m256i*)(d + len - 32), e);
+	_mm256_storeu_si256((__m256i*)d, head);
+	return (to);
+}
+
+/***
+ * memcpy_avx512 - Copies with 64 byte vectors.
+ * @to: The destination.
+ * @from: The source.
+ * @len: The size.
+ *
+ * Up to 64 bytes a single masked load and store copy exactly len bytes
+ * without touching the bytes around them. Above, same layout as
+ * memcpy_avx2 with 256 bytes per iteration.
+ *
+ * Return: to
+ */
+MEMCPY_TARGET_AVX512 static void* memcpy_avx512(void* to, const void* from, size_t len)
+{
+	uint8_t* d = (uint8_t*)to;
+	const uint8_t* s = (const uint8_t*)from;
+
+	if (len <= 64)
+	{
+		const __mmask64 mask = (len == 64) ? ~0ULL : ((1ULL << len) - 1);
+		_mm512_mask_storeu_epi8(d, mask, _mm512_maskz_loadu_epi8(mask, s));
+		return (to);
+	}
+
+	if (len <= 128)
+	{
+		__m512i a = _mm512_loadu_si512(s);
+		__m512i b = _mm512_loadu_si512(s + len - 64);
+		_mm512_storeu_si512(d, a);
+		_mm512_storeu_si512(d + len - 64, b);
+		return (to);
+	}
+
+	if (len <= 256)
+	{
+		__m512i a = _mm512_loadu_si512(s);
+		__m512i b = _mm512_loadu_si512(s + 64);
+		__m512i c = _mm512_loadu_si512(s + len - 128);
+		__m512i e = _mm512_loadu_si512(s + len - 64);
+		_mm512_storeu_si512(d, a);
+		_mm512_storeu_si512(d + 64, b);
+		_mm512_storeu_si512(d + len - 128, c);
+		_mm512_storeu_si512(d + len - 64, e);
+		return (to);
+	}
+
+	const __m512i head = _mm512_loadu_si512(s);
+	const size_t skip = 64 - ((uintptr_t)d & 63);
+
+	uint8_t* dd = d + skip;
+	const uint8_t* ss = s + skip;
+	size_t left = len - skip;
+
+	while (left > 256)
+	{
+		__m512i a = _mm512_loadu_si512(ss);
+		__m512i b = _mm512_loadu_si512(ss + 64);
+		__m512i c = _mm512_loadu_si512(ss + 128);
+		__m512i e = _mm512_loadu_si512(ss + 192);
+		_mm512_store_si512(dd, a);
+		_mm512_store_si512(dd + 64, b);
+		_mm512_store_si512(dd + 128, c);
+		_mm512_store_si512(dd + 192, e);
+
+		dd += 256;
+		ss += 256;
+		left -= 256;
+	}
+
+	__m512i a = _mm512_loadu_si512(s + len - 256);
+	__m512i b = _mm512_loadu_si512(s + len - 192);
+	__m512i c = _mm512_loadu_si512(s + len - 128);
+	__m512i e = _mm512_loadu_si512(s + len - 64);
+	_mm512_storeu_si512(d + len - 256, a);
+	_mm512_storeu_si512(d + len - 192, b);
+	_mm512_storeu_si512(d + len - 128, c);
+	_mm512_storeu_si512(d + len - 64, e);
+	_mm512_storeu_si512(d, head);
+	return (to);
+}
+
+/***
+ * memcpy_erms - Copies short blocks with AVX2 and long ones with rep movsb.
+ * @to: The destination.
+ * @from: The source.
+ * @len: The size.
+ *
+ * On CPUs with enhanced rep movsb the microcode moves whole cache lines
+ * and beats any vector loop once the copy is long enough to pay for its
+ * startup, which is the case for buffer reallocations but not packets.
+ *
+ * Return: to
+ */
+MEMCPY_TARGET_AVX2 static void* memcpy_erms(void* to, const void* from, size_t len)
+{
+	if (len < MEMCPY_ERMS_THRESHOLD)
+	{
+		return (memcpy_avx2(to, from, len));
+	}
+
+#if defined(_MSC_VER)
+	__movsb((unsigned char*)to, (const unsigned char*)from, len);
+#else
+	void* d = to;
+	__asm__ __volatile__("rep movsb" : "+D"(d), "+S"(from), "+c"(len) : : "memory");
+#endif
+	return (to);
+}
+
+/* how far ahead of the copy (in bytes) the streaming loop prefetches the source */
+#define MEMCPY_STREAM_PREFETCH 1024
+#endif
+
+/* the size from which thecore_memcpy_stream bypasses the caches */
+static size_t memcpy_stream_threshold = MEMCPY_STREAM_THRESHOLD;
+
+/***
+ * memcpy_libc - Copies with the C library.
+ * @to: The destination.
+ * @from: The source.
+ * @len: The size.
+ *
+ * Return: to
+ */
+static void* memcpy_libc(void* to, const void* from, size_t len)
+{
+	return (memcpy(to, from, len));
+}
+
+/* a kernel, the CPU features it needs and its name in THECORE_MEMCPY */
+typedef struct SMemcpyKernel
+{
+	int32_t kernel;
+	void *(*copy) (void* to, const void* from, size_t len);
+	uint32_t features;
+	const char* name;
+} TMemcpyKernel;
+
+static const TMemcpyKernel memcpy_kernels[] =
+{
+	{ MEMCPY_KERNEL_LIBC, memcpy_libc, 0, "libc" },
+#if defined(CPU_X86_64)
+	{ MEMCPY_KERNEL_SSE2, memcpy_sse2, CPU_FEATURE_SSE2, "sse2" },
+	{ MEMCPY_KERNEL_AVX2, memcpy_avx2, CPU_FEATURE_AVX2, "avx2" },
+	{ MEMCPY_KERNEL_AVX512, memcpy_avx512, CPU_FEATURE_AVX2 | CPU_FEATURE_AVX512F | CPU_FEATURE_AVX512BW, "avx512" },
+	{ MEMCPY_KERNEL_ERMS, memcpy_erms, CPU_FEATURE_AVX2 | CPU_FEATURE_ERMS, "erms" },
+#endif
+};
+
+/***
+ * memcpy_select_kernel - Picks the fastest kernel the CPU supports.
+ *
+ * AVX-512 is left out: the copies are too short to make up for the lower
+ * clock some CPUs run the whole core at once 512 bit instructions appear.
+ * THECORE_MEMCPY can still pick it.
+ *
+ * Return: The kernel.
+ */
+static int32_t memcpy_select_kernel()
+{
+#if defined(CPU_X86_64)
+	if (cpu_has_feature(CPU_FEATURE_AVX2 | CPU_FEATURE_ERMS))
+	{
+		return (MEMCPY_KERNEL_ERMS);
+	}
+
+	if (cpu_has_feature(CPU_FEATURE_AVX2))
+	{
+		return (MEMCPY_KERNEL_AVX2);
+	}
+
+	return (MEMCPY_KERNEL_SSE2);
+#else
+	return (MEMCPY_KERNEL_LIBC);
+#endif
+}
+
+/***
+ * thecore_memcpy_select - Points thecore_memcpy to a kernel.
+ * @iKernel: EMemcpyKernel.
+ *
+ * Return: true on success, false if the CPU doesn't support the kernel
+ * (thecore_memcpy is left as it was).
+ */
+bool thecore_memcpy_select(int32_t iKernel)
+{
+	if (iKernel == MEMCPY_KERNEL_AUTO)
+	{
+		iKernel = memcpy_select_kernel();
+	}
+
+	for (const TMemcpyKernel& kernel : memcpy_kernels)
+	{
+		if (kernel.kernel != iKernel)
+		{
+			continue;
+		}
+
+		if (!cpu_has_feature(kernel.features))
+		{
+			return (false);
+		}
+
+		thecore_memcpy = kernel.copy;
+		return (true);
+	}
+
+	return (false);
+}
+
+/***
+ * memcpy_resolve_kernel - Points thecore_memcpy to the kernel named by
+ * THECORE_MEMCPY, or to the best one if it is unset or can't be used.
+ *
+ * Return: Nothing (void)
+ */
+static void memcpy_resolve_kernel()
+{
+	const char* szKernel = getenv("THECORE_MEMCPY");
+
+	if (szKernel && *szKernel)
+	{
+		for (const TMemcpyKernel& kernel : memcpy_kernels)
+		{
+			if (!strcmp(kernel.name, szKernel) && thecore_memcpy_select(kernel.kernel))
+			{
+				return;
+			}
+		}
+
+		sys_err("THECORE_MEMCPY=%s is unknown or not supported by the CPU", szKernel);
+	}
+
+	thecore_memcpy_select(MEMCPY_KERNEL_AUTO);
+}
+
+/***
+ * memcpy_resolve - The first call of thecore_memcpy, which picks the kernel.
+ * @to: The destination.
+ * @from: The source.
+ * @len: The size.
+ *
+ * The pointer starts here rather than being set by a static initializer,
+ * so buffers copied by the static initializers of other files still go
+ * through the right kernel whatever order the files are initialized in.
+ *
+ * Return: to
+ */
+static void* memcpy_resolve(void* to, const void* from, size_t len)
+{
+	memcpy_resolve_kernel();
+	return (thecore_memcpy(to, from, len));
+}
+
+void *(*thecore_memcpy) (void *to, const void *from, size_t len) = memcpy_resolve;
+
+/***
+ * thecore_memcpy_kernel_name - Gets the name of the kernel thecore_memcpy points to.
+ *
+ * Return: "libc", "sse2", "avx2", "avx512", "erms" or "custom".
+ */
+const char* thecore_memcpy_kernel_name()
+{
+	if (thecore_memcpy == memcpy_resolve)
+	{
+		memcpy_resolve_kernel();
+	}
+
+	for (const TMemcpyKernel& kernel : memcpy_kernels)
+	{
+		if (thecore_memcpy == kernel.copy)
+		{
+			return (kernel.name);
+		}
+	}
+
+	return ("custom");
+}
+
+/***
+ * thecore_memcpy_stream - Copies a large block without filling the caches with it.
+ * @to: The destination.
+ * @from: The source.
+ * @len: The size.
+ *
+ * A multi-MB copy through the caches evicts the working set of the game
+ * loop for data that won't be touched again soon. From the stream
+ * threshold on, the destination is written with non-temporal stores and
+ * the source prefetched as non-temporal, so both mostly go around the
+ * caches. Smaller copies, and copies on CPUs other than x86-64, go through
+ * thecore_memcpy. The blocks must not overlap.
+ *
+ * Return: to
+ */
+void* thecore_memcpy_stream(void* to, const void* from, size_t len)
+{
+	if (len < memcpy_stream_threshold)
+	{
+		return (thecore_memcpy(to, from, len));
+	}
+
+#if defined(CPU_X86_64)
+	uint8_t* d = (uint8_t*)to;
+	const uint8_t* s = (const uint8_t*)from;
+
+	/* non-temporal stores need an aligned destination */
+	const size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+	thecore_memcpy(d, s, head);
+	d += head;
+	s += head;
+	len -= head;
+
+	while (len >= 64)
+	{
+		_mm_prefetch((const char*)s + MEMCPY_STREAM_PREFETCH, _MM_HINT_NTA);
+
+		__m128i a = _mm_loadu_si128((const __m128i*)s);
+		__m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(s + 32));
+		__m128i e = _mm_loadu_si128((const __m128i*)(s + 48));
+		_mm_stream_si128((__m128i*)d, a);
+		_mm_stream_si128((__m128i*)(d + 16), b);
+		_mm_stream_si128((__m128i*)(d + 32), c);
+		_mm_stream_si128((__m128i*)(d + 48), e);
+
+		d += 64;
+		s += 64;
+		len -= 64;
+	}
+
+	/* the streamed stores are weakly ordered, make them visible before the buffer is handed on */
+	_mm_sfence();
+	thecore_memcpy(d, s, len);
+	return (to);
+#else
+	return (thecore_memcpy(to, from, len));
+#endif
+}
+
+/***
+ * thecore_memcpy_set_stream_threshold - Sets the size from which thecore_memcpy_stream bypasses the caches.
+ * @len: The size in bytes, MEMCPY_STREAM_THRESHOLD by default. It should
+ *	stay above the last level cache share of a core, copies that fit in
+ *	it are faster through the caches.
+ *
+ * Return: Nothing (void)
+ */
+void thecore_memcpy_set_stream_threshold(size_t len)
+{
+	memcpy_stream_threshold = len;
+}
+
+/***
+ * memcpy_chase - Walks the hot set once.
+ * @hot: The hot set, one index per cache line linking all lines in a random cycle.
+ * @count: The amount of lines.
+ *
+ * Every access depends on the previous one, so the time of the walk is
+ * the sum of the access latencies and shows where the lines were.
+ *
+ * Return: The last index, so the walk can't be optimized away.
+ */
+static uint32_t memcpy_chase(const uint32_t* hot, size_t count)
+{
+	uint32_t dwIndex = 0;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		dwIndex = hot[dwIndex * 16];
+	}
+
+	return (dwIndex);
+}
+
+/***
+ * thecore_memcpy_measure_pollution - Measures what large copies cost a hot working set.
+ * @copy_size: The size of every copy, several MB to matter.
+ * @hot_size: The size of the hot set, e.g. what fits in L2.
+ * @iRounds: The amount of copies per mode.
+ * @result: Filled with the measures.
+ *
+ * Stands for a game loop whose state (the hot set) stays in the caches
+ * between ticks, while buffers grow in between. Each round warms the hot
+ * set, copies a block through the mode measured (no copy, thecore_memcpy,
+ * thecore_memcpy_stream) and times one walk of the hot set: the slower the
+ * walk, the more of it the copy evicted. The stream threshold is lowered
+ * to copy_size for the measure if needed.
+ *
+ * Return: true on success, false if the sizes are too small.
+ */
+bool thecore_memcpy_measure_pollution(size_t copy_size, size_t hot_size, int32_t iRounds, TMemcpyPollution* result)
+{
+	const size_t count = hot_size / 64;
+
+	if (count < 2 || copy_size == 0 || iRounds <= 0)
+	{
+		sys_err("thecore_memcpy_measure_pollution: nothing to measure (copy %zu, hot %zu, rounds %d)", copy_size, hot_size, iRounds);
+		return (false);
+	}
+
+	uint32_t* hot;
+	uint8_t* src;
+	uint8_t* dst;
+	CREATE(hot, uint32_t, count * 16);
+	CREATE(src, uint8_t, copy_size);
+	CREATE(dst, uint8_t, copy_size);
+
+	/* a single random cycle through all lines (Sattolo), so the prefetchers can't follow it */
+	uint32_t* order;
+	CREATE(order, uint32_t, count);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		order[i] = (uint32_t)i;
+	}
+
+	uint64_t qwSeed = 0x9E3779B97F4A7C15ULL;
+
+	for (size_t i = count - 1; i > 0; --i)
+	{
+		qwSeed ^= qwSeed << 13;
+		qwSeed ^= qwSeed >> 7;
+		qwSeed ^= qwSeed << 17;
+		std::swap(order[i], order[qwSeed % i]);
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		hot[order[i] * 16] = order[(i + 1) % count];
+	}
+
+	free(order);
+
+	/* the pages are touched once, so the first round doesn't pay for faulting them in */
+	memset(src, 1, copy_size);
+	memset(dst, 2, copy_size);
+
+	const size_t old_threshold = memcpy_stream_threshold;
+	memcpy_stream_threshold = std::min(memcpy_stream_threshold, copy_size);
+
+	double adHotNs[3] = {0, };
+	double adCopyNs[3] = {0, };
+	volatile uint32_t dwSink = 0;
+
+	for (int32_t iMode = 0; iMode < 3; ++iMode)
+	{
+		for (int32_t iRound = 0; iRound < iRounds; ++iRound)
+		{
+			dwSink = dwSink + memcpy_chase(hot, count);
+
+			std::chrono::steady_clock::time_point tCopy = std::chrono::steady_clock::now();
+
+			if (iMode == 1)
+			{
+				thecore_memcpy(dst, src, copy_size);
+			}
+			else if (iMode == 2)
+			{
+				thecore_memcpy_stream(dst, src, copy_size);
+			}
+
+			std::chrono::steady_clock::time_point tHot = std::chrono::steady_clock::now();
+			dwSink = dwSink + memcpy_chase(hot, count);
+			std::chrono::steady_clock::time_point tEnd = std::chrono::steady_clock::now();
+
+			adCopyNs[iMode] += std::chrono::duration<double, std::nano>(tHot - tCopy).count();
+			adHotNs[iMode] += std::chrono::duration<double, std::nano>(tEnd - tHot).count();
+		}
+	}
+
+	memcpy_stream_threshold = old_threshold;
+
+	result->copy_size = copy_size;
+	result->hot_size = count * 64;
+	result->hot_ns_idle = adHotNs[0] / ((double)iRounds * count);
+	result->hot_ns_memcpy = adHotNs[1] / ((double)iRounds * count);
+	result->hot_ns_stream = adHotNs[2] / ((double)iRounds * count);
+	result->copy_gbps_memcpy = (double)copy_size * iRounds / adCopyNs[1];
+	result->copy_gbps_stream = (double)copy_size * iRounds / adCopyNs[2];
+
+	free(dst);
+	free(src);
+	free(hot);
+	return (true);
+}
@@ -2,8 +2,77 @@
 
 #include "stdafx.h"
 
-#if defined(_WIN64)
-    #define thecore_memcpy memcpy
-#else
-    extern void *(*thecore_memcpy) (void *to, const void *from, size_t len);
-#endif
\ No newline at end of file
+/* Copy kernels thecore_memcpy can point to */
+enum EMemcpyKernel
+{
+	/* the best one the CPU supports */
+	MEMCPY_KERNEL_AUTO,
+
+	/* the C library memcpy */
+	MEMCPY_KERNEL_LIBC,
+
+	/* 16 byte vectors, any x86-64 CPU */
+	MEMCPY_KERNEL_SSE2,
+
+	/* 32 byte vectors */
+	MEMCPY_KERNEL_AVX2,
+
+	/* 64 byte vectors, masked loads and stores for the short copies */
+	MEMCPY_KERNEL_AVX512,
+
+	/* AVX2 for the short copies, rep movsb for the long ones */
+	MEMCPY_KERNEL_ERMS,
+};
+
+/* copies from this size (in bytes) on go through rep movsb in the ERMS kernel */
+#define MEMCPY_ERMS_THRESHOLD 2048
+
+/* default size (in bytes) from which thecore_memcpy_stream bypasses the caches */
+#define MEMCPY_STREAM_THRESHOLD (1024 * 1024)
+
+/***
+ * TMemcpyPollution - what a large copy costs the working set around it,
+ * see thecore_memcpy_measure_pollution.
+ */
+typedef struct SMemcpyPollution
+{
+	/* The size of every copy and of the hot working set, in bytes */
+	size_t copy_size;
+	size_t hot_size;
+
+	/* Nanoseconds per access to the hot set, with no copy before it */
+	double hot_ns_idle;
+
+	/* Nanoseconds per access to the hot set, after a copy through thecore_memcpy */
+	double hot_ns_memcpy;
+
+	/* Nanoseconds per access to the hot set, after a copy through thecore_memcpy_stream */
+	double hot_ns_stream;
+
+	/* The speed of both copies, in GB/s */
+	double copy_gbps_memcpy;
+	double copy_gbps_stream;
+} TMemcpyPollution;
+
+/***
+ * thecore_memcpy - copies memory like memcpy, through the kernel picked for
+ * the CPU on the first call. Every buffer operation copies through it.
+ * The THECORE_MEMCPY environment variable ("libc", "sse2", "avx2", "avx512"
+ * or "erms") overrides the choice, e.g. to compare kernels.
+ */
+extern void *(*thecore_memcpy) (void *to, const void *from, size_t len);
+
+/* Points thecore_memcpy to a kernel, false if the CPU doesn't support it */
+extern bool thecore_memcpy_select(int32_t iKernel);
+
+/* Gets the name of the kernel thecore_memcpy points to */
+extern const char* thecore_memcpy_kernel_name();
+
+/* Copies large blocks past the caches (non-temporal stores), smaller ones through thecore_memcpy */
+extern void* thecore_memcpy_stream(void* to, const void* from, size_t len);
+
+/* Sets the size from which thecore_memcpy_stream bypasses the caches */
+extern void thecore_memcpy_set_stream_threshold(size_t len);
+
+/* Measures how much slower a hot working set gets after large copies, with and without streaming */
+extern bool thecore_memcpy_measure_pollution(size_t copy_size, size_t hot_size, int32_t iRounds, TMemcpyPollution* result);
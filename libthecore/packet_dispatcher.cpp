@@ -0,0 +1,176 @@
+#include "stdafx.h"
+#include "packet_dispatcher.h"
+
+/***
+ * CPacketDispatcher::CPacketDispatcher - Constructor for the CPacketDispatcher class
+ *
+ * Starts with every header unknown.
+ *
+ * Return: Nothing (Constructor)
+ */
+CPacketDispatcher::CPacketDispatcher()
+{
+	memset(m_aHandlers, 0, sizeof(m_aHandlers));
+}
+
+/***
+ * CPacketDispatcher::Register - Registers a handler for fixed size packets
+ * @bHeader: The header of the packets
+ * @iSize: The size of the packets, header included
+ * @handler: The handler
+ *
+ * Return: true on success, false if the arguments are invalid.
+ */
+bool CPacketDispatcher::Register(uint8_t bHeader, int32_t iSize, TPacketHandlerFunc handler)
+{
+	if (!handler || iSize < 1)
+	{
+		sys_err("CPacketDispatcher::Register: invalid handler for header %u [Size: %d]", bHeader, iSize);
+		return (false);
+	}
+
+	m_aHandlers[bHeader].handler = handler;
+	m_aHandlers[bHeader].size = iSize;
+	m_aHandlers[bHeader].size_decoder = nullptr;
+	return (true);
+}
+
+/***
+ * CPacketDispatcher::Register - Registers a handler for variable size packets
+ * @bHeader: The header of the packets
+ * @size_decoder: Gets the size of a packet from its first bytes
+ * @handler: The handler
+ *
+ * Return: true on success, false if the arguments are invalid.
+ */
+bool CPacketDispatcher::Register(uint8_t bHeader, TPacketSizeDecoder size_decoder, TPacketHandlerFunc handler)
+{
+	if (!handler || !size_decoder)
+	{
+		sys_err("CPacketDispatcher::Register: invalid handler for header %u", bHeader);
+		return (false);
+	}
+
+	m_aHandlers[bHeader].handler = handler;
+	m_aHandlers[bHeader].size = 0;
+	m_aHandlers[bHeader].size_decoder = size_decoder;
+	return (true);
+}
+
+/***
+ * CPacketDispatcher::Unregister - Removes the handler of a header
+ * @bHeader: The header
+ *
+ * Packets with this header are reported as unknown afterwards.
+ *
+ * Return: Nothing (void)
+ */
+void CPacketDispatcher::Unregister(uint8_t bHeader)
+{
+	memset(&m_aHandlers[bHeader], 0, sizeof(TPacketHandler));
+}
+
+/***
+ * CPacketDispatcher::Dispatch - Handles every complete packet at the front of the data
+ * @pData: The received data
+ * @iLength: The amount of received data (in bytes)
+ * @pContext: Given to the handlers
+ * @piProcessed: If not nullptr, receives the amount of packets handled
+ *
+ * The packets are handled in one loop, a packet cut at the end of the data
+ * is left for the next call. Processing stops at an unknown header, at a
+ * malformed packet, or when a handler returns false.
+ *
+ * Return: The amount of bytes handled, or -1 if an unknown header or a
+ * malformed packet was met, in which case the stream can't be resynchronized.
+ */
+int32_t CPacketDispatcher::Dispatch(const void* pData, int32_t iLength, void* pContext, int32_t* piProcessed)
+{
+	const uint8_t* pbData = static_cast<const uint8_t*>(pData);
+	int32_t iOffset = 0;
+	int32_t iProcessed = 0;
+
+	while (iOffset < iLength)
+	{
+		const TPacketHandler& rHandler = m_aHandlers[pbData[iOffset]];
+		const int32_t iLeft = iLength - iOffset;
+		int32_t iSize = rHandler.size;
+
+		if (!rHandler.handler)
+		{
+			sys_err("CPacketDispatcher::Dispatch: unknown header %u [Offset: %d]", pbData[iOffset], iOffset);
+			iOffset = -1;
+			break;
+		}
+
+		if (rHandler.size_decoder)
+		{
+			iSize = rHandler.size_decoder(pbData + iOffset, iLeft);
+
+			if (iSize < 0)
+			{
+				sys_err("CPacketDispatcher::Dispatch: malformed packet, header %u [Offset: %d]", pbData[iOffset], iOffset);
+				iOffset = -1;
+				break;
+			}
+
+			/* can't tell the size yet, wait for more data */
+			if (iSize == 0)
+			{
+				break;
+			}
+		}
+
+		/* the packet is cut at the end of the data, wait for the rest */
+		if (iSize > iLeft)
+		{
+			break;
+		}
+
+		const bool bContinue = rHandler.handler(pContext, pbData + iOffset, iSize);
+
+		iOffset += iSize;
+		++iProcessed;
+
+		if (!bContinue)
+		{
+			break;
+		}
+	}
+
+	if (piProcessed)
+	{
+		*piProcessed = iProcessed;
+	}
+
+	return (iOffset);
+}
+
+/***
+ * CPacketDispatcher::Process - Handles every complete packet in the buffer and consumes them
+ * @buffer: The input buffer
+ * @pContext: Given to the handlers
+ *
+ * The handled packets are consumed with a single buffer_read_proceed, an
+ * incomplete packet stays at the front of the buffer for the next call.
+ *
+ * Return: The amount of packets handled, or -1 if an unknown header or a
+ * malformed packet was met (the connection should be closed).
+ */
+int32_t CPacketDispatcher::Process(LPBUFFER buffer, void* pContext)
+{
+	int32_t iProcessed = 0;
+	const int32_t iRead = Dispatch(buffer_read_peek(buffer), static_cast<int32_t>(buffer_size(buffer)), pContext, &iProcessed);
+
+	if (iRead < 0)
+	{
+		return (-1);
+	}
+
+	if (iRead > 0)
+	{
+		buffer_read_proceed(buffer, iRead);
+	}
+
+	return (iProcessed);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+/* amount of headers a dispatcher knows, one per value of the uint8_t header */
+#define PACKET_HEADER_MAX 256
+
+/***
+ * TPacketSizeDecoder - Gets the size of a variable sized packet
+ * @pData: The packet, starting at its header
+ * @iLength: The amount of received data (in bytes), at least 1
+ *
+ * Return: The size of the packet, 0 if it can't be told yet, or -1 if the data is malformed.
+ */
+typedef int32_t (*TPacketSizeDecoder)(const void* pData, int32_t iLength);
+
+/***
+ * TPacketHandlerFunc - Handles one complete packet
+ * @pContext: The context given to CPacketDispatcher::Process, e.g. the connection
+ * @pData: The packet, starting at its header. It points into the input buffer,
+ *	so the handler must not write to that buffer
+ * @iSize: The size of the packet (in bytes)
+ *
+ * Return: false to stop processing the buffer, e.g. when the connection is closed.
+ */
+typedef bool (*TPacketHandlerFunc)(void* pContext, const void* pData, int32_t iSize);
+
+/* An entry of the handler table */
+typedef struct SPacketHandler
+{
+	/* The handler, nullptr for unknown headers */
+	TPacketHandlerFunc handler;
+
+	/* The size of the packet, 0 when it has a size decoder */
+	int32_t size;
+
+	/* Gets the size of variable sized packets */
+	TPacketSizeDecoder size_decoder;
+} TPacketHandler;
+
+/***
+ * CPacketDispatcher - routes the packets of an input buffer to their handlers.
+ * The first byte of a packet is its header, which indexes a flat table of
+ * handlers, each with a fixed packet size or a size decoder.
+ */
+class CPacketDispatcher
+{
+public:
+	/* Constructor for the CPacketDispatcher class */
+	CPacketDispatcher();
+
+	/* Registers a handler for fixed size packets */
+	bool Register(uint8_t bHeader, int32_t iSize, TPacketHandlerFunc handler);
+
+	/* Registers a handler for variable size packets */
+	bool Register(uint8_t bHeader, TPacketSizeDecoder size_decoder, TPacketHandlerFunc handler);
+
+	/* Removes the handler of a header */
+	void Unregister(uint8_t bHeader);
+
+	/* Handles every complete packet at the front of the data */
+	int32_t Dispatch(const void* pData, int32_t iLength, void* pContext, int32_t* piProcessed = nullptr);
+
+	/* Handles every complete packet in the buffer and consumes them */
+	int32_t Process(LPBUFFER buffer, void* pContext);
+
+private:
+	/* the handlers, indexed by header */
+	TPacketHandler m_aHandlers[PACKET_HEADER_MAX];
+};
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <limits>
+
+/* largest encoded packet a schema may describe */
+#define PACKET_SCHEMA_MAX_SIZE 65535
+
+/***
+ * Packet schemas - compile-time descriptions of how a packet struct goes on the wire.
+ *
+ * A schema lists the members of a struct in wire order:
+ *
+ *	typedef TPacketSchema<TPacketGCTest,
+ *		TPacketFixed<&TPacketGCTest::bHeader>,
+ *		TPacketString<&TPacketGCTest::szPlayerName>> TPacketGCTestSchema;
+ *
+ * Fixed fields are copied as is, strings and arrays only send their used part
+ * behind a length prefix. The encoder and decoder are expanded per schema at
+ * compile time, there is no per-field dispatch at runtime. Encoding assembles
+ * the packet in a stack buffer of max_size bytes and hands it to buffer_write
+ * (or CTempBuffer::Write) in one call.
+ *
+ * Every field provides:
+ *	min_size / max_size - the least and most bytes it takes on the wire
+ *	Put(pData, packet) - writes the field at pData, returns the end of it
+ *	Get(pData, iSlack, packet) - reads the field at pData, returns the end of it.
+ *		iSlack is the amount of bytes available past the minimum size of the
+ *		packet, variable fields consume it. Returns nullptr if the field is
+ *		not complete yet, with iSlack set to -1 if the field is malformed.
+ *	Skip(pData, iSlack) - as Get, without copying the field anywhere.
+ */
+
+/* Splits a pointer to member into its class and member type */
+template <typename M>
+struct TPacketMemberTraits;
+
+template <typename C, typename M>
+struct TPacketMemberTraits<M C::*>
+{
+	typedef C Class;
+	typedef M Type;
+};
+
+/* Picks the smallest unsigned type able to hold iMax */
+template <size_t iMax>
+using TPacketLength = typename std::conditional<(iMax <= 0xFF), uint8_t,
+	typename std::conditional<(iMax <= 0xFFFF), uint16_t, uint32_t>::type>::type;
+
+/***
+ * TPacketFixed - a member sent byte for byte, e.g. the header or an integer.
+ * The copies have a compile-time size, so memcpy is used instead of
+ * thecore_memcpy to let the compiler turn them into plain moves.
+ */
+template <auto Member>
+struct TPacketFixed
+{
+	typedef typename TPacketMemberTraits<decltype(Member)>::Class Class;
+	typedef typename TPacketMemberTraits<decltype(Member)>::Type Type;
+
+	static_assert(std::is_trivially_copyable<Type>::value, "TPacketFixed: the member must be trivially copyable");
+
+	static constexpr size_t min_size = sizeof(Type);
+	static constexpr size_t max_size = sizeof(Type);
+
+	static char* Put(char* pData, const Class& packet)
+	{
+		std::memcpy(pData, &(packet.*Member), sizeof(Type));
+		return (pData + sizeof(Type));
+	}
+
+	static const char* Get(const char* pData, int32_t& /* iSlack */, Class& packet)
+	{
+		std::memcpy(&(packet.*Member), pData, sizeof(Type));
+		return (pData + sizeof(Type));
+	}
+
+	static const char* Skip(const char* pData, int32_t& /* iSlack */)
+	{
+		return (pData + sizeof(Type));
+	}
+};
+
+/***
+ * TPacketString - a char array holding a null terminated string. Only the
+ * characters are sent, behind a length prefix sized for the array. The
+ * decoded string is always null terminated.
+ */
+template <auto Member>
+struct TPacketString
+{
+	typedef typename TPacketMemberTraits<decltype(Member)>::Class Class;
+	typedef typename TPacketMemberTraits<decltype(Member)>::Type Type;
+
+	static_assert(std::is_array<Type>::value && std::is_same<typename std::remove_extent<Type>::type, char>::value,
+		"TPacketString: the member must be a char array");
+
+	/* the last char is kept for the null terminator */
+	static constexpr size_t max_length = std::extent<Type>::value - 1;
+
+	typedef TPacketLength<max_length> Length;
+
+	static constexpr size_t min_size = sizeof(Length);
+	static constexpr size_t max_size = sizeof(Length) + max_length;
+
+	static char* Put(char* pData, const Class& packet)
+	{
+		const Length length = static_cast<Length>(strnlen(packet.*Member, max_length));
+
+		std::memcpy(pData, &length, sizeof(Length));
+		std::memcpy(pData + sizeof(Length), packet.*Member, length);
+		return (pData + sizeof(Length) + length);
+	}
+
+	static const char* Skip(const char* pData, int32_t& iSlack)
+	{
+		Length length;
+		std::memcpy(&length, pData, sizeof(Length));
+
+		if (length > max_length)
+		{
+			iSlack = -1;
+			return (nullptr);
+		}
+
+		if (static_cast<int32_t>(length) > iSlack)
+		{
+			return (nullptr);
+		}
+
+		iSlack -= length;
+		return (pData + sizeof(Length) + length);
+	}
+
+	static const char* Get(const char* pData, int32_t& iSlack, Class& packet)
+	{
+		const char* pEnd = Skip(pData, iSlack);
+
+		if (pEnd)
+		{
+			const size_t length = pEnd - pData - sizeof(Length);
+
+			std::memcpy(packet.*Member, pData + sizeof(Length), length);
+			(packet.*Member)[length] = '\0';
+		}
+
+		return (pEnd);
+	}
+};
+
+/***
+ * TPacketArray - a fixed capacity array of which only the first *CountMember
+ * elements are sent. The count member is the length prefix, so it must not
+ * also be listed as a TPacketFixed field.
+ */
+template <auto Member, auto CountMember>
+struct TPacketArray
+{
+	typedef typename TPacketMemberTraits<decltype(Member)>::Class Class;
+	typedef typename TPacketMemberTraits<decltype(Member)>::Type Type;
+	typedef typename TPacketMemberTraits<decltype(CountMember)>::Type Length;
+	typedef typename std::remove_extent<Type>::type Element;
+
+	static_assert(std::is_array<Type>::value, "TPacketArray: the member must be an array");
+	static_assert(std::is_same<Class, typename TPacketMemberTraits<decltype(CountMember)>::Class>::value,
+		"TPacketArray: the count must be a member of the same packet");
+	static_assert(std::is_integral<Length>::value && std::is_unsigned<Length>::value, "TPacketArray: the count must be an unsigned integer");
+	static_assert(std::is_trivially_copyable<Element>::value, "TPacketArray: the elements must be trivially copyable");
+
+	static constexpr size_t capacity = std::extent<Type>::value;
+
+	static_assert(capacity <= static_cast<size_t>(std::numeric_limits<Length>::max()), "TPacketArray: the count can't hold the capacity");
+
+	static constexpr size_t min_size = sizeof(Length);
+	static constexpr size_t max_size = sizeof(Length) + capacity * sizeof(Element);
+
+	static char* Put(char* pData, const Class& packet)
+	{
+		const Length count = std::min<Length>(packet.*CountMember, static_cast<Length>(capacity));
+
+		std::memcpy(pData, &count, sizeof(Length));
+		std::memcpy(pData + sizeof(Length), packet.*Member, count * sizeof(Element));
+		return (pData + sizeof(Length) + count * sizeof(Element));
+	}
+
+	static const char* Skip(const char* pData, int32_t& iSlack)
+	{
+		Length count;
+		std::memcpy(&count, pData, sizeof(Length));
+
+		if (count > capacity)
+		{
+			iSlack = -1;
+			return (nullptr);
+		}
+
+		const int32_t iBytes = static_cast<int32_t>(count * sizeof(Element));
+
+		if (iBytes > iSlack)
+		{
+			return (nullptr);
+		}
+
+		iSlack -= iBytes;
+		return (pData + sizeof(Length) + iBytes);
+	}
+
+	static const char* Get(const char* pData, int32_t& iSlack, Class& packet)
+	{
+		const char* pEnd = Skip(pData, iSlack);
+
+		if (pEnd)
+		{
+			std::memcpy(&(packet.*CountMember), pData, sizeof(Length));
+			std::memcpy(packet.*Member, pData + sizeof(Length), pEnd - pData - sizeof(Length));
+		}
+
+		return (pEnd);
+	}
+};
+
+/***
+ * TPacketSchema - the wire layout of packet struct T, made of the given fields.
+ */
+template <typename T, typename... Fields>
+struct TPacketSchema
+{
+	typedef T Packet;
+
+	static_assert(sizeof...(Fields) > 0, "TPacketSchema: a packet needs at least one field");
+	static_assert((std::is_same<typename Fields::Class, T>::value && ...), "TPacketSchema: every field must be a member of the packet");
+
+	static constexpr size_t min_size = (Fields::min_size + ...);
+	static constexpr size_t max_size = (Fields::max_size + ...);
+
+	static_assert(max_size <= PACKET_SCHEMA_MAX_SIZE, "TPacketSchema: the packet can't be larger than PACKET_SCHEMA_MAX_SIZE");
+
+	/***
+	 * Encode - Encodes a packet to memory
+	 * @pData: Memory of at least max_size bytes
+	 * @packet: The packet to encode
+	 *
+	 * Return: The amount of bytes written.
+	 */
+	static int32_t Encode(void* pData, const T& packet)
+	{
+		char* pStart = static_cast<char*>(pData);
+		char* pEnd = pStart;
+
+		((pEnd = Fields::Put(pEnd, packet)), ...);
+		return (static_cast<int32_t>(pEnd - pStart));
+	}
+
+	/***
+	 * Decode - Decodes a packet from memory
+	 * @pData: The received data
+	 * @iLength: The amount of received data (in bytes)
+	 * @packet: The packet to fill
+	 *
+	 * Return: The amount of bytes the packet took, 0 if it is not complete yet,
+	 * or -1 if the data is malformed.
+	 */
+	static int32_t Decode(const void* pData, int32_t iLength, T& packet)
+	{
+		if (iLength < static_cast<int32_t>(min_size))
+		{
+			return (0);
+		}
+
+		const char* pStart = static_cast<const char*>(pData);
+		const char* pEnd = pStart;
+		int32_t iSlack = iLength - static_cast<int32_t>(min_size);
+
+		if (!((pEnd = Fields::Get(pEnd, iSlack, packet)) && ...))
+		{
+			return ((iSlack < 0) ? -1 : 0);
+		}
+
+		return (static_cast<int32_t>(pEnd - pStart));
+	}
+
+	/***
+	 * Size - Gets the size of the encoded packet at the front of the data, without decoding it
+	 * @pData: The received data
+	 * @iLength: The amount of received data (in bytes)
+	 *
+	 * Usable as the size decoder of a CPacketDispatcher.
+	 *
+	 * Return: The size of the packet, 0 if it is not complete yet, or -1 if the data is malformed.
+	 */
+	static int32_t Size(const void* pData, int32_t iLength)
+	{
+		if (iLength < static_cast<int32_t>(min_size))
+		{
+			return (0);
+		}
+
+		const char* pStart = static_cast<const char*>(pData);
+		const char* pEnd = pStart;
+		int32_t iSlack = iLength - static_cast<int32_t>(min_size);
+
+		if (!((pEnd = Fields::Skip(pEnd, iSlack)) && ...))
+		{
+			return ((iSlack < 0) ? -1 : 0);
+		}
+
+		return (static_cast<int32_t>(pEnd - pStart));
+	}
+
+	/***
+	 * Write - Encodes a packet and writes it to a buffer
+	 * @buffer: The buffer to write to, it grows when needed
+	 * @packet: The packet to encode
+	 *
+	 * Return: The amount of bytes written.
+	 */
+	static int32_t Write(LPBUFFER& buffer, const T& packet)
+	{
+		char acData[max_size];
+		const int32_t iSize = Encode(acData, packet);
+
+		buffer_write(buffer, acData, iSize);
+		return (iSize);
+	}
+
+	/***
+	 * Write - Encodes a packet and writes it to a CTempBuffer
+	 * @buf: The CTempBuffer to write to
+	 * @packet: The packet to encode
+	 *
+	 * Return: The amount of bytes written.
+	 */
+	static int32_t Write(CTempBuffer& buf, const T& packet)
+	{
+		char acData[max_size];
+		const int32_t iSize = Encode(acData, packet);
+
+		buf.Write(acData, iSize);
+		return (iSize);
+	}
+
+	/***
+	 * Read - Decodes a packet from the front of a buffer and consumes it
+	 * @buffer: The buffer to read from, nothing is consumed unless the packet is complete
+	 * @packet: The packet to fill
+	 *
+	 * Return: The amount of bytes read, 0 if the packet is not complete yet,
+	 * or -1 if the data is malformed.
+	 */
+	static int32_t Read(LPBUFFER buffer, T& packet)
+	{
+		const int32_t iRead = Decode(buffer_read_peek(buffer), static_cast<int32_t>(buffer_size(buffer)), packet);
+
+		if (iRead > 0)
+		{
+			buffer_read_proceed(buffer, iRead);
+		}
+
+		return (iRead);
+	}
+
+	/***
+	 * Read - Decodes a packet from the front of a CTempBuffer and consumes it
+	 * @buf: The CTempBuffer to read from, nothing is consumed unless the packet is complete
+	 * @packet: The packet to fill
+	 *
+	 * Return: The amount of bytes read, 0 if the packet is not complete yet,
+	 * or -1 if the data is malformed.
+	 */
+	static int32_t Read(CTempBuffer& buf, T& packet)
+	{
+		return (Read(buf.GetBuffer(), packet));
+	}
+};
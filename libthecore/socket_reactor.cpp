@@ -0,0 +1,1204 @@
+#include "stdafx.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* the events of a connection, registered once: with edge triggering there is no re-arming */
+#define REACTOR_CONN_EVENTS (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET)
+
+/* the output queued by every connection of the process (in bytes), and its peak */
+static std::atomic<int64_t> reactor_output_total(0);
+static std::atomic<int64_t> reactor_output_peak(0);
+
+/* the global output budget, see reactor_set_global_output_budget */
+static std::atomic<int64_t> reactor_output_global_limit(REACTOR_OUTPUT_GLOBAL_LIMIT);
+
+/***
+ * reactor_set_nonblock - Makes a socket non-blocking.
+ * @fd: The socket.
+ *
+ * Return: true on success, false otherwise.
+ */
+static bool reactor_set_nonblock(socket_t fd)
+{
+	const int iFlags = fcntl(fd, F_GETFL, 0);
+
+	if (iFlags < 0 || fcntl(fd, F_SETFL, iFlags | O_NONBLOCK) < 0)
+	{
+		sys_err("reactor_set_nonblock: fcntl failed, Error[%d] : %s", errno, strerror(errno));
+		return (false);
+	}
+
+	return (true);
+}
+
+/***
+ * reactor_new - Creates a reactor.
+ * @callbacks: What to call on socket events, copied.
+ * @iBackend: EReactorBackend, io_uring falls back to epoll when the kernel lacks it.
+ *
+ * Return: The new reactor, or nullptr if epoll can't be created.
+ */
+LPREACTOR reactor_new(const TReactorCallbacks* callbacks, int32_t iBackend)
+{
+	if (iBackend == REACTOR_BACKEND_URING)
+	{
+		TReactorUring* uring = reactor_uring_new();
+
+		if (uring)
+		{
+			LPREACTOR reactor;
+			CREATE(reactor, TReactor, 1);
+
+			reactor->backend = REACTOR_BACKEND_URING;
+			reactor->epoll_fd = -1;
+			reactor->uring = uring;
+			reactor->listen_fd = -1;
+			reactor->wake_fd = -1;
+			reactor->coalesce = true;
+			reactor->callbacks = *callbacks;
+			reactor->max_input = REACTOR_MAX_INPUT;
+			reactor->output_soft_limit = REACTOR_OUTPUT_SOFT_LIMIT;
+			reactor->output_hard_limit = REACTOR_OUTPUT_HARD_LIMIT;
+			reactor->output_policy = REACTOR_OUTPUT_DROP_LOW | REACTOR_OUTPUT_COALESCE;
+
+			return (reactor);
+		}
+
+		sys_log(0, "reactor_new: falling back to epoll");
+	}
+
+	const int32_t iEpollFd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (iEpollFd < 0)
+	{
+		sys_err("reactor_new: epoll_create1 failed, Error[%d] : %s", errno, strerror(errno));
+		return (nullptr);
+	}
+
+	LPREACTOR reactor;
+	CREATE(reactor, TReactor, 1);
+
+	reactor->backend = REACTOR_BACKEND_EPOLL;
+	reactor->epoll_fd = iEpollFd;
+	reactor->listen_fd = -1;
+	reactor->wake_fd = -1;
+	reactor->coalesce = true;
+	reactor->callbacks = *callbacks;
+	reactor->max_input = REACTOR_MAX_INPUT;
+	reactor->output_soft_limit = REACTOR_OUTPUT_SOFT_LIMIT;
+	reactor->output_hard_limit = REACTOR_OUTPUT_HARD_LIMIT;
+	reactor->output_policy = REACTOR_OUTPUT_DROP_LOW | REACTOR_OUTPUT_COALESCE;
+
+	return (reactor);
+}
+
+/***
+ * reactor_free_closed - Frees the connections closed since the last call.
+ * @reactor: The reactor.
+ *
+ * A connection the kernel still has operations of, or still queued for
+ * submission (io_uring backend), is kept until the next call after that.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_free_closed(LPREACTOR reactor)
+{
+	LPREACTORCONN* link = &reactor->closed;
+
+	while (*link)
+	{
+		LPREACTORCONN conn = *link;
+
+		if (conn->pending_ops > 0 || (conn->flags & REACTOR_CONN_DIRTY))
+		{
+			link = &conn->next_closed;
+			continue;
+		}
+
+		*link = conn->next_closed;
+
+		if (conn->sending)
+		{
+			buffer_delete(conn->sending);
+		}
+
+		for (int32_t i = 0; i < conn->state_count; ++i)
+		{
+			buffer_delete(conn->states[i].data);
+		}
+
+		reactor_output_total.fetch_sub(conn->output_accounted, std::memory_order_relaxed);
+
+		free(conn->states);
+		buffer_delete(conn->input);
+		buffer_delete(conn->output);
+		free(conn);
+	}
+}
+
+/***
+ * reactor_delete - Closes every connection and frees the reactor.
+ * @reactor: The reactor.
+ *
+ * on_close is called for the connections still open.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_delete(LPREACTOR reactor)
+{
+	while (reactor->conns)
+	{
+		reactor_close(reactor->conns);
+	}
+
+	/* every connection is closing, nothing is left to flush */
+	while (reactor->dirty)
+	{
+		reactor->dirty->flags &= ~REACTOR_CONN_DIRTY;
+		reactor->dirty = reactor->dirty->next_dirty;
+	}
+
+	if (reactor->listen_fd >= 0)
+	{
+		close(reactor->listen_fd);
+		reactor->listen_fd = -1;
+	}
+
+	if (reactor->uring)
+	{
+		reactor_uring_delete(reactor);
+	}
+
+	reactor_free_closed(reactor);
+
+	if (reactor->wake_fd >= 0)
+	{
+		close(reactor->wake_fd);
+	}
+
+	if (reactor->epoll_fd >= 0)
+	{
+		close(reactor->epoll_fd);
+	}
+
+	free(reactor);
+}
+
+/***
+ * reactor_listen - Starts accepting connections.
+ * @reactor: The reactor.
+ * @szHost: The address to bind to, nullptr for any.
+ * @wPort: The port to bind to, 0 for any (see listen_port).
+ * @iBacklog: The length of the queue of pending connections.
+ * @bReusePort: Let other sockets bind to the same port (SO_REUSEPORT), the
+ *	kernel then spreads the incoming connections over them.
+ *
+ * Return: true on success, false otherwise.
+ */
+bool reactor_listen(LPREACTOR reactor, const char* szHost, uint16_t wPort, int32_t iBacklog, bool bReusePort)
+{
+	if (reactor->listen_fd >= 0)
+	{
+		sys_err("reactor_listen: the reactor is already listening on port %u", reactor->listen_port);
+		return (false);
+	}
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(wPort);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (szHost && inet_pton(AF_INET, szHost, &addr.sin_addr) != 1)
+	{
+		sys_err("reactor_listen: invalid address %s", szHost);
+		return (false);
+	}
+
+	const socket_t fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	if (fd < 0)
+	{
+		sys_err("reactor_listen: socket failed, Error[%d] : %s", errno, strerror(errno));
+		return (false);
+	}
+
+	const int iOn = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &iOn, sizeof(iOn));
+
+	if (bReusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &iOn, sizeof(iOn)) < 0)
+	{
+		sys_err("reactor_listen: SO_REUSEPORT failed, Error[%d] : %s", errno, strerror(errno));
+		close(fd);
+		return (false);
+	}
+
+	socklen_t iAddrLength = sizeof(addr);
+	if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, iBacklog) < 0 || getsockname(fd, (sockaddr*)&addr, &iAddrLength) < 0)
+	{
+		sys_err("reactor_listen: can't listen on %s:%u, Error[%d] : %s", szHost ? szHost : "*", wPort, errno, strerror(errno));
+		close(fd);
+		return (false);
+	}
+
+	reactor->listen_fd = fd;
+	reactor->listen_port = ntohs(addr.sin_port);
+
+	if (reactor->backend == REACTOR_BACKEND_URING)
+	{
+		if (!reactor_uring_listen(reactor))
+		{
+			reactor->listen_fd = -1;
+			close(fd);
+			return (false);
+		}
+
+		return (true);
+	}
+
+	/* level triggered, so connections left pending (e.g. out of descriptors) are retried next poll */
+	epoll_event event;
+	event.events = EPOLLIN;
+	event.data.ptr = nullptr;
+
+	if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+	{
+		sys_err("reactor_listen: epoll_ctl failed, Error[%d] : %s", errno, strerror(errno));
+		reactor->listen_fd = -1;
+		close(fd);
+		return (false);
+	}
+
+	return (true);
+}
+
+/***
+ * reactor_set_wakeup - Lets other threads wake the reactor up.
+ * @reactor: The reactor.
+ * @on_wake: Called by reactor_poll, on the thread of the reactor, after a reactor_wakeup.
+ *
+ * Wakeups are coalesced: several reactor_wakeup calls before the reactor
+ * notices them lead to a single on_wake call.
+ *
+ * Return: true on success, false otherwise.
+ */
+bool reactor_set_wakeup(LPREACTOR reactor, void (*on_wake)(LPREACTOR reactor))
+{
+	if (reactor->wake_fd >= 0)
+	{
+		reactor->on_wake = on_wake;
+		return (true);
+	}
+
+	const int32_t fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (fd < 0)
+	{
+		sys_err("reactor_set_wakeup: eventfd failed, Error[%d] : %s", errno, strerror(errno));
+		return (false);
+	}
+
+	reactor->wake_fd = fd;
+	reactor->on_wake = on_wake;
+
+	if (reactor->backend == REACTOR_BACKEND_URING)
+	{
+		if (reactor_uring_watch_wakeup(reactor))
+		{
+			return (true);
+		}
+	}
+	else
+	{
+		/* the reactor itself marks the eventfd among the events */
+		epoll_event event;
+		event.events = EPOLLIN;
+		event.data.ptr = reactor;
+
+		if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0)
+		{
+			return (true);
+		}
+
+		sys_err("reactor_set_wakeup: epoll_ctl failed, Error[%d] : %s", errno, strerror(errno));
+	}
+
+	close(fd);
+	reactor->wake_fd = -1;
+	reactor->on_wake = nullptr;
+	return (false);
+}
+
+/***
+ * reactor_wakeup - Wakes the reactor up.
+ * @reactor: The reactor, reactor_set_wakeup was called on it.
+ *
+ * Safe to call from any thread.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_wakeup(LPREACTOR reactor)
+{
+	const uint64_t qwOne = 1;
+
+	/* EAGAIN means the counter is saturated, the reactor is woken up anyway */
+	if (write(reactor->wake_fd, &qwOne, sizeof(qwOne)) < 0 && errno != EAGAIN)
+	{
+		sys_err("reactor_wakeup: write failed, Error[%d] : %s", errno, strerror(errno));
+	}
+}
+
+/***
+ * reactor_woken - Resets the wakeup eventfd and calls on_wake.
+ * @reactor: The reactor.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_woken(LPREACTOR reactor)
+{
+	uint64_t qwCount;
+
+	/* reset before on_wake, so a wakeup sent meanwhile is not lost */
+	if (read(reactor->wake_fd, &qwCount, sizeof(qwCount)) < 0 && errno != EAGAIN)
+	{
+		sys_err("reactor_woken: read failed, Error[%d] : %s", errno, strerror(errno));
+	}
+
+	if (reactor->on_wake)
+	{
+		reactor->on_wake(reactor);
+	}
+}
+
+/***
+ * reactor_attach - Adds a connected socket to the reactor.
+ * @reactor: The reactor.
+ * @fd: The socket, the reactor takes it over and makes it non-blocking.
+ *
+ * Return: The connection, or nullptr on failure (the socket is closed).
+ */
+LPREACTORCONN reactor_attach(LPREACTOR reactor, socket_t fd)
+{
+	if (!reactor_set_nonblock(fd))
+	{
+		close(fd);
+		return (nullptr);
+	}
+
+	const int iOn = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &iOn, sizeof(iOn));
+
+	LPREACTORCONN conn;
+	CREATE(conn, TReactorConn, 1);
+
+	conn->fd = fd;
+	conn->reactor = reactor;
+	conn->input = buffer_new(REACTOR_READ_SIZE);
+	conn->output = buffer_new(REACTOR_OUTPUT_SIZE);
+
+	if (reactor->backend == REACTOR_BACKEND_URING)
+	{
+		if (!reactor_uring_attach(conn))
+		{
+			close(fd);
+			buffer_delete(conn->input);
+			buffer_delete(conn->output);
+			free(conn);
+			return (nullptr);
+		}
+	}
+	else
+	{
+		epoll_event event;
+		event.events = REACTOR_CONN_EVENTS;
+		event.data.ptr = conn;
+
+		if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+		{
+			sys_err("reactor_attach: epoll_ctl failed, Error[%d] : %s", errno, strerror(errno));
+			close(fd);
+			buffer_delete(conn->input);
+			buffer_delete(conn->output);
+			free(conn);
+			return (nullptr);
+		}
+	}
+
+	conn->next = reactor->conns;
+	if (reactor->conns)
+	{
+		reactor->conns->prev = conn;
+	}
+
+	reactor->conns = conn;
+	++reactor->conn_count;
+	return (conn);
+}
+
+/***
+ * reactor_close - Closes a connection.
+ * @conn: The connection.
+ * @iError: 0 for an orderly close, or the errno value that caused it.
+ *
+ * The output still queued is sent if the socket accepts it right away, then
+ * on_close is called and the socket closed. The connection is freed at the
+ * end of the current (or next) reactor_poll, so it can be closed from a
+ * callback. With io_uring the socket is shut down first, which completes the
+ * operations in flight, and the connection is freed once they have.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_close(LPREACTORCONN conn, int32_t iError)
+{
+	if (conn->flags & REACTOR_CONN_CLOSING)
+	{
+		return;
+	}
+
+	LPREACTOR reactor = conn->reactor;
+
+	if (iError == 0 && !(conn->flags & REACTOR_CONN_BLOCKED) && !conn->sending && conn->output->length > 0)
+	{
+		send(conn->fd, buffer_read_peek(conn->output), conn->output->length, MSG_NOSIGNAL);
+	}
+
+	conn->flags |= REACTOR_CONN_CLOSING;
+
+	if (reactor->callbacks.on_close)
+	{
+		reactor->callbacks.on_close(conn, iError);
+	}
+
+	if (reactor->backend == REACTOR_BACKEND_URING)
+	{
+		shutdown(conn->fd, SHUT_RDWR);
+	}
+	else
+	{
+		epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+	}
+
+	close(conn->fd);
+	conn->fd = -1;
+
+	if (conn->prev)
+	{
+		conn->prev->next = conn->next;
+	}
+	else
+	{
+		reactor->conns = conn->next;
+	}
+
+	if (conn->next)
+	{
+		conn->next->prev = conn->prev;
+	}
+
+	--reactor->conn_count;
+
+	conn->next_closed = reactor->closed;
+	reactor->closed = conn;
+}
+
+/***
+ * reactor_flush - Sends the queued data of a connection until the socket refuses more.
+ * @conn: The connection.
+ *
+ * Data is sent straight from the unread part of the output buffer. When the
+ * socket is full the connection waits for epoll to report it writable.
+ * With io_uring the output is only marked dirty for the next reactor_poll.
+ *
+ * Return: The amount of bytes sent, or -1 if the connection was closed.
+ */
+int32_t reactor_flush(LPREACTORCONN conn)
+{
+	int32_t iSent = 0;
+
+	if (conn->reactor->backend == REACTOR_BACKEND_URING)
+	{
+		reactor_mark_dirty(conn);
+		return (0);
+	}
+
+	if (conn->flags & (REACTOR_CONN_CLOSING | REACTOR_CONN_BLOCKED))
+	{
+		return (0);
+	}
+
+	reactor_release_states(conn);
+
+	while (conn->output->length > 0)
+	{
+		const ssize_t iResult = send(conn->fd, buffer_read_peek(conn->output), conn->output->length, MSG_NOSIGNAL);
+
+		if (iResult > 0)
+		{
+			buffer_read_proceed(conn->output, (int32_t)iResult);
+			iSent += (int32_t)iResult;
+
+			/* the output went under budget, the updates held back follow it */
+			if (conn->state_count > 0)
+			{
+				reactor_release_states(conn);
+			}
+
+			continue;
+		}
+
+		if (iResult < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (iResult < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			conn->flags |= REACTOR_CONN_BLOCKED;
+			break;
+		}
+
+		reactor_close(conn, errno);
+		return (-1);
+	}
+
+	reactor_account_output(conn);
+	return (iSent);
+}
+
+/***
+ * reactor_output_queued - Gets the output a connection has queued.
+ * @conn: The connection.
+ *
+ * Return: The unsent output, in flight or held back included (in bytes).
+ */
+int32_t reactor_output_queued(LPREACTORCONN conn)
+{
+	return (conn->output->length + (conn->sending ? conn->sending->length : 0) + conn->state_bytes);
+}
+
+/***
+ * reactor_account_output - Updates the global count of queued output.
+ * @conn: The connection, its output changed.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_account_output(LPREACTORCONN conn)
+{
+	const int32_t iQueued = reactor_output_queued(conn);
+	const int32_t iDelta = iQueued - conn->output_accounted;
+
+	if (iDelta == 0)
+	{
+		return;
+	}
+
+	conn->output_accounted = iQueued;
+
+	const int64_t llTotal = reactor_output_total.fetch_add(iDelta, std::memory_order_relaxed) + iDelta;
+	int64_t llPeak = reactor_output_peak.load(std::memory_order_relaxed);
+
+	while (llTotal > llPeak && !reactor_output_peak.compare_exchange_weak(llPeak, llTotal, std::memory_order_relaxed))
+	{
+	}
+}
+
+/* What reactor_admit_output decided */
+enum EReactorAdmit
+{
+	REACTOR_ADMIT_CLOSED = -1,
+	REACTOR_ADMIT_DROP,
+	REACTOR_ADMIT_WRITE,
+	REACTOR_ADMIT_OVER_BUDGET,
+};
+
+/***
+ * reactor_admit_output - Applies the output budget to a packet about to be queued.
+ * @conn: The connection.
+ * @iLength: The size of the packet (in bytes).
+ * @iPriority: EReactorPriority of the packet.
+ *
+ * A packet taking the connection over its hard limit closes it, and so
+ * does any packet of a connection over its soft limit while the process
+ * is over the global budget: the slow clients pay for the memory, not the
+ * others. A packet keeping the connection under its soft limit is always
+ * written, even over the global budget. Otherwise the output policy
+ * decides.
+ *
+ * Return: EReactorAdmit.
+ */
+static int32_t reactor_admit_output(LPREACTORCONN conn, int32_t iLength, int32_t iPriority)
+{
+	LPREACTOR reactor = conn->reactor;
+	const int32_t iQueued = reactor_output_queued(conn);
+	const bool bGlobal = reactor_output_total.load(std::memory_order_relaxed) + iLength > reactor_output_global_limit.load(std::memory_order_relaxed);
+
+	if (iQueued + iLength > reactor->output_hard_limit || (bGlobal && iQueued > reactor->output_soft_limit))
+	{
+		sys_err("reactor_admit_output: closing fd %d with %d bytes of output queued", conn->fd, iQueued);
+		++reactor->output_stats.disconnects;
+		reactor_close(conn, ENOBUFS);
+		return (REACTOR_ADMIT_CLOSED);
+	}
+
+	/* the global budget only ever costs the connections over their soft limit */
+	if (iQueued + iLength <= reactor->output_soft_limit)
+	{
+		return (REACTOR_ADMIT_WRITE);
+	}
+
+	if (reactor->output_policy & REACTOR_OUTPUT_DISCONNECT)
+	{
+		++reactor->output_stats.disconnects;
+		reactor_close(conn, ENOBUFS);
+		return (REACTOR_ADMIT_CLOSED);
+	}
+
+	if (iPriority == REACTOR_PRIORITY_LOW && (reactor->output_policy & REACTOR_OUTPUT_DROP_LOW))
+	{
+		++reactor->output_stats.dropped_packets;
+		reactor->output_stats.dropped_bytes += iLength;
+		return (REACTOR_ADMIT_DROP);
+	}
+
+	return (REACTOR_ADMIT_OVER_BUDGET);
+}
+
+/***
+ * reactor_release_states - Moves the held back state updates to the output once it is under budget.
+ * @conn: The connection.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_release_states(LPREACTORCONN conn)
+{
+	if (conn->state_count == 0 || reactor_output_queued(conn) - conn->state_bytes >= conn->reactor->output_soft_limit)
+	{
+		return;
+	}
+
+	for (int32_t i = 0; i < conn->state_count; ++i)
+	{
+		LPBUFFER data = conn->states[i].data;
+
+		buffer_write(conn->output, buffer_read_peek(data), data->length);
+		buffer_delete(data);
+	}
+
+	conn->state_count = 0;
+	conn->state_bytes = 0;
+}
+
+/***
+ * reactor_mark_dirty - Queues the output of a connection for the end-of-tick flush.
+ * @conn: The connection.
+ *
+ * For code writing to conn->output directly (e.g. a packet schema or a
+ * CTempBuffer) instead of through reactor_send. Such writes bypass the
+ * output policy, only the hard limit is checked here.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_mark_dirty(LPREACTORCONN conn)
+{
+	if (conn->flags & REACTOR_CONN_CLOSING)
+	{
+		return;
+	}
+
+	LPREACTOR reactor = conn->reactor;
+
+	reactor_account_output(conn);
+
+	if (conn->output_accounted > reactor->output_hard_limit)
+	{
+		sys_err("reactor_mark_dirty: closing fd %d with %d bytes of output queued", conn->fd, conn->output_accounted);
+		++reactor->output_stats.disconnects;
+		reactor_close(conn, ENOBUFS);
+		return;
+	}
+
+	if (conn->flags & REACTOR_CONN_DIRTY)
+	{
+		return;
+	}
+
+	conn->flags |= REACTOR_CONN_DIRTY;
+	conn->next_dirty = reactor->dirty;
+	reactor->dirty = conn;
+}
+
+/***
+ * reactor_flush_dirty - Sends the output of every connection marked dirty.
+ * @reactor: The reactor.
+ *
+ * reactor_poll calls it before it waits and once the events are handled,
+ * so the packets the game systems write during a tick leave in one send
+ * per connection (one TCP segment when they fit) rather than one each.
+ * A server whose tick runs outside of reactor_poll can call it at the end
+ * of its tick. With io_uring the sends are submitted without waiting.
+ *
+ * Return: The amount of connections flushed.
+ */
+int32_t reactor_flush_dirty(LPREACTOR reactor)
+{
+	if (reactor->backend == REACTOR_BACKEND_URING)
+	{
+		return (reactor_uring_flush(reactor));
+	}
+
+	int32_t iFlushed = 0;
+
+	while (reactor->dirty)
+	{
+		LPREACTORCONN conn = reactor->dirty;
+		reactor->dirty = conn->next_dirty;
+		conn->flags &= ~REACTOR_CONN_DIRTY;
+
+		if (!(conn->flags & REACTOR_CONN_CLOSING))
+		{
+			reactor_flush(conn);
+			++iFlushed;
+		}
+	}
+
+	return (iFlushed);
+}
+
+/***
+ * reactor_set_coalesce - Chooses when reactor_send sends.
+ * @reactor: The reactor.
+ * @bCoalesce: true to queue until the end of the tick (the default), false to send right away.
+ *
+ * The io_uring backend always queues.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_set_coalesce(LPREACTOR reactor, bool bCoalesce)
+{
+	reactor->coalesce = bCoalesce;
+}
+
+/***
+ * reactor_set_output_budget - Sets the output budget of the connections of a reactor.
+ * @reactor: The reactor.
+ * @iSoftLimit: The queued output above which the policy applies (in bytes).
+ * @iHardLimit: The queued output that closes a connection (in bytes).
+ * @iPolicy: EReactorOutputPolicy flags.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_set_output_budget(LPREACTOR reactor, int32_t iSoftLimit, int32_t iHardLimit, int32_t iPolicy)
+{
+	reactor->output_soft_limit = iSoftLimit;
+	reactor->output_hard_limit = std::max(iSoftLimit, iHardLimit);
+	reactor->output_policy = iPolicy;
+}
+
+/***
+ * reactor_set_global_output_budget - Sets the output budget of all the connections of the process.
+ * @llLimit: The queued output (in bytes) above which the connections over their soft limit are closed.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_set_global_output_budget(int64_t llLimit)
+{
+	reactor_output_global_limit.store(llLimit, std::memory_order_relaxed);
+}
+
+/***
+ * reactor_get_output_stats - Gets what the output budgets did.
+ * @reactor: The reactor.
+ * @pStats: Filled with the counters of the reactor and the global queued bytes.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_get_output_stats(LPREACTOR reactor, TReactorOutputStats* pStats)
+{
+	*pStats = reactor->output_stats;
+	pStats->queued_bytes = reactor_output_total.load(std::memory_order_relaxed);
+	pStats->peak_bytes = reactor_output_peak.load(std::memory_order_relaxed);
+}
+
+/***
+ * reactor_send - Queues data on a connection.
+ * @conn: The connection.
+ * @pData: The data.
+ * @iLength: The amount of data (in bytes).
+ *
+ * The data is sent by reactor_flush_dirty at the end of the tick, or right
+ * away if coalescing is off.
+ *
+ * Return: true on success, false if the connection is closed.
+ */
+bool reactor_send(LPREACTORCONN conn, const void* pData, int32_t iLength)
+{
+	return (reactor_send_priority(conn, pData, iLength, REACTOR_PRIORITY_NORMAL));
+}
+
+/***
+ * reactor_send_state - Queues a state update.
+ * @conn: The connection.
+ * @dwKey: What the update is about, e.g. the entity id and the kind of state.
+ * @pData: The packet.
+ * @iLength: The size of the packet (in bytes).
+ *
+ * Sent like any packet while the connection is under budget. Over it, with
+ * REACTOR_OUTPUT_COALESCE, the update is held back and a newer update with
+ * the same key replaces it, so a stalled client holds one update per key
+ * rather than every update since it stalled. The held back updates follow
+ * the output once it is under budget again.
+ *
+ * Return: true on success (held back or replaced included), false if the connection is closed.
+ */
+bool reactor_send_state(LPREACTORCONN conn, uint32_t dwKey, const void* pData, int32_t iLength)
+{
+	if (conn->flags & REACTOR_CONN_CLOSING)
+	{
+		return (false);
+	}
+
+	LPREACTOR reactor = conn->reactor;
+
+	/* an update already held back is replaced even under budget, so it can't follow a newer one */
+	for (int32_t i = 0; i < conn->state_count; ++i)
+	{
+		TReactorStateUpdate* state = &conn->states[i];
+
+		if (state->key != dwKey)
+		{
+			continue;
+		}
+
+		conn->state_bytes += iLength - state->data->length;
+		buffer_reset(state->data);
+		buffer_write(state->data, pData, iLength);
+		++reactor->output_stats.coalesced;
+
+		reactor_mark_dirty(conn);
+		return (!(conn->flags & REACTOR_CONN_CLOSING));
+	}
+
+	const int32_t iAdmit = reactor_admit_output(conn, iLength, REACTOR_PRIORITY_NORMAL);
+
+	if (iAdmit == REACTOR_ADMIT_CLOSED)
+	{
+		return (false);
+	}
+
+	if (iAdmit != REACTOR_ADMIT_OVER_BUDGET || !(reactor->output_policy & REACTOR_OUTPUT_COALESCE))
+	{
+		return (reactor_send_priority(conn, pData, iLength, REACTOR_PRIORITY_NORMAL));
+	}
+
+	if (conn->state_count == conn->state_capacity)
+	{
+		TReactorStateUpdate* states;
+		const int32_t iCapacity = std::max(16, conn->state_capacity * 2);
+
+		CREATE(states, TReactorStateUpdate, iCapacity);
+
+		if (conn->state_count > 0)
+		{
+			memcpy(states, conn->states, conn->state_count * sizeof(TReactorStateUpdate));
+		}
+
+		free(conn->states);
+		conn->states = states;
+		conn->state_capacity = iCapacity;
+	}
+
+	TReactorStateUpdate* state = &conn->states[conn->state_count++];
+	state->key = dwKey;
+	state->data = buffer_new(iLength);
+	buffer_write(state->data, pData, iLength);
+	conn->state_bytes += iLength;
+
+	reactor_mark_dirty(conn);
+	return (!(conn->flags & REACTOR_CONN_CLOSING));
+}
+
+/***
+ * reactor_send_priority - Queues a packet of a given priority.
+ * @conn: The connection.
+ * @pData: The packet.
+ * @iLength: The size of the packet (in bytes).
+ * @iPriority: EReactorPriority.
+ *
+ * Over budget, with REACTOR_OUTPUT_DROP_LOW, a low priority packet is
+ * dropped. See reactor_admit_output for when the connection is closed.
+ *
+ * Return: true on success (dropped included), false if the connection is closed.
+ */
+bool reactor_send_priority(LPREACTORCONN conn, const void* pData, int32_t iLength, int32_t iPriority)
+{
+	if (conn->flags & REACTOR_CONN_CLOSING)
+	{
+		return (false);
+	}
+
+	const int32_t iAdmit = reactor_admit_output(conn, iLength, iPriority);
+
+	if (iAdmit == REACTOR_ADMIT_CLOSED)
+	{
+		return (false);
+	}
+
+	if (iAdmit == REACTOR_ADMIT_DROP)
+	{
+		return (true);
+	}
+
+	buffer_write(conn->output, pData, iLength);
+
+	if (conn->reactor->coalesce || conn->reactor->backend == REACTOR_BACKEND_URING)
+	{
+		reactor_mark_dirty(conn);
+		return (true);
+	}
+
+	return (reactor_flush(conn) >= 0);
+}
+
+/***
+ * reactor_deliver - Hands the received data of a connection to on_read.
+ * @conn: The connection.
+ *
+ * Return: true if the connection is still open.
+ */
+bool reactor_deliver(LPREACTORCONN conn)
+{
+	LPREACTOR reactor = conn->reactor;
+
+	if (reactor->callbacks.on_read && !reactor->callbacks.on_read(conn))
+	{
+		reactor_close(conn);
+		return (false);
+	}
+
+	return (!(conn->flags & REACTOR_CONN_CLOSING));
+}
+
+/***
+ * reactor_read - Receives everything the socket holds.
+ * @conn: The connection.
+ * @bHangup: The peer shut its side down, read until the end of the stream.
+ *
+ * Edge triggering reports new data once, so the socket is read until it
+ * would block. Data is received straight into the free space of the input
+ * buffer, which is compacted or grown to keep REACTOR_READ_SIZE bytes free.
+ * on_read is called once per batch, or earlier when the input fills up.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_read(LPREACTORCONN conn, bool bHangup)
+{
+	LPREACTOR reactor = conn->reactor;
+	bool bEnd = false;
+
+	for (;;)
+	{
+		if (buffer_has_space(conn->input) < REACTOR_READ_SIZE)
+		{
+			if (conn->input->length >= reactor->max_input)
+			{
+				/* let the handler drain the input before reading on */
+				if (!reactor_deliver(conn))
+				{
+					return;
+				}
+
+				if (conn->input->length >= reactor->max_input)
+				{
+					sys_err("reactor_read: input of fd %d is over %d bytes", conn->fd, reactor->max_input);
+					reactor_close(conn, EMSGSIZE);
+					return;
+				}
+			}
+
+			buffer_adjust_size(conn->input, REACTOR_READ_SIZE);
+		}
+
+		const int32_t iSpace = buffer_has_space(conn->input);
+		const ssize_t iResult = recv(conn->fd, buffer_write_peek(conn->input), iSpace, 0);
+
+		if (iResult > 0)
+		{
+			buffer_write_proceed(conn->input, (int32_t)iResult);
+
+			/* a short read drained the socket, new data will raise a new edge */
+			if (iResult < iSpace && !bHangup)
+			{
+				break;
+			}
+
+			continue;
+		}
+
+		if (iResult == 0)
+		{
+			bEnd = true;
+			break;
+		}
+
+		if (errno == EINTR)
+		{
+			continue;
+		}
+
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			break;
+		}
+
+		reactor_close(conn, errno);
+		return;
+	}
+
+	if (conn->input->length > 0 && !reactor_deliver(conn))
+	{
+		return;
+	}
+
+	if (bEnd)
+	{
+		reactor_close(conn);
+	}
+}
+
+/***
+ * reactor_accept - Accepts the pending connections.
+ * @reactor: The reactor.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_accept(LPREACTOR reactor)
+{
+	for (;;)
+	{
+		const socket_t fd = accept4(reactor->listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+			{
+				continue;
+			}
+
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				sys_err("reactor_accept: accept4 failed, Error[%d] : %s", errno, strerror(errno));
+			}
+
+			return;
+		}
+
+		LPREACTORCONN conn = reactor_attach(reactor, fd);
+
+		if (conn && reactor->callbacks.on_accept && !reactor->callbacks.on_accept(conn))
+		{
+			reactor_close(conn);
+		}
+	}
+}
+
+/***
+ * reactor_poll - Waits for socket events and handles them.
+ * @reactor: The reactor.
+ * @iTimeoutMS: The longest time to wait (in milliseconds), -1 to wait until an event.
+ *
+ * Pending connections are accepted, received data is handed to on_read and
+ * blocked output is sent again once the socket is writable. The output
+ * queued by the callbacks is flushed once every event is handled, and the
+ * connections closed during the poll are freed before it returns.
+ *
+ * Return: The amount of events handled, or -1 if epoll failed.
+ */
+int32_t reactor_poll(LPREACTOR reactor, int32_t iTimeoutMS)
+{
+	if (reactor->backend == REACTOR_BACKEND_URING)
+	{
+		const int32_t iHandled = reactor_uring_poll(reactor, iTimeoutMS);
+		reactor_free_closed(reactor);
+		return (iHandled);
+	}
+
+	/* the output written since the last poll */
+	reactor_flush_dirty(reactor);
+
+	epoll_event aEvents[REACTOR_MAX_EVENTS];
+	const int32_t iCount = epoll_wait(reactor->epoll_fd, aEvents, REACTOR_MAX_EVENTS, iTimeoutMS);
+
+	if (iCount < 0)
+	{
+		if (errno == EINTR)
+		{
+			return (0);
+		}
+
+		sys_err("reactor_poll: epoll_wait failed, Error[%d] : %s", errno, strerror(errno));
+		return (-1);
+	}
+
+	for (int32_t i = 0; i < iCount; ++i)
+	{
+		const uint32_t dwEvents = aEvents[i].events;
+		LPREACTORCONN conn = (LPREACTORCONN)aEvents[i].data.ptr;
+
+		if (!conn)
+		{
+			reactor_accept(reactor);
+			continue;
+		}
+
+		if (aEvents[i].data.ptr == reactor)
+		{
+			reactor_woken(reactor);
+			continue;
+		}
+
+		/* closed by an earlier event of this batch */
+		if (conn->flags & REACTOR_CONN_CLOSING)
+		{
+			continue;
+		}
+
+		if (dwEvents & EPOLLERR)
+		{
+			int iError = 0;
+			socklen_t iLength = sizeof(iError);
+			getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &iError, &iLength);
+			reactor_close(conn, iError ? iError : EIO);
+			continue;
+		}
+
+		if (dwEvents & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))
+		{
+			reactor_read(conn, (dwEvents & (EPOLLRDHUP | EPOLLHUP)) != 0);
+
+			if (conn->flags & REACTOR_CONN_CLOSING)
+			{
+				continue;
+			}
+		}
+
+		if (dwEvents & EPOLLOUT)
+		{
+			conn->flags &= ~REACTOR_CONN_BLOCKED;
+			reactor_flush(conn);
+		}
+	}
+
+	/* the output written by this poll's callbacks */
+	reactor_flush_dirty(reactor);
+
+	reactor_free_closed(reactor);
+	return (iCount);
+}
+#endif
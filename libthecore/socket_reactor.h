@@ -0,0 +1,304 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__linux__)
+
+#include <sys/socket.h>
+
+/* free space guaranteed in the input buffer before each recv */
+#define REACTOR_READ_SIZE 16384
+
+/* initial size of the output buffer of a connection */
+#define REACTOR_OUTPUT_SIZE 16384
+
+/* a connection whose unprocessed input reaches this size is closed */
+#define REACTOR_MAX_INPUT (1024 * 1024)
+
+/* most events handled by a single reactor_poll */
+#define REACTOR_MAX_EVENTS 256
+
+/* queued output above which a connection is slow and its output policy applies */
+#define REACTOR_OUTPUT_SOFT_LIMIT (256 * 1024)
+
+/* queued output a connection is closed at, whatever its policy */
+#define REACTOR_OUTPUT_HARD_LIMIT (4 * 1024 * 1024)
+
+/* queued output of all the connections of the process above which the slow ones are closed */
+#define REACTOR_OUTPUT_GLOBAL_LIMIT (512ll * 1024 * 1024)
+
+/* How a reactor talks to the kernel */
+enum EReactorBackend
+{
+	/* edge-triggered epoll and plain recv/send calls */
+	REACTOR_BACKEND_EPOLL,
+
+	/* io_uring with multishot receives and batched sends, see socket_uring.h */
+	REACTOR_BACKEND_URING,
+};
+
+/* How much a packet matters when the output of its connection is over budget */
+enum EReactorPriority
+{
+	/* can be dropped, e.g. chat of others or effects */
+	REACTOR_PRIORITY_LOW,
+
+	/* must arrive */
+	REACTOR_PRIORITY_NORMAL,
+};
+
+/* What happens to a connection whose output is over the soft limit (flags) */
+enum EReactorOutputPolicy
+{
+	/* low priority packets are dropped */
+	REACTOR_OUTPUT_DROP_LOW = (1 << 0),
+
+	/* state updates replace the unsent one with the same key, see reactor_send_state */
+	REACTOR_OUTPUT_COALESCE = (1 << 1),
+
+	/* the connection is closed */
+	REACTOR_OUTPUT_DISCONNECT = (1 << 2),
+};
+
+/* Flags of a connection */
+enum EReactorConnFlags
+{
+	/* reactor_close was called, the connection is freed at the end of the poll */
+	REACTOR_CONN_CLOSING = (1 << 0),
+
+	/* the socket refused data, sending resumes when epoll reports it writable */
+	REACTOR_CONN_BLOCKED = (1 << 1),
+
+	/* the output is queued for the end-of-tick flush, see reactor_flush_dirty */
+	REACTOR_CONN_DIRTY = (1 << 2),
+
+	/* a send is in flight, the next one is prepared when it completes (io_uring backend) */
+	REACTOR_CONN_SENDING = (1 << 3),
+};
+
+typedef struct SReactor TReactor;
+typedef TReactor* LPREACTOR;
+
+typedef struct SReactorConn TReactorConn;
+typedef TReactorConn* LPREACTORCONN;
+
+/***
+ * TReactorStateUpdate - a state update held back while its connection is
+ * over budget, replaced by newer updates with the same key.
+ */
+typedef struct SReactorStateUpdate
+{
+	/* What the update is about, e.g. the entity id and the kind of state */
+	uint32_t key;
+
+	/* The packet */
+	LPBUFFER data;
+} TReactorStateUpdate;
+
+/***
+ * TReactorOutputStats - what the output budgets did.
+ */
+typedef struct SReactorOutputStats
+{
+	/* Output queued by every connection of the process now, and at most (in bytes) */
+	int64_t queued_bytes;
+	int64_t peak_bytes;
+
+	/* Low priority packets dropped, and their size */
+	uint64_t dropped_packets;
+	uint64_t dropped_bytes;
+
+	/* State updates replaced by a newer one before they were sent */
+	uint64_t coalesced;
+
+	/* Connections closed for their output */
+	uint64_t disconnects;
+} TReactorOutputStats;
+
+/***
+ * TReactorCallbacks - what the reactor calls on socket events.
+ * Any of them can be nullptr.
+ */
+typedef struct SReactorCallbacks
+{
+	/* A connection was accepted, e.g. to set its user_data. Returns false to refuse it */
+	bool (*on_accept)(LPREACTORCONN conn);
+
+	/* New data was received into conn->input, the callback consumes the whole
+	 * packets it holds. Returns false to close the connection */
+	bool (*on_read)(LPREACTORCONN conn);
+
+	/* The connection is being closed, iError is 0 for an orderly close or an errno value.
+	 * Called once, conn stays valid until the end of the current reactor_poll */
+	void (*on_close)(LPREACTORCONN conn, int32_t iError);
+
+	/* Free for the user, e.g. the server object */
+	void* context;
+} TReactorCallbacks;
+
+/***
+ * TReactorConn - a non-blocking socket of a reactor with its input and
+ * output buffers. Data is received straight into the free space of input
+ * and sent straight from the unread data of output.
+ */
+struct SReactorConn
+{
+	/* The socket */
+	socket_t fd;
+
+	/* The received data not processed yet */
+	LPBUFFER input;
+
+	/* The data not sent yet */
+	LPBUFFER output;
+
+	/* The reactor the connection belongs to */
+	LPREACTOR reactor;
+
+	/* EReactorConnFlags */
+	int32_t flags;
+
+	/* Free for the user, e.g. the session or the character */
+	void* user_data;
+
+	/* The previous and next live connections of the reactor */
+	LPREACTORCONN prev;
+	LPREACTORCONN next;
+
+	/* The next connection waiting to be freed */
+	LPREACTORCONN next_closed;
+
+	/* The next connection with output queued for the end-of-tick flush */
+	LPREACTORCONN next_dirty;
+
+	/* The output handed to the kernel and not completed yet (io_uring backend) */
+	LPBUFFER sending;
+
+	/* The operations in flight, the connection is freed once there are none */
+	int32_t pending_ops;
+
+	/* The state updates held back while over budget, in the order of their first update */
+	TReactorStateUpdate* states;
+	int32_t state_count;
+	int32_t state_capacity;
+	int32_t state_bytes;
+
+	/* The queued output last added to the global count (in bytes) */
+	int32_t output_accounted;
+};
+
+/***
+ * TReactor - an event loop over a listening socket and its connections.
+ * A reactor is used by a single thread.
+ */
+struct SReactor
+{
+	/* EReactorBackend, the one in use after a fallback */
+	int32_t backend;
+
+	/* The epoll instance (epoll backend) */
+	int32_t epoll_fd;
+
+	/* The ring (io_uring backend) */
+	struct SReactorUring* uring;
+
+	/* The listening socket, -1 if there is none */
+	socket_t listen_fd;
+
+	/* The port the listening socket is bound to */
+	uint16_t listen_port;
+
+	/* What to call on socket events */
+	TReactorCallbacks callbacks;
+
+	/* The live connections */
+	LPREACTORCONN conns;
+
+	/* The amount of live connections */
+	int32_t conn_count;
+
+	/* The closed connections, freed at the end of reactor_poll */
+	LPREACTORCONN closed;
+
+	/* The connections with output queued for the end-of-tick flush */
+	LPREACTORCONN dirty;
+
+	/* reactor_send queues instead of sending (epoll backend, io_uring always queues) */
+	bool coalesce;
+
+	/* The amount of unprocessed input that closes a connection */
+	int32_t max_input;
+
+	/* The output budget of each connection (in bytes) and EReactorOutputPolicy */
+	int32_t output_soft_limit;
+	int32_t output_hard_limit;
+	int32_t output_policy;
+
+	/* What the output budgets of the reactor did, queued_bytes and peak_bytes aside */
+	TReactorOutputStats output_stats;
+
+	/* The eventfd other threads wake the reactor through, -1 until reactor_set_wakeup */
+	int32_t wake_fd;
+
+	/* Called by reactor_poll after the reactor was woken up */
+	void (*on_wake)(LPREACTOR reactor);
+};
+
+/* Creates a reactor */
+extern LPREACTOR reactor_new(const TReactorCallbacks* callbacks, int32_t iBackend = REACTOR_BACKEND_EPOLL);
+
+/* Closes every connection and frees the reactor */
+extern void reactor_delete(LPREACTOR reactor);
+
+/* Starts accepting connections */
+extern bool reactor_listen(LPREACTOR reactor, const char* szHost, uint16_t wPort, int32_t iBacklog = SOMAXCONN, bool bReusePort = false);
+
+/* Lets other threads wake the reactor up, on_wake is called from reactor_poll */
+extern bool reactor_set_wakeup(LPREACTOR reactor, void (*on_wake)(LPREACTOR reactor));
+
+/* Wakes the reactor up, from any thread */
+extern void reactor_wakeup(LPREACTOR reactor);
+
+/* Adds a connected socket to the reactor */
+extern LPREACTORCONN reactor_attach(LPREACTOR reactor, socket_t fd);
+
+/* Waits for socket events and handles them */
+extern int32_t reactor_poll(LPREACTOR reactor, int32_t iTimeoutMS);
+
+/* Queues data on a connection, sent at the end of the tick (or right away without coalescing) */
+extern bool reactor_send(LPREACTORCONN conn, const void* pData, int32_t iLength);
+
+/* Queues a packet of the given EReactorPriority, dropped if low and the connection is over budget */
+extern bool reactor_send_priority(LPREACTORCONN conn, const void* pData, int32_t iLength, int32_t iPriority);
+
+/* Queues a state update, replacing the unsent one with the same key while the connection is over budget */
+extern bool reactor_send_state(LPREACTORCONN conn, uint32_t dwKey, const void* pData, int32_t iLength);
+
+/* The output a connection has queued (in bytes) */
+extern int32_t reactor_output_queued(LPREACTORCONN conn);
+
+/* Sets the output budget of the connections of a reactor */
+extern void reactor_set_output_budget(LPREACTOR reactor, int32_t iSoftLimit, int32_t iHardLimit, int32_t iPolicy);
+
+/* Sets the output budget of all the connections of the process */
+extern void reactor_set_global_output_budget(int64_t llLimit);
+
+/* Gets what the output budgets did */
+extern void reactor_get_output_stats(LPREACTOR reactor, TReactorOutputStats* pStats);
+
+/* Queues the output of a connection for the end-of-tick flush, after writing to conn->output directly */
+extern void reactor_mark_dirty(LPREACTORCONN conn);
+
+/* Sends the output of every connection marked dirty */
+extern int32_t reactor_flush_dirty(LPREACTOR reactor);
+
+/* Makes reactor_send send right away (false) or at the end of the tick (true, the default) */
+extern void reactor_set_coalesce(LPREACTOR reactor, bool bCoalesce);
+
+/* Sends the queued data of a connection until the socket refuses more */
+extern int32_t reactor_flush(LPREACTORCONN conn);
+
+/* Closes a connection */
+extern void reactor_close(LPREACTORCONN conn, int32_t iError = 0);
+
+#endif
@@ -0,0 +1,401 @@
+#include "stdafx.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+
+/* the shard run by the calling thread */
+static thread_local LPREACTORSHARD reactor_shard_self = nullptr;
+
+/***
+ * reactor_shard_queue_init - Makes a queue empty.
+ * @queue: The queue.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_shard_queue_init(TReactorShardQueue* queue)
+{
+	queue->stub.next.store(nullptr, std::memory_order_relaxed);
+	queue->head.store(&queue->stub, std::memory_order_relaxed);
+	queue->tail = &queue->stub;
+	queue->wake_pending.store(false, std::memory_order_relaxed);
+}
+
+/***
+ * reactor_shard_queue_push - Appends a message, from any thread.
+ * @queue: The queue.
+ * @message: The message.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_shard_queue_push(TReactorShardQueue* queue, TReactorShardMessage* message)
+{
+	message->next.store(nullptr, std::memory_order_relaxed);
+
+	/* the message is in the queue from here, linked to its predecessor on the next line */
+	TReactorShardMessage* prev = queue->head.exchange(message, std::memory_order_acq_rel);
+	prev->next.store(message, std::memory_order_release);
+}
+
+/***
+ * reactor_shard_queue_pop - Takes the first message, from the consumer thread.
+ * @queue: The queue.
+ *
+ * Return: The message, or nullptr if the queue is empty or a producer is
+ * between the two steps of a push (the message is taken on the next call).
+ */
+static TReactorShardMessage* reactor_shard_queue_pop(TReactorShardQueue* queue)
+{
+	TReactorShardMessage* tail = queue->tail;
+	TReactorShardMessage* next = tail->next.load(std::memory_order_acquire);
+
+	if (tail == &queue->stub)
+	{
+		if (!next)
+		{
+			return (nullptr);
+		}
+
+		queue->tail = next;
+		tail = next;
+		next = next->next.load(std::memory_order_acquire);
+	}
+
+	if (next)
+	{
+		queue->tail = next;
+		return (tail);
+	}
+
+	if (tail != queue->head.load(std::memory_order_acquire))
+	{
+		return (nullptr);
+	}
+
+	/* tail is the last message, the stub goes behind it so it can be taken */
+	reactor_shard_queue_push(queue, &queue->stub);
+	next = tail->next.load(std::memory_order_acquire);
+
+	if (next)
+	{
+		queue->tail = next;
+		return (tail);
+	}
+
+	return (nullptr);
+}
+
+/***
+ * reactor_shard_drain - Runs the tasks posted to a shard.
+ * @shard: The shard.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_shard_drain(LPREACTORSHARD shard)
+{
+	/* cleared first, so a post racing with the loop below sends a new wakeup */
+	shard->queue.wake_pending.store(false, std::memory_order_seq_cst);
+
+	while (TReactorShardMessage* message = reactor_shard_queue_pop(&shard->queue))
+	{
+		message->task(shard, message->data);
+		free(message);
+		++shard->tasks_run;
+	}
+}
+
+/***
+ * reactor_shard_run_tasks - Runs the tasks posted to the shard of the calling thread (on_wake).
+ *
+ * The reactor just woken up is the one of that shard.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_shard_run_tasks(LPREACTOR /* reactor */)
+{
+	reactor_shard_drain(reactor_shard_self);
+}
+
+/***
+ * reactor_shard_post - Runs a task on the thread of a shard.
+ * @shard: The shard.
+ * @task: The task, called with the shard and data.
+ * @data: The argument of the task.
+ *
+ * Safe to call from any thread, including the shard's own. The tasks a
+ * thread posts to a shard run in the order they were posted, on the next
+ * poll of the shard. Threads other than the shards must stop posting
+ * before reactor_group_stop is called.
+ *
+ * Return: true on success, false if the group is not running.
+ */
+bool reactor_shard_post(LPREACTORSHARD shard, TReactorShardTask task, void* data)
+{
+	if (!shard->group->running.load(std::memory_order_acquire))
+	{
+		return (false);
+	}
+
+	TReactorShardMessage* message;
+	CREATE(message, TReactorShardMessage, 1);
+	message->task = task;
+	message->data = data;
+
+	reactor_shard_queue_push(&shard->queue, message);
+
+	if (!shard->queue.wake_pending.exchange(true, std::memory_order_seq_cst))
+	{
+		reactor_wakeup(shard->reactor);
+	}
+
+	return (true);
+}
+
+/***
+ * reactor_shard_current - Gets the shard of the calling thread.
+ *
+ * Return: The shard, or nullptr outside of shard threads.
+ */
+LPREACTORSHARD reactor_shard_current()
+{
+	return (reactor_shard_self);
+}
+
+/***
+ * reactor_shard_main - The thread of a shard.
+ * @arg: The shard.
+ *
+ * Return: nullptr
+ */
+static void* reactor_shard_main(void* arg)
+{
+	LPREACTORSHARD shard = (LPREACTORSHARD)arg;
+	LPREACTORGROUP group = shard->group;
+
+	reactor_shard_self = shard;
+	log_set_thread_tag(shard->log_tag);
+
+	if (shard->cpu >= 0)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(shard->cpu, &set);
+
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		{
+			sys_log(0, "reactor_shard_main: can't pin %s to cpu %d", shard->log_tag, shard->cpu);
+		}
+	}
+
+	if (group->on_thread_start)
+	{
+		group->on_thread_start(shard);
+	}
+
+	int32_t iIdlePolls = 0;
+
+	while (group->running.load(std::memory_order_acquire))
+	{
+		int32_t iEvents = reactor_poll(shard->reactor, REACTOR_SHARD_TICK_MS);
+		if (iEvents < 0)
+		{
+			break;
+		}
+
+		/* an idle shard doesn't keep the buffers of its last burst to itself */
+		if (iEvents > 0)
+		{
+			iIdlePolls = 0;
+		}
+		else if (++iIdlePolls == REACTOR_SHARD_IDLE_TRIM_POLLS)
+		{
+			buffer_thread_cache_trim();
+		}
+	}
+
+	/* the connections close on this thread, the reactor is freed once every shard stopped */
+	reactor_shard_drain(shard);
+
+	while (shard->reactor->conns)
+	{
+		reactor_close(shard->reactor->conns);
+	}
+
+	if (group->on_thread_stop)
+	{
+		group->on_thread_stop(shard);
+	}
+
+	log_set_thread_tag(nullptr);
+	reactor_shard_self = nullptr;
+	return (nullptr);
+}
+
+/***
+ * reactor_group_new - Creates a group of shards.
+ * @callbacks: What the reactors call on socket events, copied. The
+ *	callbacks run on the thread of the shard owning the connection.
+ * @iShards: The amount of shards, 0 for one per online core.
+ * @iBackend: EReactorBackend of the reactors.
+ *
+ * Shard i is pinned to core i when there are no more shards than cores.
+ * Set on_thread_start/on_thread_stop before reactor_group_start to give
+ * each thread its own state.
+ *
+ * Return: The group, not started yet.
+ */
+LPREACTORGROUP reactor_group_new(const TReactorCallbacks* callbacks, int32_t iShards, int32_t iBackend)
+{
+	const int32_t iCores = std::max<int32_t>(1, (int32_t)sysconf(_SC_NPROCESSORS_ONLN));
+
+	if (iShards <= 0)
+	{
+		iShards = iCores;
+	}
+
+	LPREACTORGROUP group;
+	CREATE(group, TReactorGroup, 1);
+	CREATE(group->shards, TReactorShard, iShards);
+
+	group->shard_count = iShards;
+	group->callbacks = *callbacks;
+	group->backend = iBackend;
+
+	for (int32_t i = 0; i < iShards; ++i)
+	{
+		LPREACTORSHARD shard = &group->shards[i];
+
+		shard->index = i;
+		shard->cpu = (iShards <= iCores) ? i : -1;
+		shard->group = group;
+		snprintf(shard->log_tag, sizeof(shard->log_tag), "shard%d", i);
+		reactor_shard_queue_init(&shard->queue);
+	}
+
+	return (group);
+}
+
+/***
+ * reactor_group_start - Creates the listening sockets of the shards and starts their threads.
+ * @group: The group.
+ * @szHost: The address to bind to, nullptr for any.
+ * @wPort: The port to bind to, 0 for any (see port).
+ *
+ * Every shard binds its own socket to the port with SO_REUSEPORT, and the
+ * kernel spreads the incoming connections over them, so no lock or shared
+ * accept queue sits between the shards.
+ *
+ * Return: true on success, false otherwise (nothing is left running).
+ */
+bool reactor_group_start(LPREACTORGROUP group, const char* szHost, uint16_t wPort)
+{
+	if (group->running.load(std::memory_order_acquire))
+	{
+		sys_err("reactor_group_start: the group is already running on port %u", group->port);
+		return (false);
+	}
+
+	for (int32_t i = 0; i < group->shard_count; ++i)
+	{
+		LPREACTORSHARD shard = &group->shards[i];
+
+		shard->reactor = reactor_new(&group->callbacks, group->backend);
+
+		if (!shard->reactor || !reactor_set_wakeup(shard->reactor, reactor_shard_run_tasks) || !reactor_listen(shard->reactor, szHost, wPort, SOMAXCONN, true))
+		{
+			sys_err("reactor_group_start: can't start %s", shard->log_tag);
+			reactor_group_stop(group);
+			return (false);
+		}
+
+		/* the first shard picks the port when any will do, the others join it */
+		wPort = shard->reactor->listen_port;
+	}
+
+	group->port = wPort;
+	group->running.store(true, std::memory_order_release);
+
+	for (int32_t i = 0; i < group->shard_count; ++i)
+	{
+		LPREACTORSHARD shard = &group->shards[i];
+
+		if (pthread_create(&shard->thread, nullptr, reactor_shard_main, shard) != 0)
+		{
+			sys_err("reactor_group_start: can't create the thread of %s", shard->log_tag);
+			reactor_group_stop(group);
+			return (false);
+		}
+
+		shard->started = true;
+	}
+
+	sys_log(0, "reactor_group_start: %d shards listening on port %u", group->shard_count, group->port);
+	return (true);
+}
+
+/***
+ * reactor_group_stop - Stops the threads of the shards.
+ * @group: The group.
+ *
+ * Each shard runs the tasks already posted to it and closes its
+ * connections (on_close is called on its thread). The reactors are freed
+ * once every thread stopped, so a shard posting to another one while they
+ * stop never wakes a freed reactor; the tasks still queued then run on the
+ * calling thread.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_group_stop(LPREACTORGROUP group)
+{
+	group->running.store(false, std::memory_order_release);
+
+	for (int32_t i = 0; i < group->shard_count; ++i)
+	{
+		LPREACTORSHARD shard = &group->shards[i];
+
+		if (shard->started)
+		{
+			reactor_wakeup(shard->reactor);
+		}
+	}
+
+	for (int32_t i = 0; i < group->shard_count; ++i)
+	{
+		LPREACTORSHARD shard = &group->shards[i];
+
+		if (shard->started)
+		{
+			pthread_join(shard->thread, nullptr);
+			shard->started = false;
+		}
+	}
+
+	for (int32_t i = 0; i < group->shard_count; ++i)
+	{
+		LPREACTORSHARD shard = &group->shards[i];
+
+		if (shard->reactor)
+		{
+			reactor_shard_drain(shard);
+			reactor_delete(shard->reactor);
+			shard->reactor = nullptr;
+		}
+
+		reactor_shard_queue_init(&shard->queue);
+	}
+}
+
+/***
+ * reactor_group_delete - Stops the group if it runs and frees it.
+ * @group: The group.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_group_delete(LPREACTORGROUP group)
+{
+	reactor_group_stop(group);
+
+	free(group->shards);
+	free(group);
+}
+#endif
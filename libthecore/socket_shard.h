@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+#if defined(__linux__)
+
+#include <pthread.h>
+
+/* most time a shard waits in reactor_poll before checking whether it has to stop (in milliseconds) */
+#define REACTOR_SHARD_TICK_MS 100
+
+/* polls in a row without events before a shard hands its cached buffers back, see buffer_thread_cache_trim */
+#define REACTOR_SHARD_IDLE_TRIM_POLLS 50
+
+typedef struct SReactorShard TReactorShard;
+typedef TReactorShard* LPREACTORSHARD;
+
+typedef struct SReactorGroup TReactorGroup;
+typedef TReactorGroup* LPREACTORGROUP;
+
+/* A task posted to a shard, run on its thread */
+typedef void (*TReactorShardTask)(LPREACTORSHARD shard, void* data);
+
+/***
+ * TReactorShardMessage - a task waiting in the queue of a shard.
+ */
+typedef struct SReactorShardMessage
+{
+	/* The next message, written by the thread that posts it */
+	std::atomic<SReactorShardMessage*> next;
+
+	/* What to run and its argument */
+	TReactorShardTask task;
+	void* data;
+} TReactorShardMessage;
+
+/***
+ * TReactorShardQueue - a lock-free queue of messages, with many producers
+ * and a single consumer. Posting is one atomic exchange, and taking
+ * needs none. A stub message keeps the queue from ever being empty, so
+ * producers and the consumer don't race for the same pointer.
+ */
+typedef struct SReactorShardQueue
+{
+	/* The last message, where producers append */
+	std::atomic<TReactorShardMessage*> head;
+
+	/* The first message, where the consumer takes */
+	TReactorShardMessage* tail;
+
+	/* The stub message */
+	TReactorShardMessage stub;
+
+	/* A wakeup was sent and not handled yet, so further posts don't send one */
+	std::atomic<bool> wake_pending;
+} TReactorShardQueue;
+
+/***
+ * TReactorShard - a reactor with its own listening socket, run by its own
+ * thread pinned to a core. A connection stays on the shard that accepted it.
+ */
+struct SReactorShard
+{
+	/* The index of the shard in its group */
+	int32_t index;
+
+	/* The core the thread is pinned to, -1 if it isn't */
+	int32_t cpu;
+
+	/* The group of the shard */
+	LPREACTORGROUP group;
+
+	/* The reactor, used by the thread of the shard only */
+	LPREACTOR reactor;
+
+	/* The thread */
+	pthread_t thread;
+	bool started;
+
+	/* The tasks posted by other threads */
+	TReactorShardQueue queue;
+
+	/* The tag of the lines the shard logs, e.g. "shard3" */
+	char log_tag[16];
+
+	/* The amount of tasks the shard ran */
+	uint64_t tasks_run;
+};
+
+/***
+ * TReactorGroup - the shards serving one port.
+ */
+struct SReactorGroup
+{
+	/* The shards */
+	LPREACTORSHARD shards;
+	int32_t shard_count;
+
+	/* The port every shard listens on */
+	uint16_t port;
+
+	/* What the reactors of the shards call on socket events */
+	TReactorCallbacks callbacks;
+
+	/* EReactorBackend */
+	int32_t backend;
+
+	/* Called by each shard thread before it polls and after it stopped, can be nullptr */
+	void (*on_thread_start)(LPREACTORSHARD shard);
+	void (*on_thread_stop)(LPREACTORSHARD shard);
+
+	/* Cleared by reactor_group_stop */
+	std::atomic<bool> running;
+};
+
+/* Creates a group of iShards shards (0 for one per core) */
+extern LPREACTORGROUP reactor_group_new(const TReactorCallbacks* callbacks, int32_t iShards = 0, int32_t iBackend = REACTOR_BACKEND_EPOLL);
+
+/* Stops the group if it runs and frees it */
+extern void reactor_group_delete(LPREACTORGROUP group);
+
+/* Creates the listening sockets of the shards and starts their threads */
+extern bool reactor_group_start(LPREACTORGROUP group, const char* szHost, uint16_t wPort);
+
+/* Stops the threads of the shards, every connection is closed */
+extern void reactor_group_stop(LPREACTORGROUP group);
+
+/* Runs a task on the thread of a shard, from any thread */
+extern bool reactor_shard_post(LPREACTORSHARD shard, TReactorShardTask task, void* data);
+
+/* The shard of the calling thread, nullptr outside of shard threads */
+extern LPREACTORSHARD reactor_shard_current();
+
+#endif
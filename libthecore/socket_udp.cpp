@@ -0,0 +1,536 @@
+#include "stdafx.h"
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <unistd.h>
+
+/* buckets of the session table of a new channel, a power of 2 */
+#define UDP_CHANNEL_BUCKETS 256
+
+/* receive buffer asked of the kernel, so a burst between two ticks is not dropped */
+#define UDP_CHANNEL_SOCKET_BUFFER (4 * 1024 * 1024)
+
+/***
+ * udp_store_le32 - Stores an integer in little endian.
+ * @dst: Where to store it, unaligned.
+ * @val: The integer.
+ *
+ * Return: Nothing (void)
+ */
+static inline void udp_store_le32(void* dst, uint32_t val)
+{
+#if defined(BUFFER_BIG_ENDIAN)
+	val = BUFFER_BSWAP32(val);
+#endif
+	memcpy(dst, &val, sizeof(val));
+}
+
+/***
+ * udp_session_bucket - Gets the bucket of a session id.
+ * @channel: The channel.
+ * @dwId: The session id.
+ *
+ * Return: The index of the bucket.
+ */
+static inline int32_t udp_session_bucket(LPUDPCHANNEL channel, uint32_t dwId)
+{
+	return ((int32_t)(((uint64_t)dwId * 0x9E3779B97F4A7C15ull) >> 32) & channel->bucket_mask);
+}
+
+/***
+ * udp_channel_reset_recv_slot - Points a receive slot of the batch at its buffer.
+ * @channel: The channel.
+ * @i: The slot.
+ *
+ * Return: Nothing (void)
+ */
+static void udp_channel_reset_recv_slot(LPUDPCHANNEL channel, int32_t i)
+{
+	channel->recv_iov[i].iov_base = channel->recv_buffers[i]->mem_data;
+	channel->recv_iov[i].iov_len = UDP_CHANNEL_MAX_DATAGRAM;
+
+	msghdr* hdr = &channel->recv_msgs[i].msg_hdr;
+	hdr->msg_name = &channel->recv_addrs[i];
+	hdr->msg_namelen = sizeof(sockaddr_in);
+	hdr->msg_iov = &channel->recv_iov[i];
+	hdr->msg_iovlen = 1;
+	hdr->msg_flags = 0;
+}
+
+/***
+ * udp_channel_new - Creates a channel.
+ * @szHost: The address to bind to, nullptr for any.
+ * @wPort: The port to bind to, 0 for any (see port).
+ * @iFlags: EUdpChannelFlags.
+ *
+ * Return: The channel, or nullptr on failure.
+ */
+LPUDPCHANNEL udp_channel_new(const char* szHost, uint16_t wPort, int32_t iFlags)
+{
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(wPort);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (szHost && inet_pton(AF_INET, szHost, &addr.sin_addr) != 1)
+	{
+		sys_err("udp_channel_new: invalid address %s", szHost);
+		return (nullptr);
+	}
+
+	const socket_t fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	if (fd < 0)
+	{
+		sys_err("udp_channel_new: socket failed, Error[%d] : %s", errno, strerror(errno));
+		return (nullptr);
+	}
+
+	const int iSize = UDP_CHANNEL_SOCKET_BUFFER;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &iSize, sizeof(iSize));
+
+	socklen_t iAddrLength = sizeof(addr);
+	if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || getsockname(fd, (sockaddr*)&addr, &iAddrLength) < 0)
+	{
+		sys_err("udp_channel_new: can't bind %s:%u, Error[%d] : %s", szHost ? szHost : "*", wPort, errno, strerror(errno));
+		close(fd);
+		return (nullptr);
+	}
+
+	LPUDPCHANNEL channel;
+	CREATE(channel, TUdpChannel, 1);
+	CREATE(channel->buckets, LPUDPSESSION, UDP_CHANNEL_BUCKETS);
+	CREATE(channel->tick, TUdpDatagram, UDP_CHANNEL_MAX_TICK);
+
+	channel->fd = fd;
+	channel->port = ntohs(addr.sin_port);
+	channel->flags = iFlags;
+	channel->bucket_mask = UDP_CHANNEL_BUCKETS - 1;
+
+	for (int32_t i = 0; i < UDP_CHANNEL_BATCH; ++i)
+	{
+		channel->recv_buffers[i] = buffer_new(UDP_CHANNEL_MAX_DATAGRAM);
+		udp_channel_reset_recv_slot(channel, i);
+	}
+
+	return (channel);
+}
+
+/***
+ * udp_channel_delete - Frees a channel with its sessions.
+ * @channel: The channel.
+ *
+ * The datagrams still queued are dropped.
+ *
+ * Return: Nothing (void)
+ */
+void udp_channel_delete(LPUDPCHANNEL channel)
+{
+	udp_channel_release(channel);
+
+	for (int32_t i = 0; i < channel->send_count; ++i)
+	{
+		buffer_delete(channel->send_buffers[i]);
+	}
+
+	for (int32_t i = 0; i < UDP_CHANNEL_BATCH; ++i)
+	{
+		buffer_delete(channel->recv_buffers[i]);
+	}
+
+	for (int32_t i = 0; i <= channel->bucket_mask; ++i)
+	{
+		while (channel->buckets[i])
+		{
+			LPUDPSESSION session = channel->buckets[i];
+			channel->buckets[i] = session->next;
+			free(session);
+		}
+	}
+
+	close(channel->fd);
+	free(channel->buckets);
+	free(channel->tick);
+	free(channel);
+}
+
+/***
+ * udp_channel_grow - Doubles the buckets of the session table.
+ * @channel: The channel.
+ *
+ * Return: Nothing (void)
+ */
+static void udp_channel_grow(LPUDPCHANNEL channel)
+{
+	LPUDPSESSION* old = channel->buckets;
+	const int32_t iOldCount = channel->bucket_mask + 1;
+
+	CREATE(channel->buckets, LPUDPSESSION, iOldCount * 2);
+	channel->bucket_mask = iOldCount * 2 - 1;
+
+	for (int32_t i = 0; i < iOldCount; ++i)
+	{
+		while (old[i])
+		{
+			LPUDPSESSION session = old[i];
+			old[i] = session->next;
+
+			const int32_t iBucket = udp_session_bucket(channel, session->id);
+			session->next = channel->buckets[iBucket];
+			channel->buckets[iBucket] = session;
+		}
+	}
+
+	free(old);
+}
+
+/***
+ * udp_channel_add_session - Registers a session.
+ * @channel: The channel.
+ * @dwId: The id the client puts in its datagrams.
+ * @pUserData: Free for the user.
+ *
+ * Return: The session, or nullptr if the id is taken.
+ */
+LPUDPSESSION udp_channel_add_session(LPUDPCHANNEL channel, uint32_t dwId, void* pUserData)
+{
+	if (udp_channel_find_session(channel, dwId))
+	{
+		sys_err("udp_channel_add_session: session %u already exists", dwId);
+		return (nullptr);
+	}
+
+	if (channel->session_count > channel->bucket_mask)
+	{
+		udp_channel_grow(channel);
+	}
+
+	LPUDPSESSION session;
+	CREATE(session, TUdpSession, 1);
+
+	session->id = dwId;
+	session->tick_index = -1;
+	session->user_data = pUserData;
+
+	const int32_t iBucket = udp_session_bucket(channel, dwId);
+	session->next = channel->buckets[iBucket];
+	channel->buckets[iBucket] = session;
+	++channel->session_count;
+
+	return (session);
+}
+
+/***
+ * udp_channel_find_session - Finds a session by id.
+ * @channel: The channel.
+ * @dwId: The session id.
+ *
+ * Return: The session, or nullptr if there is none.
+ */
+LPUDPSESSION udp_channel_find_session(LPUDPCHANNEL channel, uint32_t dwId)
+{
+	for (LPUDPSESSION session = channel->buckets[udp_session_bucket(channel, dwId)]; session; session = session->next)
+	{
+		if (session->id == dwId)
+		{
+			return (session);
+		}
+	}
+
+	return (nullptr);
+}
+
+/***
+ * udp_channel_remove_session - Forgets a session.
+ * @channel: The channel.
+ * @session: The session, freed.
+ *
+ * Can be called while the tick's datagrams are handled: a datagram of the
+ * session left in the tick gets a nullptr session.
+ *
+ * Return: Nothing (void)
+ */
+void udp_channel_remove_session(LPUDPCHANNEL channel, LPUDPSESSION session)
+{
+	for (int32_t i = 0; i < channel->tick_count; ++i)
+	{
+		if (channel->tick[i].session == session)
+		{
+			channel->tick[i].session = nullptr;
+		}
+	}
+
+	LPUDPSESSION* link = &channel->buckets[udp_session_bucket(channel, session->id)];
+
+	while (*link && *link != session)
+	{
+		link = &(*link)->next;
+	}
+
+	if (*link)
+	{
+		*link = session->next;
+		--channel->session_count;
+	}
+
+	free(session);
+}
+
+/***
+ * udp_channel_accept - Checks a received datagram and adds it to the tick.
+ * @channel: The channel.
+ * @i: The receive slot holding it.
+ *
+ * The slot gets a new buffer when the datagram is kept, otherwise its
+ * buffer receives again.
+ *
+ * Return: Nothing (void)
+ */
+static void udp_channel_accept(LPUDPCHANNEL channel, int32_t i)
+{
+	const mmsghdr* msg = &channel->recv_msgs[i];
+	const int32_t iLength = (int32_t)msg->msg_len;
+
+	if ((msg->msg_hdr.msg_flags & MSG_TRUNC) || iLength < UDP_CHANNEL_HEADER_SIZE)
+	{
+		++channel->stats.dropped_malformed;
+		return;
+	}
+
+	LPBUFFER buffer = channel->recv_buffers[i];
+	const uint32_t dwId = buffer_load_le32(buffer->mem_data);
+	const uint32_t dwSequence = buffer_load_le32(buffer->mem_data + 4);
+
+	LPUDPSESSION session = udp_channel_find_session(channel, dwId);
+
+	if (!session)
+	{
+		++channel->stats.dropped_unknown;
+		return;
+	}
+
+	/* serial number arithmetic, so the sequence can wrap around */
+	if (session->recv_any && (int32_t)(dwSequence - session->recv_sequence) <= 0)
+	{
+		++channel->stats.dropped_stale;
+		return;
+	}
+
+	session->recv_sequence = dwSequence;
+	session->recv_any = true;
+	session->addr = channel->recv_addrs[i];
+
+	buffer_write_proceed(buffer, iLength);
+	buffer_read_proceed(buffer, UDP_CHANNEL_HEADER_SIZE);
+
+	channel->recv_buffers[i] = buffer_new(UDP_CHANNEL_MAX_DATAGRAM);
+
+	if ((channel->flags & UDP_CHANNEL_LATEST_ONLY) && session->tick_index >= 0)
+	{
+		TUdpDatagram* datagram = &channel->tick[session->tick_index];
+
+		buffer_delete(datagram->buffer);
+		datagram->sequence = dwSequence;
+		datagram->buffer = buffer;
+
+		++channel->stats.superseded;
+		return;
+	}
+
+	TUdpDatagram* datagram = &channel->tick[channel->tick_count];
+	datagram->session = session;
+	datagram->sequence = dwSequence;
+	datagram->buffer = buffer;
+
+	session->tick_index = channel->tick_count++;
+	++channel->stats.accepted;
+}
+
+/***
+ * udp_channel_poll - Receives what the socket holds and returns the datagrams accepted this tick.
+ * @channel: The channel.
+ * @ppDatagrams: Set to the datagrams, valid until udp_channel_release.
+ *
+ * Called once per tick. The socket is drained with recvmmsg, up to
+ * UDP_CHANNEL_BATCH datagrams per call, straight into pooled TBuffers.
+ * Datagrams of unknown sessions, malformed ones and the ones older than
+ * what the session already sent are dropped. With UDP_CHANNEL_LATEST_ONLY
+ * a session has at most one datagram per tick, its newest.
+ *
+ * Return: The amount of datagrams.
+ */
+int32_t udp_channel_poll(LPUDPCHANNEL channel, TUdpDatagram** ppDatagrams)
+{
+	udp_channel_release(channel);
+
+	/* bounds the work of a tick when a flood keeps the socket full */
+	for (int32_t iReceived = 0; iReceived < UDP_CHANNEL_MAX_TICK && channel->tick_count < UDP_CHANNEL_MAX_TICK;)
+	{
+		const int32_t iWanted = std::min(UDP_CHANNEL_BATCH, UDP_CHANNEL_MAX_TICK - channel->tick_count);
+		const int32_t iCount = recvmmsg(channel->fd, channel->recv_msgs, iWanted, MSG_DONTWAIT, nullptr);
+
+		if (iCount < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				sys_err("udp_channel_poll: recvmmsg failed, Error[%d] : %s", errno, strerror(errno));
+			}
+
+			break;
+		}
+
+		++channel->stats.recv_calls;
+		channel->stats.received += iCount;
+		iReceived += iCount;
+
+		for (int32_t i = 0; i < iCount; ++i)
+		{
+			udp_channel_accept(channel, i);
+			udp_channel_reset_recv_slot(channel, i);
+		}
+
+		if (iCount < iWanted)
+		{
+			break;
+		}
+	}
+
+	*ppDatagrams = channel->tick;
+	return (channel->tick_count);
+}
+
+/***
+ * udp_channel_release - Gives the buffers of the tick's datagrams back to the pool.
+ * @channel: The channel.
+ *
+ * Return: Nothing (void)
+ */
+void udp_channel_release(LPUDPCHANNEL channel)
+{
+	for (int32_t i = 0; i < channel->tick_count; ++i)
+	{
+		TUdpDatagram* datagram = &channel->tick[i];
+
+		if (datagram->session)
+		{
+			datagram->session->tick_index = -1;
+		}
+
+		buffer_delete(datagram->buffer);
+	}
+
+	channel->tick_count = 0;
+}
+
+/***
+ * udp_channel_send - Queues a datagram to a session.
+ * @channel: The channel.
+ * @session: The session, its address is known once it sent a datagram.
+ * @pData: The payload.
+ * @iLength: The size of the payload (in bytes).
+ *
+ * The header is added here. A full batch is flushed first.
+ *
+ * Return: true on success, false if the session has no address yet or the payload is too big.
+ */
+bool udp_channel_send(LPUDPCHANNEL channel, LPUDPSESSION session, const void* pData, int32_t iLength)
+{
+	if (session->addr.sin_family != AF_INET)
+	{
+		return (false);
+	}
+
+	if (iLength < 0 || iLength > UDP_CHANNEL_MAX_DATAGRAM - UDP_CHANNEL_HEADER_SIZE)
+	{
+		sys_err("udp_channel_send: payload of %d bytes, at most %d fit", iLength, UDP_CHANNEL_MAX_DATAGRAM - UDP_CHANNEL_HEADER_SIZE);
+		return (false);
+	}
+
+	if (channel->send_count == UDP_CHANNEL_BATCH)
+	{
+		udp_channel_flush(channel);
+	}
+
+	LPBUFFER buffer = buffer_new(UDP_CHANNEL_HEADER_SIZE + iLength);
+	uint8_t* dst = (uint8_t*)buffer_write_peek(buffer);
+
+	udp_store_le32(dst, session->id);
+	udp_store_le32(dst + 4, ++session->send_sequence);
+	memcpy(dst + UDP_CHANNEL_HEADER_SIZE, pData, iLength);
+	buffer_write_proceed(buffer, UDP_CHANNEL_HEADER_SIZE + iLength);
+
+	const int32_t i = channel->send_count++;
+	channel->send_buffers[i] = buffer;
+	channel->send_addrs[i] = session->addr;
+	channel->send_iov[i].iov_base = buffer->mem_data;
+	channel->send_iov[i].iov_len = buffer->length;
+
+	msghdr* hdr = &channel->send_msgs[i].msg_hdr;
+	memset(hdr, 0, sizeof(msghdr));
+	hdr->msg_name = &channel->send_addrs[i];
+	hdr->msg_namelen = sizeof(sockaddr_in);
+	hdr->msg_iov = &channel->send_iov[i];
+	hdr->msg_iovlen = 1;
+
+	return (true);
+}
+
+/***
+ * udp_channel_flush - Sends the queued datagrams with sendmmsg.
+ * @channel: The channel.
+ *
+ * Called at the end of the tick, next to reactor_flush_dirty. The
+ * datagrams the socket refuses are dropped rather than kept for the next
+ * tick, which will carry newer state anyway.
+ *
+ * Return: The amount of datagrams sent.
+ */
+int32_t udp_channel_flush(LPUDPCHANNEL channel)
+{
+	int32_t iNext = 0;
+	int32_t iSent = 0;
+
+	while (iNext < channel->send_count)
+	{
+		const int32_t iResult = sendmmsg(channel->fd, channel->send_msgs + iNext, channel->send_count - iNext, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+		if (iResult > 0)
+		{
+			++channel->stats.send_calls;
+			iNext += iResult;
+			iSent += iResult;
+			continue;
+		}
+
+		if (iResult < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (iResult < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			break;
+		}
+
+		/* the first datagram failed on its own (e.g. an unreachable address), skip it */
+		++iNext;
+	}
+
+	channel->stats.sent += iSent;
+	channel->stats.send_failed += channel->send_count - iSent;
+
+	for (int32_t i = 0; i < channel->send_count; ++i)
+	{
+		buffer_delete(channel->send_buffers[i]);
+	}
+
+	channel->send_count = 0;
+	return (iSent);
+}
+#endif
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__linux__)
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/* datagrams received or sent by a single recvmmsg/sendmmsg call */
+#define UDP_CHANNEL_BATCH 64
+
+/* largest datagram received, bigger ones are truncated and dropped */
+#define UDP_CHANNEL_MAX_DATAGRAM 1472
+
+/* most datagrams handed to the game loop by one udp_channel_poll */
+#define UDP_CHANNEL_MAX_TICK 4096
+
+/* the header of every datagram: the session id then the sequence number, both little endian */
+#define UDP_CHANNEL_HEADER_SIZE 8
+
+/* Options of a channel */
+enum EUdpChannelFlags
+{
+	/* hand the game loop only the newest datagram of each session per tick */
+	UDP_CHANNEL_LATEST_ONLY = (1 << 0),
+};
+
+typedef struct SUdpChannel TUdpChannel;
+typedef TUdpChannel* LPUDPCHANNEL;
+
+/***
+ * TUdpSession - a peer of the channel, registered by the game when the
+ * TCP login hands the client its session id. The id is the only thing
+ * tying a datagram to a session, so it should be random rather than a
+ * counter. The address is learned from the newest accepted datagram,
+ * which follows clients behind a NAT rebinding their port.
+ */
+typedef struct SUdpSession
+{
+	/* The id the client puts in its datagrams */
+	uint32_t id;
+
+	/* The address of the peer, family is 0 until a datagram was accepted */
+	sockaddr_in addr;
+
+	/* The newest sequence number received, see recv_any */
+	uint32_t recv_sequence;
+	bool recv_any;
+
+	/* The sequence number of the next datagram sent */
+	uint32_t send_sequence;
+
+	/* The index of its datagram in the current tick (UDP_CHANNEL_LATEST_ONLY), -1 if none */
+	int32_t tick_index;
+
+	/* Free for the user, e.g. the character */
+	void* user_data;
+
+	/* The next session of the same hash bucket */
+	SUdpSession* next;
+} TUdpSession;
+
+typedef TUdpSession* LPUDPSESSION;
+
+/***
+ * TUdpDatagram - a datagram accepted this tick.
+ */
+typedef struct SUdpDatagram
+{
+	/* The session it belongs to */
+	LPUDPSESSION session;
+
+	/* Its sequence number */
+	uint32_t sequence;
+
+	/* The payload, the header is already read */
+	LPBUFFER buffer;
+} TUdpDatagram;
+
+/***
+ * TUdpChannelStats - what a channel did with the datagrams it saw.
+ */
+typedef struct SUdpChannelStats
+{
+	/* Datagrams received, accepted or not */
+	uint64_t received;
+
+	/* Datagrams handed to the game loop */
+	uint64_t accepted;
+
+	/* Datagrams older than one already received from the session */
+	uint64_t dropped_stale;
+
+	/* Datagrams of an unknown session */
+	uint64_t dropped_unknown;
+
+	/* Datagrams shorter than the header or truncated */
+	uint64_t dropped_malformed;
+
+	/* Datagrams replaced by a newer one of the same tick (UDP_CHANNEL_LATEST_ONLY) */
+	uint64_t superseded;
+
+	/* Datagrams sent, and the sendmmsg calls that sent them */
+	uint64_t sent;
+	uint64_t send_calls;
+
+	/* Datagrams the socket refused */
+	uint64_t send_failed;
+
+	/* The recvmmsg calls */
+	uint64_t recv_calls;
+} TUdpChannelStats;
+
+/***
+ * TUdpChannel - a non-blocking UDP socket carrying state updates (position,
+ * movement) that go stale within a tick, next to the TCP connections of
+ * the reactor. A lost or late datagram is never waited for: the newer one
+ * replaces it.
+ *
+ * Once per tick the game loop calls udp_channel_poll, which drains the
+ * socket with recvmmsg into pooled TBuffers and returns the accepted
+ * datagrams, then udp_channel_release once it handled them. Sends are
+ * queued by udp_channel_send and leave together on udp_channel_flush.
+ */
+struct SUdpChannel
+{
+	/* The socket */
+	socket_t fd;
+
+	/* The port the socket is bound to */
+	uint16_t port;
+
+	/* EUdpChannelFlags */
+	int32_t flags;
+
+	/* The sessions, hashed by id */
+	LPUDPSESSION* buckets;
+	int32_t bucket_mask;
+	int32_t session_count;
+
+	/* The receive slots of a recvmmsg batch */
+	LPBUFFER recv_buffers[UDP_CHANNEL_BATCH];
+	mmsghdr recv_msgs[UDP_CHANNEL_BATCH];
+	iovec recv_iov[UDP_CHANNEL_BATCH];
+	sockaddr_in recv_addrs[UDP_CHANNEL_BATCH];
+
+	/* The datagrams accepted this tick */
+	TUdpDatagram* tick;
+	int32_t tick_count;
+
+	/* The datagrams queued for udp_channel_flush */
+	LPBUFFER send_buffers[UDP_CHANNEL_BATCH];
+	mmsghdr send_msgs[UDP_CHANNEL_BATCH];
+	iovec send_iov[UDP_CHANNEL_BATCH];
+	sockaddr_in send_addrs[UDP_CHANNEL_BATCH];
+	int32_t send_count;
+
+	/* What the channel did */
+	TUdpChannelStats stats;
+};
+
+/* Creates a channel bound to szHost:wPort (nullptr for any address, 0 for any port) */
+extern LPUDPCHANNEL udp_channel_new(const char* szHost, uint16_t wPort, int32_t iFlags = UDP_CHANNEL_LATEST_ONLY);
+
+/* Frees a channel with its sessions */
+extern void udp_channel_delete(LPUDPCHANNEL channel);
+
+/* Registers a session, nullptr if the id is taken */
+extern LPUDPSESSION udp_channel_add_session(LPUDPCHANNEL channel, uint32_t dwId, void* pUserData);
+
+/* Finds a session by id */
+extern LPUDPSESSION udp_channel_find_session(LPUDPCHANNEL channel, uint32_t dwId);
+
+/* Forgets a session */
+extern void udp_channel_remove_session(LPUDPCHANNEL channel, LPUDPSESSION session);
+
+/* Receives what the socket holds and returns the datagrams accepted this tick */
+extern int32_t udp_channel_poll(LPUDPCHANNEL channel, TUdpDatagram** ppDatagrams);
+
+/* Gives the buffers of the tick's datagrams back to the pool */
+extern void udp_channel_release(LPUDPCHANNEL channel);
+
+/* Queues a datagram to a session, sent by udp_channel_flush */
+extern bool udp_channel_send(LPUDPCHANNEL channel, LPUDPSESSION session, const void* pData, int32_t iLength);
+
+/* Sends the queued datagrams with sendmmsg */
+extern int32_t udp_channel_flush(LPUDPCHANNEL channel);
+
+#endif
@@ -0,0 +1,918 @@
+#include "stdafx.h"
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <unistd.h>
+
+/* the receive buffers form buffer group 0 */
+#define REACTOR_URING_GROUP 0
+
+/* the operation of a completion is kept in the low bits of its user_data, next to the connection pointer */
+#define REACTOR_URING_OP_MASK 7ull
+
+/* Operations submitted to the ring */
+enum EReactorUringOp
+{
+	REACTOR_URING_OP_CANCEL,
+	REACTOR_URING_OP_ACCEPT,
+	REACTOR_URING_OP_RECV,
+	REACTOR_URING_OP_SEND,
+	REACTOR_URING_OP_WAKE,
+};
+
+/***
+ * TReactorUring - the rings shared with the kernel and the receive buffers.
+ */
+struct SReactorUring
+{
+	/* The ring */
+	int32_t ring_fd;
+
+	/* The submission queue: the kernel moves head, we move tail */
+	uint32_t* sq_head;
+	uint32_t* sq_tail;
+	uint32_t* sq_array;
+	uint32_t sq_mask;
+	uint32_t sq_entries;
+	io_uring_sqe* sqes;
+
+	/* The entries prepared, and the part of them already given to io_uring_enter */
+	uint32_t sq_prepared;
+	uint32_t sq_submitted;
+
+	/* The completion queue: the kernel moves tail, we move head */
+	uint32_t* cq_head;
+	uint32_t* cq_tail;
+	uint32_t cq_mask;
+	io_uring_cqe* cqes;
+
+	/* The mappings of the rings */
+	void* sq_ring;
+	size_t sq_ring_size;
+	void* cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+
+	/* The ring of receive buffers the kernel picks from */
+	io_uring_buf* buf_ring;
+	size_t buf_ring_size;
+	uint16_t buf_tail;
+
+	/* The receive buffers, indexed by buffer id */
+	LPBUFFER buffers[REACTOR_URING_BUFFERS];
+
+	/* The operations in flight, multishot ones count until their last completion */
+	int32_t inflight;
+
+	/* Whether the multishot accept is armed */
+	bool accepting;
+};
+
+static inline int32_t reactor_uring_setup(uint32_t dwEntries, io_uring_params* params)
+{
+	return ((int32_t)syscall(__NR_io_uring_setup, dwEntries, params));
+}
+
+static inline int32_t reactor_uring_enter(int32_t iFd, uint32_t dwSubmit, uint32_t dwMinComplete, uint32_t dwFlags, void* pArg, size_t iArgSize)
+{
+	return ((int32_t)syscall(__NR_io_uring_enter, iFd, dwSubmit, dwMinComplete, dwFlags, pArg, iArgSize));
+}
+
+static inline int32_t reactor_uring_register(int32_t iFd, uint32_t dwOpcode, void* pArg, uint32_t dwArgs)
+{
+	return ((int32_t)syscall(__NR_io_uring_register, iFd, dwOpcode, pArg, dwArgs));
+}
+
+/***
+ * reactor_uring_free - Unmaps the rings and frees the receive buffers.
+ * @uring: The ring, possibly partially set up.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_uring_free(TReactorUring* uring)
+{
+	if (uring->ring_fd >= 0)
+	{
+		close(uring->ring_fd);
+	}
+
+	if (uring->buf_ring)
+	{
+		munmap(uring->buf_ring, uring->buf_ring_size);
+	}
+
+	if (uring->sqes)
+	{
+		munmap(uring->sqes, uring->sqes_size);
+	}
+
+	if (uring->cq_ring && uring->cq_ring != uring->sq_ring)
+	{
+		munmap(uring->cq_ring, uring->cq_ring_size);
+	}
+
+	if (uring->sq_ring)
+	{
+		munmap(uring->sq_ring, uring->sq_ring_size);
+	}
+
+	for (int32_t i = 0; i < REACTOR_URING_BUFFERS; ++i)
+	{
+		if (uring->buffers[i])
+		{
+			buffer_delete(uring->buffers[i]);
+		}
+	}
+
+	free(uring);
+}
+
+/***
+ * reactor_uring_provide - Gives a receive buffer (back) to the kernel.
+ * @uring: The ring.
+ * @wBufferId: The buffer id.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_uring_provide(TReactorUring* uring, uint16_t wBufferId)
+{
+	io_uring_buf* entry = &uring->buf_ring[uring->buf_tail & (REACTOR_URING_BUFFERS - 1)];
+
+	entry->addr = (uint64_t)(uintptr_t)uring->buffers[wBufferId]->mem_data;
+	entry->len = REACTOR_READ_SIZE;
+	entry->bid = wBufferId;
+
+	/* the tail of the buffer ring overlays the reserved field of its first entry */
+	++uring->buf_tail;
+	__atomic_store_n(&uring->buf_ring[0].resv, uring->buf_tail, __ATOMIC_RELEASE);
+}
+
+/* defined with the other submission helpers below */
+static bool reactor_uring_probe_recv(TReactorUring* uring);
+
+/***
+ * reactor_uring_new - Creates a ring.
+ *
+ * Needs multishot receives and provided buffer rings (Linux 6.0). The
+ * kernel is probed for each part, so an older kernel or a sandbox that
+ * forbids io_uring gets nullptr and the reactor falls back to epoll.
+ *
+ * Return: The ring, or nullptr if io_uring can't be used.
+ */
+TReactorUring* reactor_uring_new()
+{
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = REACTOR_URING_ENTRIES * 4;
+
+	const int32_t iRingFd = reactor_uring_setup(REACTOR_URING_ENTRIES, &params);
+
+	if (iRingFd < 0)
+	{
+		sys_log(0, "reactor_uring_new: io_uring is unavailable, Error[%d] : %s", errno, strerror(errno));
+		return (nullptr);
+	}
+
+	TReactorUring* uring;
+	CREATE(uring, TReactorUring, 1);
+	uring->ring_fd = iRingFd;
+
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+	{
+		sys_log(0, "reactor_uring_new: the kernel io_uring is too old [Features: %x]", params.features);
+		reactor_uring_free(uring);
+		return (nullptr);
+	}
+
+	/* one mapping holds both the submission and the completion ring */
+	uring->sq_ring_size = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(uint32_t), params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+	uring->sq_ring = mmap(nullptr, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, iRingFd, IORING_OFF_SQ_RING);
+	uring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	uring->sqes = (io_uring_sqe*)mmap(nullptr, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, iRingFd, IORING_OFF_SQES);
+
+	if (uring->sq_ring == MAP_FAILED || uring->sqes == MAP_FAILED)
+	{
+		sys_err("reactor_uring_new: mmap failed, Error[%d] : %s", errno, strerror(errno));
+		uring->sq_ring = (uring->sq_ring == MAP_FAILED) ? nullptr : uring->sq_ring;
+		uring->sqes = (uring->sqes == MAP_FAILED) ? nullptr : uring->sqes;
+		reactor_uring_free(uring);
+		return (nullptr);
+	}
+
+	uring->cq_ring = uring->sq_ring;
+	uring->cq_ring_size = uring->sq_ring_size;
+
+	char* sq = (char*)uring->sq_ring;
+	uring->sq_head = (uint32_t*)(sq + params.sq_off.head);
+	uring->sq_tail = (uint32_t*)(sq + params.sq_off.tail);
+	uring->sq_array = (uint32_t*)(sq + params.sq_off.array);
+	uring->sq_mask = *(uint32_t*)(sq + params.sq_off.ring_mask);
+	uring->sq_entries = params.sq_entries;
+	uring->sq_prepared = uring->sq_submitted = *uring->sq_tail;
+
+	char* cq = (char*)uring->cq_ring;
+	uring->cq_head = (uint32_t*)(cq + params.cq_off.head);
+	uring->cq_tail = (uint32_t*)(cq + params.cq_off.tail);
+	uring->cq_mask = *(uint32_t*)(cq + params.cq_off.ring_mask);
+	uring->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	/* the ring of receive buffers, registered as buffer group 0 */
+	uring->buf_ring_size = REACTOR_URING_BUFFERS * sizeof(io_uring_buf);
+	uring->buf_ring = (io_uring_buf*)mmap(nullptr, uring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (uring->buf_ring == MAP_FAILED)
+	{
+		sys_err("reactor_uring_new: mmap failed, Error[%d] : %s", errno, strerror(errno));
+		uring->buf_ring = nullptr;
+		reactor_uring_free(uring);
+		return (nullptr);
+	}
+
+	io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)uring->buf_ring;
+	reg.ring_entries = REACTOR_URING_BUFFERS;
+	reg.bgid = REACTOR_URING_GROUP;
+
+	if (reactor_uring_register(iRingFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+	{
+		sys_log(0, "reactor_uring_new: provided buffer rings are unavailable, Error[%d] : %s", errno, strerror(errno));
+		reactor_uring_free(uring);
+		return (nullptr);
+	}
+
+	/* pooled buffers of the receive size come from the slabs, so they share a few mappings */
+	for (int32_t i = 0; i < REACTOR_URING_BUFFERS; ++i)
+	{
+		uring->buffers[i] = buffer_new(REACTOR_READ_SIZE);
+		reactor_uring_provide(uring, (uint16_t)i);
+	}
+
+	/* Linux 5.19 has the buffer rings but fails every multishot receive */
+	if (!reactor_uring_probe_recv(uring))
+	{
+		sys_log(0, "reactor_uring_new: multishot receives are unavailable");
+		reactor_uring_free(uring);
+		return (nullptr);
+	}
+
+	return (uring);
+}
+
+/***
+ * reactor_uring_submit - Hands the prepared entries to the kernel and waits for completions.
+ * @uring: The ring.
+ * @dwMinComplete: The amount of completions to wait for, 0 not to wait.
+ * @iTimeoutMS: The longest time to wait (in milliseconds), -1 for no limit.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_uring_submit(TReactorUring* uring, uint32_t dwMinComplete, int32_t iTimeoutMS)
+{
+	__atomic_store_n(uring->sq_tail, uring->sq_prepared, __ATOMIC_RELEASE);
+
+	const uint32_t dwSubmit = uring->sq_prepared - uring->sq_submitted;
+
+	if (dwSubmit == 0 && dwMinComplete == 0)
+	{
+		return;
+	}
+
+	__kernel_timespec ts;
+	io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+
+	uint32_t dwFlags = IORING_ENTER_EXT_ARG;
+
+	if (dwMinComplete > 0)
+	{
+		dwFlags |= IORING_ENTER_GETEVENTS;
+
+		if (iTimeoutMS >= 0)
+		{
+			ts.tv_sec = iTimeoutMS / 1000;
+			ts.tv_nsec = (iTimeoutMS % 1000) * 1000000ll;
+			arg.ts = (uint64_t)(uintptr_t)&ts;
+		}
+	}
+
+	const int32_t iResult = reactor_uring_enter(uring->ring_fd, dwSubmit, dwMinComplete, dwFlags, &arg, sizeof(arg));
+
+	if (iResult >= 0)
+	{
+		uring->sq_submitted += iResult;
+	}
+	else if (errno != EINTR && errno != ETIME && errno != EBUSY && errno != EAGAIN)
+	{
+		sys_err("reactor_uring_submit: io_uring_enter failed, Error[%d] : %s", errno, strerror(errno));
+	}
+}
+
+/***
+ * reactor_uring_get_sqe - Gets a free submission entry.
+ * @uring: The ring.
+ * @qwUserData: The value the completion of the entry will carry.
+ *
+ * When the queue is full the prepared entries are submitted first.
+ *
+ * Return: The zeroed entry, or nullptr if the queue stays full.
+ */
+static io_uring_sqe* reactor_uring_get_sqe(TReactorUring* uring, uint64_t qwUserData)
+{
+	if (uring->sq_prepared - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) >= uring->sq_entries)
+	{
+		reactor_uring_submit(uring, 0, 0);
+
+		if (uring->sq_prepared - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) >= uring->sq_entries)
+		{
+			sys_err("reactor_uring_get_sqe: the submission queue is full");
+			return (nullptr);
+		}
+	}
+
+	const uint32_t dwIndex = uring->sq_prepared & uring->sq_mask;
+	io_uring_sqe* sqe = &uring->sqes[dwIndex];
+
+	memset(sqe, 0, sizeof(io_uring_sqe));
+	sqe->user_data = qwUserData;
+	uring->sq_array[dwIndex] = dwIndex;
+	++uring->sq_prepared;
+	++uring->inflight;
+
+	return (sqe);
+}
+
+/***
+ * reactor_uring_probe_recv - Checks that the kernel supports multishot receives.
+ * @uring: The ring, with the receive buffers provided.
+ *
+ * A byte followed by the end of the stream is received from a socket pair.
+ * A kernel with multishot receives delivers the byte with IORING_CQE_F_MORE
+ * set and ends the receive at the end of the stream, an older one fails the
+ * receive with -EINVAL.
+ *
+ * Return: true if multishot receives work.
+ */
+static bool reactor_uring_probe_recv(TReactorUring* uring)
+{
+	int aiPair[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, aiPair) < 0)
+	{
+		sys_err("reactor_uring_probe_recv: socketpair failed, Error[%d] : %s", errno, strerror(errno));
+		return (false);
+	}
+
+	const char cProbe = 0;
+	const bool bWritten = write(aiPair[1], &cProbe, 1) == 1;
+	close(aiPair[1]);
+
+	io_uring_sqe* sqe = bWritten ? reactor_uring_get_sqe(uring, REACTOR_URING_OP_CANCEL) : nullptr;
+
+	if (!sqe)
+	{
+		close(aiPair[0]);
+		return (false);
+	}
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = aiPair[0];
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = REACTOR_URING_GROUP;
+
+	bool bMultishot = false;
+	bool bEnded = false;
+
+	/* the byte and the end of the stream may complete in separate waits */
+	for (int32_t iWait = 0; iWait < 3 && !bEnded; ++iWait)
+	{
+		reactor_uring_submit(uring, 1, 1000);
+
+		uint32_t dwHead = *uring->cq_head;
+		const uint32_t dwTail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+
+		for (; dwHead != dwTail; ++dwHead)
+		{
+			const io_uring_cqe* cqe = &uring->cqes[dwHead & uring->cq_mask];
+
+			if (cqe->flags & IORING_CQE_F_BUFFER)
+			{
+				const uint16_t wBufferId = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+				buffer_reset(uring->buffers[wBufferId]);
+				reactor_uring_provide(uring, wBufferId);
+			}
+
+			if (cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE))
+			{
+				bMultishot = true;
+			}
+
+			if (!(cqe->flags & IORING_CQE_F_MORE))
+			{
+				--uring->inflight;
+				bEnded = true;
+			}
+		}
+
+		__atomic_store_n(uring->cq_head, dwHead, __ATOMIC_RELEASE);
+	}
+
+	close(aiPair[0]);
+	return (bMultishot && bEnded);
+}
+
+/***
+ * reactor_uring_arm_accept - Arms the multishot accept of the listening socket.
+ * @reactor: The reactor.
+ *
+ * Return: true on success, false if the queue is full.
+ */
+static bool reactor_uring_arm_accept(LPREACTOR reactor)
+{
+	io_uring_sqe* sqe = reactor_uring_get_sqe(reactor->uring, REACTOR_URING_OP_ACCEPT);
+
+	if (!sqe)
+	{
+		return (false);
+	}
+
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = reactor->listen_fd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+
+	reactor->uring->accepting = true;
+	return (true);
+}
+
+/***
+ * reactor_uring_arm_recv - Arms the multishot receive of a connection.
+ * @conn: The connection.
+ *
+ * Return: true on success, false if the queue is full.
+ */
+static bool reactor_uring_arm_recv(LPREACTORCONN conn)
+{
+	io_uring_sqe* sqe = reactor_uring_get_sqe(conn->reactor->uring, (uint64_t)(uintptr_t)conn | REACTOR_URING_OP_RECV);
+
+	if (!sqe)
+	{
+		return (false);
+	}
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = conn->fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = REACTOR_URING_GROUP;
+
+	++conn->pending_ops;
+	return (true);
+}
+
+/***
+ * reactor_uring_watch_wakeup - Arms the multishot poll of the wakeup eventfd.
+ * @reactor: The reactor, wake_fd is set.
+ *
+ * Return: true on success, false if the queue is full.
+ */
+bool reactor_uring_watch_wakeup(LPREACTOR reactor)
+{
+	io_uring_sqe* sqe = reactor_uring_get_sqe(reactor->uring, REACTOR_URING_OP_WAKE);
+
+	if (!sqe)
+	{
+		return (false);
+	}
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = reactor->wake_fd;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->poll32_events = POLLIN;
+
+	return (true);
+}
+
+/***
+ * reactor_uring_on_wake - Handles a completion of the wakeup poll.
+ * @reactor: The reactor.
+ * @cqe: The completion.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_uring_on_wake(LPREACTOR reactor, const io_uring_cqe* cqe)
+{
+	const bool bMore = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+	if (!bMore)
+	{
+		--reactor->uring->inflight;
+	}
+
+	if (cqe->res == -ECANCELED)
+	{
+		return;
+	}
+
+	if (cqe->res > 0)
+	{
+		reactor_woken(reactor);
+	}
+
+	if (!bMore && !reactor_uring_watch_wakeup(reactor))
+	{
+		sys_err("reactor_uring_on_wake: can't rearm the wakeup poll");
+	}
+}
+
+/***
+ * reactor_uring_listen - Arms the multishot accept of the listening socket.
+ * @reactor: The reactor, listen_fd is set.
+ *
+ * Return: true on success, false otherwise.
+ */
+bool reactor_uring_listen(LPREACTOR reactor)
+{
+	return (reactor_uring_arm_accept(reactor));
+}
+
+/***
+ * reactor_uring_attach - Arms the multishot receive of a new connection.
+ * @conn: The connection.
+ *
+ * Return: true on success, false otherwise.
+ */
+bool reactor_uring_attach(LPREACTORCONN conn)
+{
+	return (reactor_uring_arm_recv(conn));
+}
+
+/***
+ * reactor_uring_prepare_sends - Prepares a send for every connection with queued output.
+ * @reactor: The reactor.
+ *
+ * A connection has at most one send in flight. Its output buffer is handed
+ * to the kernel as is and replaced by an empty one, so writing more output
+ * never moves data the kernel is reading.
+ *
+ * Return: The amount of sends prepared.
+ */
+static int32_t reactor_uring_prepare_sends(LPREACTOR reactor)
+{
+	int32_t iPrepared = 0;
+
+	while (reactor->dirty)
+	{
+		LPREACTORCONN conn = reactor->dirty;
+		reactor->dirty = conn->next_dirty;
+		conn->flags &= ~REACTOR_CONN_DIRTY;
+
+		if (conn->flags & (REACTOR_CONN_CLOSING | REACTOR_CONN_SENDING))
+		{
+			continue;
+		}
+
+		if (!conn->sending)
+		{
+			reactor_release_states(conn);
+
+			if (conn->output->length == 0)
+			{
+				continue;
+			}
+
+			conn->sending = conn->output;
+			conn->output = buffer_new(REACTOR_OUTPUT_SIZE);
+		}
+
+		io_uring_sqe* sqe = reactor_uring_get_sqe(reactor->uring, (uint64_t)(uintptr_t)conn | REACTOR_URING_OP_SEND);
+
+		if (!sqe)
+		{
+			reactor_close(conn, ENOBUFS);
+			continue;
+		}
+
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = conn->fd;
+		sqe->addr = (uint64_t)(uintptr_t)buffer_read_peek(conn->sending);
+		sqe->len = conn->sending->length;
+		sqe->msg_flags = MSG_NOSIGNAL;
+
+		conn->flags |= REACTOR_CONN_SENDING;
+		++conn->pending_ops;
+		++iPrepared;
+	}
+
+	return (iPrepared);
+}
+
+/***
+ * reactor_uring_flush - Submits the sends of the dirty connections without waiting.
+ * @reactor: The reactor.
+ *
+ * Return: The amount of sends submitted.
+ */
+int32_t reactor_uring_flush(LPREACTOR reactor)
+{
+	const int32_t iPrepared = reactor_uring_prepare_sends(reactor);
+	reactor_uring_submit(reactor->uring, 0, 0);
+	return (iPrepared);
+}
+
+/***
+ * reactor_uring_on_accept - Handles a completion of the multishot accept.
+ * @reactor: The reactor.
+ * @cqe: The completion.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_uring_on_accept(LPREACTOR reactor, const io_uring_cqe* cqe)
+{
+	if (!(cqe->flags & IORING_CQE_F_MORE))
+	{
+		reactor->uring->accepting = false;
+		--reactor->uring->inflight;
+	}
+
+	if (cqe->res >= 0)
+	{
+		if (reactor->listen_fd < 0)
+		{
+			close(cqe->res);
+			return;
+		}
+
+		LPREACTORCONN conn = reactor_attach(reactor, cqe->res);
+
+		if (conn && reactor->callbacks.on_accept && !reactor->callbacks.on_accept(conn))
+		{
+			reactor_close(conn);
+		}
+	}
+	else if (cqe->res != -ECANCELED)
+	{
+		sys_err("reactor_uring_on_accept: accept failed, Error[%d] : %s", -cqe->res, strerror(-cqe->res));
+	}
+
+	if (!reactor->uring->accepting && reactor->listen_fd >= 0 && cqe->res != -ECANCELED)
+	{
+		reactor_uring_arm_accept(reactor);
+	}
+}
+
+/***
+ * reactor_uring_on_recv - Handles a completion of a multishot receive.
+ * @conn: The connection.
+ * @cqe: The completion.
+ *
+ * The data is in the receive buffer the kernel picked. When the input of
+ * the connection is empty, which is the usual case once its packets are
+ * handled, the two buffers are swapped and nothing is copied. Otherwise the
+ * data is appended to the input. Either way an empty buffer goes back to
+ * the kernel.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_uring_on_recv(LPREACTORCONN conn, const io_uring_cqe* cqe)
+{
+	LPREACTOR reactor = conn->reactor;
+	TReactorUring* uring = reactor->uring;
+	const bool bMore = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+	if (!bMore)
+	{
+		--conn->pending_ops;
+		--uring->inflight;
+	}
+
+	if (cqe->flags & IORING_CQE_F_BUFFER)
+	{
+		const uint16_t wBufferId = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+		LPBUFFER buffer = uring->buffers[wBufferId];
+
+		if (cqe->res > 0 && !(conn->flags & REACTOR_CONN_CLOSING))
+		{
+			if (conn->input->length == 0 && conn->input->mem_size >= REACTOR_READ_SIZE && conn->input->mem_size <= 4 * REACTOR_READ_SIZE && !conn->input->shared)
+			{
+				buffer_write_proceed(buffer, cqe->res);
+				uring->buffers[wBufferId] = conn->input;
+				conn->input = buffer;
+			}
+			else
+			{
+				buffer_write(conn->input, buffer->mem_data, cqe->res);
+			}
+		}
+
+		buffer_reset(uring->buffers[wBufferId]);
+		reactor_uring_provide(uring, wBufferId);
+	}
+
+	if (conn->flags & REACTOR_CONN_CLOSING)
+	{
+		return;
+	}
+
+	if (cqe->res == 0)
+	{
+		reactor_close(conn);
+		return;
+	}
+
+	if (cqe->res < 0 && cqe->res != -ENOBUFS)
+	{
+		reactor_close(conn, -cqe->res);
+		return;
+	}
+
+	if (cqe->res > 0)
+	{
+		if (!reactor_deliver(conn))
+		{
+			return;
+		}
+
+		if (conn->input->length >= reactor->max_input)
+		{
+			sys_err("reactor_uring_on_recv: input of fd %d is over %d bytes", conn->fd, reactor->max_input);
+			reactor_close(conn, EMSGSIZE);
+			return;
+		}
+	}
+
+	/* the kernel ends a multishot receive when it runs out of buffers */
+	if (!bMore && !reactor_uring_arm_recv(conn))
+	{
+		reactor_close(conn, ENOBUFS);
+	}
+}
+
+/***
+ * reactor_uring_on_send - Handles a completion of a send.
+ * @conn: The connection.
+ * @cqe: The completion.
+ *
+ * Return: Nothing (void)
+ */
+static void reactor_uring_on_send(LPREACTORCONN conn, const io_uring_cqe* cqe)
+{
+	--conn->pending_ops;
+	--conn->reactor->uring->inflight;
+	conn->flags &= ~REACTOR_CONN_SENDING;
+
+	if (conn->flags & REACTOR_CONN_CLOSING)
+	{
+		return;
+	}
+
+	if (cqe->res < 0)
+	{
+		reactor_close(conn, -cqe->res);
+		return;
+	}
+
+	buffer_read_proceed(conn->sending, cqe->res);
+
+	if (conn->sending->length == 0)
+	{
+		buffer_delete(conn->sending);
+		conn->sending = nullptr;
+	}
+
+	reactor_account_output(conn);
+
+	/* the rest of a short send, or the output written or held back meanwhile */
+	if (conn->sending || conn->output->length > 0 || conn->state_count > 0)
+	{
+		reactor_mark_dirty(conn);
+	}
+}
+
+/***
+ * reactor_uring_reap - Handles the completions in the queue.
+ * @reactor: The reactor.
+ *
+ * Return: The amount of completions handled.
+ */
+static int32_t reactor_uring_reap(LPREACTOR reactor)
+{
+	TReactorUring* uring = reactor->uring;
+	uint32_t dwHead = *uring->cq_head;
+	const uint32_t dwTail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+	const int32_t iCount = (int32_t)(dwTail - dwHead);
+
+	for (; dwHead != dwTail; ++dwHead)
+	{
+		const io_uring_cqe* cqe = &uring->cqes[dwHead & uring->cq_mask];
+		const uint64_t qwOp = cqe->user_data & REACTOR_URING_OP_MASK;
+		LPREACTORCONN conn = (LPREACTORCONN)(uintptr_t)(cqe->user_data & ~REACTOR_URING_OP_MASK);
+
+		switch (qwOp)
+		{
+			case REACTOR_URING_OP_ACCEPT:
+				reactor_uring_on_accept(reactor, cqe);
+				break;
+
+			case REACTOR_URING_OP_RECV:
+				reactor_uring_on_recv(conn, cqe);
+				break;
+
+			case REACTOR_URING_OP_SEND:
+				reactor_uring_on_send(conn, cqe);
+				break;
+
+			case REACTOR_URING_OP_WAKE:
+				reactor_uring_on_wake(reactor, cqe);
+				break;
+
+			default:
+				--uring->inflight;
+				break;
+		}
+	}
+
+	__atomic_store_n(uring->cq_head, dwHead, __ATOMIC_RELEASE);
+	return (iCount);
+}
+
+/***
+ * reactor_uring_poll - Submits the queued sends, waits for completions and handles them.
+ * @reactor: The reactor.
+ * @iTimeoutMS: The longest time to wait (in milliseconds), -1 for no limit.
+ *
+ * The sends queued since the last poll and the wait for completions share a
+ * single io_uring_enter call, so a tick costs one syscall however many
+ * connections it writes to.
+ *
+ * Return: The amount of completions handled.
+ */
+int32_t reactor_uring_poll(LPREACTOR reactor, int32_t iTimeoutMS)
+{
+	TReactorUring* uring = reactor->uring;
+
+	reactor_uring_prepare_sends(reactor);
+
+	/* completions already waiting are handled without blocking */
+	const bool bReady = *uring->cq_head != __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+	reactor_uring_submit(uring, bReady ? 0 : 1, iTimeoutMS);
+
+	return (reactor_uring_reap(reactor));
+}
+
+/***
+ * reactor_uring_delete - Cancels what is in flight, waits for it and frees the ring.
+ * @reactor: The reactor, its connections are closed already.
+ *
+ * The kernel may still write to the receive buffers until the cancelled
+ * operations complete, so they are waited for (up to a second) before the
+ * buffers go back to the pool.
+ *
+ * Return: Nothing (void)
+ */
+void reactor_uring_delete(LPREACTOR reactor)
+{
+	TReactorUring* uring = reactor->uring;
+
+	if (uring->accepting)
+	{
+		io_uring_sqe* sqe = reactor_uring_get_sqe(uring, REACTOR_URING_OP_CANCEL);
+
+		if (sqe)
+		{
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = REACTOR_URING_OP_ACCEPT;
+		}
+	}
+
+	if (reactor->wake_fd >= 0)
+	{
+		io_uring_sqe* sqe = reactor_uring_get_sqe(uring, REACTOR_URING_OP_CANCEL);
+
+		if (sqe)
+		{
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = REACTOR_URING_OP_WAKE;
+		}
+	}
+
+	for (int32_t i = 0; i < 100 && uring->inflight > 0; ++i)
+	{
+		reactor_uring_submit(uring, 1, 10);
+		reactor_uring_reap(reactor);
+	}
+
+	if (uring->inflight > 0)
+	{
+		sys_err("reactor_uring_delete: %d operations still in flight", uring->inflight);
+	}
+
+	reactor_uring_free(uring);
+	reactor->uring = nullptr;
+}
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__linux__)
+
+/* submission queue entries of a ring, the completion queue gets 4 times as many */
+#define REACTOR_URING_ENTRIES 2048
+
+/* receive buffers provided to the kernel, a power of 2 */
+#define REACTOR_URING_BUFFERS 512
+
+typedef struct SReactorUring TReactorUring;
+
+/***
+ * The io_uring backend of the reactor (REACTOR_BACKEND_URING). It talks to the
+ * kernel through the raw io_uring syscalls:
+ *	- every connection has one multishot receive armed, the kernel picks a
+ *	  buffer for each completion from a ring of pooled TBuffers
+ *	- the listening socket has one multishot accept armed
+ *	- reactor_send only marks the connection dirty, the sends of every dirty
+ *	  connection are submitted together by the next reactor_poll, in the same
+ *	  io_uring_enter call that waits for completions
+ * These functions are called by socket_reactor.cpp, not by users.
+ */
+
+/* Creates a ring, nullptr if io_uring or one of the features used is unavailable */
+extern TReactorUring* reactor_uring_new();
+
+/* Cancels what is in flight, waits for it and frees the ring */
+extern void reactor_uring_delete(LPREACTOR reactor);
+
+/* Arms the multishot accept of the listening socket */
+extern bool reactor_uring_listen(LPREACTOR reactor);
+
+/* Arms the multishot receive of a new connection */
+extern bool reactor_uring_attach(LPREACTORCONN conn);
+
+/* Arms the multishot poll of the wakeup eventfd */
+extern bool reactor_uring_watch_wakeup(LPREACTOR reactor);
+
+/* Submits the sends of the dirty connections without waiting */
+extern int32_t reactor_uring_flush(LPREACTOR reactor);
+
+/* Submits the queued sends, waits for completions and handles them */
+extern int32_t reactor_uring_poll(LPREACTOR reactor, int32_t iTimeoutMS);
+
+/* Hands the received data of a connection to on_read, shared by the backends */
+extern bool reactor_deliver(LPREACTORCONN conn);
+
+/* Resets the wakeup eventfd and calls on_wake, shared by the backends */
+extern void reactor_woken(LPREACTOR reactor);
+
+/* Moves the held back state updates to the output once it is under budget, shared by the backends */
+extern void reactor_release_states(LPREACTORCONN conn);
+
+/* Updates the global count of queued output, shared by the backends */
+extern void reactor_account_output(LPREACTORCONN conn);
+
+#endif
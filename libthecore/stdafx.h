@@ -4,10 +4,22 @@
 
 #include "utils.h"
 #include "log.h"
+#include "cpu.h"
 #include "memcpy.h"
 #include "typedef.h"
 #include "buffer.h"
+#include "buffer_slab.h"
+#include "buffer_chain.h"
+#include "buffer_reader.h"
+#include "buffer_compress.h"
+#include "buffer_cipher.h"
 #include "buffer_manager.h"
+#include "packet_schema.h"
+#include "packet_dispatcher.h"
+#include "socket_reactor.h"
+#include "socket_uring.h"
+#include "socket_shard.h"
+#include "socket_udp.h"
 
 #include <cerrno>
 #include <cstdint>
@@ -16,13 +28,19 @@
 #include <cctype>  // For isprint
 #include <fstream>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <type_traits>
 #include <cassert>
 #include <stddef.h>
 #include <cmath>
 #if defined(_WIN64)
 #define strdup _strdup
 #include <time.h>
+#include <winsock2.h>
 #include <windows.h>
+#include <intrin.h>
 #include <sys/stat.h>
 #else
 #include <sys/time.h>